@@ -0,0 +1,97 @@
+#include "AdminServer.h"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#define ADMIN_MAX_LINE 4096 //一行命令的最大长度，超过后断开连接
+AdminServer::AdminServer(EventLoop* loop, const SockAddress& listenaddr)
+    : loop_(loop), server_(new TcpServer(loop, listenaddr, 0)), commands_() {
+    server_->SetNewConnectionCallback(std::bind(&AdminServer::HandleNewConnection, this, std::placeholders::_1));
+    server_->SetMessageCallback(std::bind(&AdminServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
+    RegisterCommand("help", "list commands", std::bind(&AdminServer::Help, this, std::placeholders::_1));
+}
+AdminServer::AdminServer(TcpServer* host, const SockAddress& listenaddr, const ServerOptions& options)
+    : loop_(host->GetLoop()), server_(), commands_() {
+    TcpServer::Listener* listener = host->AddListener("admin", listenaddr, options);
+    listener->SetNewConnectionCallback(std::bind(&AdminServer::HandleNewConnection, this, std::placeholders::_1));
+    listener->SetMessageCallback(std::bind(&AdminServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
+    RegisterCommand("help", "list commands", std::bind(&AdminServer::Help, this, std::placeholders::_1));
+}
+AdminServer::~AdminServer() {
+}
+void AdminServer::RegisterCommand(const std::string& name, const std::string& help, const CommandHandler& handler) {
+    Command command;
+    command.help = help;
+    command.handler = handler;
+    commands_[name] = command;
+}
+void AdminServer::Start() {
+    if (server_) {
+        server_->Start();
+    }
+}
+void AdminServer::HandleNewConnection(const TcpConnectionPtr& conn) {
+    std::cout << "Admin connection from " << conn->GetPeerAddr().ToString() << std::endl;
+    //与监听socket一样先于业务连接处理
+    conn->SetPriority(Channel::PRIORITY_HIGH);
+}
+void AdminServer::HandleMessage(const TcpConnectionPtr& conn, std::string& message) {
+    size_t start = 0;
+    size_t end;
+    std::vector<std::string> lines;
+    while ((end = message.find('\n', start)) != std::string::npos) {
+        std::string line = message.substr(start, end - start);
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        start = end + 1;
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    message.erase(0, start);
+    if (!lines.empty()) {
+        if (std::this_thread::get_id() == loop_->GetThreadId()) {
+            ExecuteLines(conn, lines);
+        } else {
+            //作为附加监听时连接在IO线程上，命令仍在主loop执行，回复由Send投递回连接所属的IO线程
+            loop_->AddTask(std::bind(&AdminServer::ExecuteLines, this, conn, lines));
+        }
+    }
+    if (message.size() > ADMIN_MAX_LINE) {
+        std::cerr << "Admin command line too long, closing connection." << std::endl;
+        conn->Shutdown();
+    }
+}
+void AdminServer::ExecuteLines(const TcpConnectionPtr& conn, const std::vector<std::string>& lines) {
+    std::string reply;
+    for (auto &line : lines) {
+        reply += Execute(line);
+    }
+    conn->Send(std::move(reply));
+}
+std::string AdminServer::Execute(const std::string& line) {
+    std::istringstream in(line);
+    std::string name;
+    in >> name;
+    std::vector<std::string> args;
+    std::string arg;
+    while (in >> arg) {
+        args.push_back(arg);
+    }
+    auto it = commands_.find(name);
+    if (it == commands_.end()) {
+        return "unknown command: " + name + "\n";
+    }
+    std::string reply = it->second.handler(args);
+    if (reply.empty() || reply[reply.size() - 1] != '\n') {
+        reply += '\n';
+    }
+    return reply;
+}
+std::string AdminServer::Help(const std::vector<std::string>& args) {
+    std::string reply;
+    for (auto &item : commands_) {
+        reply += item.first + " - " + item.second.help + "\n";
+    }
+    return reply;
+}
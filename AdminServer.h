@@ -0,0 +1,44 @@
+#ifndef _ADMINSERVER_H_
+#define _ADMINSERVER_H_
+//管理端口：按行接收命令，每条命令回复一段文本；命令在主loop线程执行，可以直接操作服务器
+//可以独立监听（自己的TcpServer，没有IO线程，连接在主loop上），也可以作为业务服务器的附加监听，连接分到业务服务器的IO线程；
+//附加监听的连接计入业务服务器的连接数和内存上限，会被迁移和内存回收关闭，IO线程卡顿时也跟着卡，运维入口应独立监听
+//只应监听本机地址或Unix域socket，不做认证
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+class AdminServer {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //命令处理函数，args为命令名之后按空格分开的参数，返回值回复给客户端
+  typedef std::function<std::string(const std::vector<std::string>& args)> CommandHandler;
+  AdminServer(EventLoop* loop, const SockAddress& listenaddr);
+  //作为host的附加监听，命令投递到host的主loop执行；host开启热升级时options需开启reuseport，见TcpServer::Listener
+  AdminServer(TcpServer* host, const SockAddress& listenaddr, const ServerOptions& options = ServerOptions());
+  ~AdminServer();
+  //登记命令，须在Start之前调用，内置help列出所有命令
+  void RegisterCommand(const std::string& name, const std::string& help, const CommandHandler& handler);
+  //独立监听时启动服务器，作为附加监听时随host启动
+  void Start();
+private:
+  struct Command {
+    std::string help;
+    CommandHandler handler;
+  };
+  void HandleNewConnection(const TcpConnectionPtr& conn);
+  //一次可能收到多行或半行，半行留在读缓冲里等下次
+  void HandleMessage(const TcpConnectionPtr& conn, std::string& message);
+  //在主loop线程执行一批命令，回复一次发出
+  void ExecuteLines(const TcpConnectionPtr& conn, const std::vector<std::string>& lines);
+  std::string Execute(const std::string& line);
+  std::string Help(const std::vector<std::string>& args);
+  EventLoop* loop_; //执行命令的主loop
+  std::unique_ptr<TcpServer> server_; //独立监听时的服务器，没有IO线程，连接都在主loop上；作为附加监听时为空
+  std::map<std::string, Command> commands_;
+};
+#endif // !_ADMINSERVER_H_
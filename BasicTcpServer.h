@@ -0,0 +1,51 @@
+#ifndef _BASICTCPSERVER_H_
+#define _BASICTCPSERVER_H_
+//编译期确定回调的TcpServer：按Handler类型生成静态跳板函数填进回调表，跳板里直接调用Handler的成员函数，编译器可以内联
+//一次可读事件从Poller到业务代码只经过两次普通函数指针调用（Channel到TcpConnection、TcpConnection到跳板），
+//不经过std::function，每个连接也不再拷贝四个std::bind出来的回调；TcpServer本身即回调类型擦除的版本
+//Handler须提供以下成员函数（可以是私有的，此时把BasicTcpServer<Handler>声明为友元）：
+//  void HandleNewConnection(const TcpConnectionPtr& conn);//在accept线程调用
+//  void HandleMessage(const TcpConnectionPtr& conn, std::string& message);
+//  void HandleSendComplete(const TcpConnectionPtr& conn);
+//  void HandleClose(const TcpConnectionPtr& conn);
+//  void HandleError(const TcpConnectionPtr& conn);
+#include <string>
+#include "TcpServer.h"
+template <typename Handler>
+class BasicTcpServer : public TcpServer {
+public:
+  //handler须比服务器存活更久
+  BasicTcpServer(EventLoop* loop, const SockAddress& listenaddr, Handler* handler, const int threadnum = 0,
+                 const ServerOptions& options = ServerOptions())
+      : TcpServer(loop, listenaddr, threadnum, options), table_() {
+    MakeHandlerTable(handler, table_);
+    SetHandlerTable(&table_);
+  }
+  //按Handler生成回调表，服务器之外自己创建的连接（如Connector连上的）也可以用
+  static void MakeHandlerTable(Handler* handler, HandlerTable& table) {
+    table.connection.owner = handler;
+    table.connection.message = &BasicTcpServer::OnMessage;
+    table.connection.sendcomplete = &BasicTcpServer::OnSendComplete;
+    table.connection.close = &BasicTcpServer::OnClose;
+    table.connection.error = &BasicTcpServer::OnError;
+    table.newconnection = &BasicTcpServer::OnNewConnection;
+  }
+private:
+  static void OnNewConnection(void* owner, const TcpConnectionPtr& conn) {
+    static_cast<Handler*>(owner)->HandleNewConnection(conn);
+  }
+  static void OnMessage(void* owner, const TcpConnectionPtr& conn, std::string& message) {
+    static_cast<Handler*>(owner)->HandleMessage(conn, message);
+  }
+  static void OnSendComplete(void* owner, const TcpConnectionPtr& conn) {
+    static_cast<Handler*>(owner)->HandleSendComplete(conn);
+  }
+  static void OnClose(void* owner, const TcpConnectionPtr& conn) {
+    static_cast<Handler*>(owner)->HandleClose(conn);
+  }
+  static void OnError(void* owner, const TcpConnectionPtr& conn) {
+    static_cast<Handler*>(owner)->HandleError(conn);
+  }
+  HandlerTable table_;
+};
+#endif // !_BASICTCPSERVER_H_
@@ -0,0 +1,128 @@
+#include "BufferPool.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#define REGION_SIZE (2UL << 20) //每次映射的区域大小，与x86的大页一致
+BufferPool::BufferPool()
+    : owner_(std::this_thread::get_id()), refs_(1), remotefree_(nullptr), freelist_(), carve_(), carveend_(), regions_(),
+      hugepages_(false), mapped_(0), hugemapped_(0), inuse_(0), remotefrees_(0) {
+}
+BufferPool::~BufferPool() {
+  for (auto &region : regions_) {
+    munmap(region.base, region.length);
+  }
+}
+void BufferPool::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+bool BufferPool::MapRegion(uint32_t sizeclass) {
+  char* base = nullptr;
+  bool huge = false;
+  if (hugepages_) {
+    void* addr = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+      base = static_cast<char*>(addr);
+      huge = true;
+    }
+  }
+  if (!base) {
+    //多映射一个区域的长度，截出按区域大小对齐的一段，透明大页才能覆盖整个区域
+    void* addr = mmap(NULL, REGION_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      perror("mmap buffer pool");
+      return false;
+    }
+    char* raw = static_cast<char*>(addr);
+    base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + REGION_SIZE - 1) & ~(REGION_SIZE - 1));
+    if (base > raw) {
+      munmap(raw, base - raw);
+    }
+    if (raw + REGION_SIZE * 2 > base + REGION_SIZE) {
+      munmap(base + REGION_SIZE, raw + REGION_SIZE * 2 - (base + REGION_SIZE));
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugepages_) {
+      madvise(base, REGION_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  Region region;
+  region.base = base;
+  region.length = REGION_SIZE;
+  regions_.push_back(region);
+  carve_[sizeclass] = base;
+  carveend_[sizeclass] = base + REGION_SIZE;
+  mapped_.store(mapped_.load(std::memory_order_relaxed) + REGION_SIZE, std::memory_order_relaxed);
+  if (huge) {
+    hugemapped_.store(hugemapped_.load(std::memory_order_relaxed) + REGION_SIZE, std::memory_order_relaxed);
+  }
+  return true;
+}
+void BufferPool::Push(Chunk* chunk) {
+  chunk->next = freelist_[chunk->sizeclass];
+  freelist_[chunk->sizeclass] = chunk;
+  inuse_.store(inuse_.load(std::memory_order_relaxed) - chunk->Size(), std::memory_order_relaxed);
+}
+void BufferPool::Reclaim() {
+  //只有所属线程整条取走，推入方只做CAS压栈，不存在ABA
+  Chunk* chunk = remotefree_.exchange(nullptr, std::memory_order_acquire);
+  uint64_t count = 0;
+  while (chunk) {
+    Chunk* next = chunk->next;
+    Push(chunk);
+    chunk = next;
+    ++count;
+  }
+  remotefrees_.store(remotefrees_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+}
+BufferPool::ChunkPtr BufferPool::Allocate(size_t size) {
+  uint32_t sizeclass = CLASS_4K;
+  while (sizeclass + 1 < CLASSES && ClassSize(sizeclass) - HEADER_SIZE < size) {
+    ++sizeclass;
+  }
+  if (!freelist_[sizeclass] && remotefree_.load(std::memory_order_relaxed)) {
+    Reclaim();
+  }
+  size_t chunksize = ClassSize(sizeclass);
+  Chunk* chunk = freelist_[sizeclass];
+  if (chunk) {
+    freelist_[sizeclass] = chunk->next;
+  } else {
+    if (static_cast<size_t>(carveend_[sizeclass] - carve_[sizeclass]) < chunksize && !MapRegion(sizeclass)) {
+      return ChunkPtr();
+    }
+    chunk = reinterpret_cast<Chunk*>(carve_[sizeclass]);
+    carve_[sizeclass] += chunksize;
+    chunk->pool = this;
+    chunk->sizeclass = sizeclass;
+    chunk->capacity = static_cast<uint32_t>(chunksize - HEADER_SIZE);
+  }
+  chunk->next = nullptr;
+  refs_.fetch_add(1, std::memory_order_relaxed);
+  inuse_.store(inuse_.load(std::memory_order_relaxed) + chunksize, std::memory_order_relaxed);
+  return ChunkPtr(chunk);
+}
+void BufferPool::Free(Chunk* chunk) {
+  BufferPool* pool = chunk->pool;
+  if (pool->InOwnerThread()) {
+    pool->Push(chunk);
+  } else {
+    Chunk* head = pool->remotefree_.load(std::memory_order_relaxed);
+    do {
+      chunk->next = head;
+    } while (!pool->remotefree_.compare_exchange_weak(head, chunk, std::memory_order_release, std::memory_order_relaxed));
+  }
+  pool->Unref();
+}
+BufferPool::Stats BufferPool::GetStats() const {
+  Stats stats;
+  stats.mapped = mapped_.load(std::memory_order_relaxed);
+  stats.hugemapped = hugemapped_.load(std::memory_order_relaxed);
+  stats.inuse = inuse_.load(std::memory_order_relaxed);
+  stats.remotefrees = remotefrees_.load(std::memory_order_relaxed);
+  return stats;
+}
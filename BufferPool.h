@@ -0,0 +1,78 @@
+#ifndef _BUFFERPOOL_H_
+#define _BUFFERPOOL_H_
+//每个EventLoop一个的IO缓冲池：4KB、16KB、64KB三档定长块，从mmap的2MB区域里切出，开启大页后区域用大页映射
+//块只在所属loop线程分配，所属线程释放时直接放回空闲链表，不加锁；其他线程（如连接迁移后的新loop）释放的块
+//挂到无锁的远程释放链表上，所属线程下次分配时一次收回
+//池由所属loop和每个未归还的块共同引用，loop析构后由最后一个归还的块释放，区域只在池析构时解除映射
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+class BufferPool {
+public:
+  enum SizeClass { CLASS_4K = 0, CLASS_16K = 1, CLASS_64K = 2, CLASSES = 3 };
+  //块头放在数据前面，占一个缓存行，数据按64字节对齐
+  struct Chunk {
+    BufferPool* pool;
+    Chunk* next;//空闲链表或远程释放链表中的下一块
+    uint32_t sizeclass;
+    uint32_t capacity;//可用的数据长度，档位大小减去块头
+    char* Data() { return reinterpret_cast<char*>(this) + HEADER_SIZE; }
+    const char* Data() const { return reinterpret_cast<const char*>(this) + HEADER_SIZE; }
+    //块占用的内存，含块头
+    size_t Size() const { return ClassSize(sizeclass); }
+  };
+  struct ChunkDeleter {
+    void operator()(Chunk* chunk) const { BufferPool::Free(chunk); }
+  };
+  typedef std::unique_ptr<Chunk, ChunkDeleter> ChunkPtr;
+  //统计，所属线程更新，任意线程可读
+  struct Stats {
+    uint64_t mapped;//已映射的区域字节数
+    uint64_t hugemapped;//其中用大页映射的字节数
+    uint64_t inuse;//分配出去还没归还的块占用的字节数，远程释放的块在收回后才扣除
+    uint64_t remotefrees;//由其他线程释放、经远程链表收回的块数
+    Stats() : mapped(0), hugemapped(0), inuse(0), remotefrees(0) {}
+  };
+  enum { HEADER_SIZE = 64 };
+  //在所属线程构造
+  BufferPool();
+  //之后新映射的区域先尝试MAP_HUGETLB，系统没有预留大页时退回普通映射并建议内核用透明大页，须在所属线程调用
+  void EnableHugePages() { hugepages_ = true; }
+  //分配能放下size字节的最小档的块，size超过最大档时返回最大档的块，须在所属线程调用，映射失败返回空
+  ChunkPtr Allocate(size_t size);
+  //任意线程可调用
+  static void Free(Chunk* chunk);
+  //所属loop析构时调用，代替delete，还有块没归还时由最后一块释放
+  void Release() { Unref(); }
+  bool InOwnerThread() const { return std::this_thread::get_id() == owner_; }
+  Stats GetStats() const;
+  static size_t ClassSize(uint32_t sizeclass) { return static_cast<size_t>(4096) << (2 * sizeclass); }
+private:
+  struct Region {
+    char* base;
+    size_t length;
+  };
+  ~BufferPool();
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+  void Unref();
+  void Reclaim();//收回远程释放链表上的块
+  bool MapRegion(uint32_t sizeclass);//为该档映射一个新区域
+  void Push(Chunk* chunk);//放回所属档的空闲链表
+  std::thread::id owner_;
+  std::atomic<int64_t> refs_;//所属loop一份，每个分配出去的块一份
+  std::atomic<Chunk*> remotefree_;//其他线程释放的块，所属线程整条取走
+  Chunk* freelist_[CLASSES];
+  char* carve_[CLASSES];//当前区域里还没切出的部分
+  char* carveend_[CLASSES];
+  std::vector<Region> regions_;
+  bool hugepages_;
+  std::atomic<uint64_t> mapped_;
+  std::atomic<uint64_t> hugemapped_;
+  std::atomic<uint64_t> inuse_;
+  std::atomic<uint64_t> remotefrees_;
+};
+#endif // !_BUFFERPOOL_H_
@@ -1,28 +1,35 @@
 #include "Channel.h"
 #include <iostream>
 #include <sys/epoll.h>
-Channel::Channel() : fd_(-1) {}
+#include "Trace.h"
+Channel::Channel() : fd_(-1), events_(0), revents_(0), eventhandler_(nullptr), owner_(nullptr),
+                     priority_(PRIORITY_NORMAL), deferred_(0), readyat_(0) {}
 Channel::~Channel() {}
 void Channel::HandleEvent() {
+    TRACE2(channel_event, fd_, revents_);
+    if (eventhandler_) {
+        eventhandler_(owner_, revents_);
+        return;
+    }
     //读事件，对端有数据或者正常关闭
-    if (events_ & (EPOLLIN | EPOLLPRI)) {
+    if (revents_ & (EPOLLIN | EPOLLPRI)) {
         if (readhandler_) {
             readhandler_();
         }
     }
     //写事件
-    if (events_ & EPOLLOUT) {
+    if (revents_ & EPOLLOUT) {
         if (writehandler_) {
             writehandler_();
         }
     }
-    if (events_ & EPOLLERR) {
+    if (revents_ & EPOLLERR) {
         if (errorhandler_) {
             errorhandler_();
         }
     }
     //对方异常关闭事件，或者半关闭事件
-    if (events_ & EPOLLHUP) {
+    if (revents_ & EPOLLHUP) {
         if (closehandler_) {
             closehandler_();
         }
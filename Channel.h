@@ -5,25 +5,51 @@
 class Channel {
 public:
   typedef std::function<void()> CallBack;
+  //事件分发函数，owner为注册者，revents为就绪事件；普通函数指针，不需要为可调用对象分配内存
+  typedef void (*EventHandler)(void* owner, uint32_t revents);
+  //优先级，开启loop调度后同一轮就绪的channel按优先级分发，数值小的先处理；高优先级不受IO时间片限制
+  enum Priority { PRIORITY_HIGH = 0, PRIORITY_NORMAL = 1, PRIORITY_LOW = 2, PRIORITY_CLASSES = 3 };
   Channel();
   ~Channel();
   void SetFd(int fd) { fd_ = fd; }
   int GetFd() const { return fd_; }
   void SetEvents(uint32_t events) { events_ = events; }
   uint32_t GetEvents() const { return events_; }
+  //epoll_wait返回的就绪事件，与关注的事件分开保存，避免覆盖EPOLLET等设置
+  void SetRevents(uint32_t revents) { revents_ = revents; }
+  uint32_t GetRevents() const { return revents_; }
   void HandleEvent();//事件分发处理
   void setReadHandler(CallBack &&cb) { readhandler_ = std::move(cb); }
   void setWriteHandler(CallBack &&cb) { writehandler_ = std::move(cb); }
   void setErrorHandler(CallBack &&cb) { errorhandler_ = std::move(cb); }
   void setCloseHandler(CallBack &&cb) { closehandler_ = std::move(cb); }  
+  //设置后HandleEvent直接把就绪事件交给handler，不再经过上面四个回调，由handler自己区分读写错误
+  void SetEventHandler(EventHandler handler, void* owner) { eventhandler_ = handler; owner_ = owner; }
+  void SetPriority(int priority) {
+    priority_ = priority < PRIORITY_HIGH ? PRIORITY_HIGH : (priority > PRIORITY_LOW ? PRIORITY_LOW : priority);
+  }
+  int GetPriority() const { return priority_; }
+  //IO时间片用完后没来得及分发的就绪事件暂存在channel上，边缘触发不会再报告，下一轮先分发；为0表示没有推迟的事件
+  void Defer() { deferred_ = revents_; }
+  uint32_t GetDeferred() const { return deferred_; }
+  uint32_t TakeDeferred() { uint32_t deferred = deferred_; deferred_ = 0; return deferred; }
+  //首次就绪的时间，推迟分发时保留，用于统计事件排队时延，单位ns
+  void SetReadyTime(int64_t readyat) { readyat_ = readyat; }
+  int64_t GetReadyTime() const { return readyat_; }
 private:
   int fd_;
-  uint32_t events_;//事件，一般情况下为epoll events
+  uint32_t events_;//关注的事件，一般情况下为epoll events
+  uint32_t revents_;//就绪的事件
   //事件触发时执行的函数，在tcpconn中注册
   CallBack readhandler_;
   CallBack writehandler_;
   CallBack errorhandler_;
   CallBack closehandler_;
+  EventHandler eventhandler_;
+  void* owner_;
+  int priority_;
+  uint32_t deferred_;//推迟到下一轮分发的就绪事件
+  int64_t readyat_;
 
 };
 
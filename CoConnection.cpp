@@ -0,0 +1,115 @@
+#include "CoConnection.h"
+#ifdef ENABLE_COROUTINES
+#include <utility>
+CoConnection::CoConnection(const TcpConnectionPtr& conn)
+    : conn_(conn), input_(), scanned_(0), closed_(false), reader_(nullptr), writer_(nullptr) {
+}
+bool CoConnection::TryRead(ReadAwaiter* reader) {
+  if (reader->delimlen_ == 0) {
+    if (!input_.empty()) {
+      reader->out_->clear();
+      reader->out_->swap(input_);
+      scanned_ = 0;
+      reader->result_ = true;
+      return true;
+    }
+  } else {
+    //只从上次查找的末尾往回退delimlen-1个字节开始找，分隔符可能跨两次收到的数据
+    size_t start = scanned_ >= reader->delimlen_ ? scanned_ - reader->delimlen_ + 1 : 0;
+    size_t pos = input_.find(reader->delim_, start, reader->delimlen_);
+    if (pos != std::string::npos) {
+      size_t len = pos + reader->delimlen_;
+      reader->out_->assign(input_, 0, len);
+      input_.erase(0, len);
+      scanned_ = 0;
+      reader->result_ = true;
+      return true;
+    }
+    scanned_ = input_.size();
+  }
+  //对端已关闭写端，不会再有数据
+  if (closed_ || conn_->HalfClosed()) {
+    scanned_ = 0;
+    reader->result_ = false;
+    return true;
+  }
+  return false;
+}
+CoConnection::WriteAwaiter CoConnection::Write(const std::string& data) {
+  if (!closed_) {
+    conn_->Send(data);
+  }
+  return WriteAwaiter(this);
+}
+CoConnection::WriteAwaiter CoConnection::Write(std::string&& data) {
+  if (!closed_) {
+    conn_->Send(std::move(data));
+  }
+  return WriteAwaiter(this);
+}
+bool CoConnection::WriteAwaiter::await_ready() {
+  if (conn_->closed_) {
+    result_ = false;
+    return true;
+  }
+  //大多数情况下一次write就发完了，不用挂起
+  if (conn_->conn_->OutputBytes() == 0) {
+    result_ = true;
+    return true;
+  }
+  return false;
+}
+void CoConnection::Close() {
+  if (!closed_) {
+    conn_->Shutdown();
+  }
+}
+void CoConnection::OnMessage(std::string& data) {
+  if (input_.empty()) {
+    input_.swap(data);
+  } else {
+    input_.append(data);
+    data.clear();
+  }
+  if (reader_ != nullptr && TryRead(reader_)) {
+    //恢复后awaiter随co_await表达式结束而销毁，先取出句柄
+    std::coroutine_handle<> handle = reader_->handle_;
+    reader_ = nullptr;
+    handle.resume();
+  }
+}
+void CoConnection::OnSendComplete() {
+  if (writer_ != nullptr) {
+    std::coroutine_handle<> handle = writer_->handle_;
+    writer_->result_ = true;
+    writer_ = nullptr;
+    handle.resume();
+  }
+}
+void CoConnection::OnClose() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  //TcpConnection通过上下文持有本对象，本对象又持有TcpConnection，关闭时解开循环引用
+  conn_->SetContext(std::shared_ptr<void>());
+  std::coroutine_handle<> reader;
+  std::coroutine_handle<> writer;
+  if (reader_ != nullptr) {
+    TryRead(reader_);
+    reader = reader_->handle_;
+    reader_ = nullptr;
+  }
+  if (writer_ != nullptr) {
+    writer_->result_ = false;
+    writer = writer_->handle_;
+    writer_ = nullptr;
+  }
+  if (reader) {
+    reader.resume();
+  }
+  if (writer) {
+    writer.resume();
+  }
+}
+#endif // ENABLE_COROUTINES
@@ -0,0 +1,82 @@
+#ifndef _COCONNECTION_H_
+#define _COCONNECTION_H_
+//协程方式使用的连接：co_await ReadUntil/Read/Write/Sleep
+//读写都在连接所属的IO线程完成，数据到达或发送完成时在TcpConnection的回调里直接恢复协程
+#ifdef ENABLE_COROUTINES
+#include <string>
+#include <memory>
+#include <coroutine>
+#include "Coroutine.h"
+#include "TcpConnection.h"
+class CoConnection {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //co_await结果为true表示读到了数据，连接关闭且没有满足条件的数据时为false
+  class ReadAwaiter {
+  public:
+    ReadAwaiter(CoConnection* conn, const char* delim, size_t delimlen, std::string* out)
+        : conn_(conn), delim_(delim), delimlen_(delimlen), out_(out), handle_(), result_(false) {}
+    bool await_ready() { return conn_->TryRead(this); }
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+      conn_->reader_ = this;
+    }
+    bool await_resume() const { return result_; }
+  private:
+    friend class CoConnection;
+    CoConnection* conn_;
+    const char* delim_;//为空时有数据就返回
+    size_t delimlen_;
+    std::string* out_;
+    std::coroutine_handle<> handle_;
+    bool result_;
+  };
+  //co_await结果为true表示数据已全部交给内核，连接已关闭时为false
+  class WriteAwaiter {
+  public:
+    explicit WriteAwaiter(CoConnection* conn) : conn_(conn), handle_(), result_(false) {}
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+      conn_->writer_ = this;
+    }
+    bool await_resume() const { return result_; }
+  private:
+    friend class CoConnection;
+    CoConnection* conn_;
+    std::coroutine_handle<> handle_;
+    bool result_;
+  };
+  explicit CoConnection(const TcpConnectionPtr& conn);
+  //读到delim为止，out为包含delim在内的一段数据；delim须在co_await完成前有效
+  ReadAwaiter ReadUntil(const std::string& delim, std::string& out) {
+    return ReadAwaiter(this, delim.data(), delim.size(), &out);
+  }
+  //读出当前已收到的全部数据，没有数据时等待
+  ReadAwaiter Read(std::string& out) { return ReadAwaiter(this, nullptr, 0, &out); }
+  //发送数据，等发送队列清空后恢复，起到背压的作用
+  WriteAwaiter Write(const std::string& data);
+  WriteAwaiter Write(std::string&& data);
+  //在连接所属loop上睡眠
+  SleepAwaiter Sleep(int ms) { return CoSleep(conn_->GetLoop(), ms); }
+  //主动关闭连接
+  void Close();
+  bool Closed() const { return closed_; }
+  const TcpConnectionPtr& GetConnection() const { return conn_; }
+  EventLoop* GetLoop() const { return conn_->GetLoop(); }
+  //以下由CoServer在TcpConnection回调里调用，都在IO线程
+  void OnMessage(std::string& data);
+  void OnSendComplete();
+  void OnClose();
+private:
+  //尝试满足一次读，满足或连接已关闭时返回true
+  bool TryRead(ReadAwaiter* reader);
+  TcpConnectionPtr conn_;
+  std::string input_;//已收到还没被协程读走的数据
+  size_t scanned_;//input_中已经查找过分隔符的长度，避免重复查找
+  bool closed_;
+  ReadAwaiter* reader_;//等待读的协程，同一时刻最多一个
+  WriteAwaiter* writer_;//等待发送完成的协程
+};
+#endif // ENABLE_COROUTINES
+#endif // !_COCONNECTION_H_
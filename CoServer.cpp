@@ -0,0 +1,59 @@
+#include "CoServer.h"
+#ifdef ENABLE_COROUTINES
+#include <iostream>
+#include <exception>
+CoServer::CoServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const ServerOptions& options)
+    : server_(loop, listenaddr, threadnum, options), handler_() {
+  server_.SetNewConnectionCallback(std::bind(&CoServer::HandleNewConnection, this, std::placeholders::_1));
+  server_.SetConnectionReadyCallback(std::bind(&CoServer::HandleConnectionReady, this, std::placeholders::_1));
+  server_.SetMessageCallback(std::bind(&CoServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
+  server_.SetSendCompleteCallback(std::bind(&CoServer::HandleSendComplete, this, std::placeholders::_1));
+  //出错的连接不走关闭回调，两种情况都要唤醒协程
+  server_.SetCloseCallback(std::bind(&CoServer::HandleClose, this, std::placeholders::_1));
+  server_.SetErrorCallback(std::bind(&CoServer::HandleClose, this, std::placeholders::_1));
+}
+void CoServer::Start() {
+  server_.Start();
+}
+DetachedTask CoServer::Run(std::shared_ptr<CoConnection> conn, Task<> task) {
+  try {
+    co_await task;
+  } catch (const std::exception& e) {
+    std::cerr << "coroutine handler exception: " << e.what() << std::endl;
+  }
+  conn->Close();
+}
+std::shared_ptr<CoConnection> CoServer::GetCoConnection(const TcpConnectionPtr& conn) {
+  return std::static_pointer_cast<CoConnection>(conn->GetContext());
+}
+void CoServer::HandleNewConnection(const TcpConnectionPtr& conn) {
+  //此时连接还没注册到IO线程，只绑定上下文
+  conn->SetContext(std::make_shared<CoConnection>(conn));
+}
+void CoServer::HandleConnectionReady(const TcpConnectionPtr& conn) {
+  std::shared_ptr<CoConnection> coconn = GetCoConnection(conn);
+  if (!coconn || !handler_) {
+    return;
+  }
+  Run(coconn, handler_(*coconn));
+}
+void CoServer::HandleMessage(const TcpConnectionPtr& conn, std::string& message) {
+  //持有一份引用，协程在回调里结束时CoConnection不会提前析构
+  std::shared_ptr<CoConnection> coconn = GetCoConnection(conn);
+  if (coconn) {
+    coconn->OnMessage(message);
+  }
+}
+void CoServer::HandleSendComplete(const TcpConnectionPtr& conn) {
+  std::shared_ptr<CoConnection> coconn = GetCoConnection(conn);
+  if (coconn) {
+    coconn->OnSendComplete();
+  }
+}
+void CoServer::HandleClose(const TcpConnectionPtr& conn) {
+  std::shared_ptr<CoConnection> coconn = GetCoConnection(conn);
+  if (coconn) {
+    coconn->OnClose();
+  }
+}
+#endif // ENABLE_COROUTINES
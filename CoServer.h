@@ -0,0 +1,34 @@
+#ifndef _COSERVER_H_
+#define _COSERVER_H_
+//协程服务器：每个连接启动一个Task<>处理协程，协程在连接所属的IO线程上运行，
+//连接注册到IO线程之后才启动，协程里可以直接收发数据；协程结束时关闭连接
+#ifdef ENABLE_COROUTINES
+#include <functional>
+#include <memory>
+#include "Coroutine.h"
+#include "CoConnection.h"
+#include "TcpServer.h"
+class CoServer {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //连接处理协程，CoConnection在协程结束前一直有效
+  typedef std::function<Task<>(CoConnection&)> Handler;
+  CoServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum = 0, const ServerOptions& options = ServerOptions());
+  //设置连接处理协程，须在Start之前调用
+  void SetHandler(const Handler& handler) { handler_ = handler; }
+  void Start();
+  TcpServer& GetServer() { return server_; }
+private:
+  //顶层协程，持有CoConnection直到处理协程结束
+  static DetachedTask Run(std::shared_ptr<CoConnection> conn, Task<> task);
+  static std::shared_ptr<CoConnection> GetCoConnection(const TcpConnectionPtr& conn);
+  void HandleNewConnection(const TcpConnectionPtr& conn);
+  void HandleConnectionReady(const TcpConnectionPtr& conn);
+  void HandleMessage(const TcpConnectionPtr& conn, std::string& message);
+  void HandleSendComplete(const TcpConnectionPtr& conn);
+  void HandleClose(const TcpConnectionPtr& conn);
+  TcpServer server_;
+  Handler handler_;
+};
+#endif // ENABLE_COROUTINES
+#endif // !_COSERVER_H_
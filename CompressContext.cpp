@@ -0,0 +1,38 @@
+#include "CompressContext.h"
+#include <iostream>
+#include "EventLoopThread.h"
+CompressContext::CompressContext() : threshold_(0), level_(1), workers_(), next_(0), stats_() {
+}
+CompressContext::~CompressContext() {
+}
+EventLoop* CompressContext::NextWorker() {
+  return workers_[next_.fetch_add(1, std::memory_order_relaxed) % workers_.size()]->GetLoop();
+}
+#ifdef ENABLE_COMPRESSION
+bool CompressContext::Available() {
+  return true;
+}
+bool CompressContext::Init(size_t threshold, int level, int workers) {
+  if (level < 1 || level > 9 || workers < 0) {
+    std::cerr << "CompressContext: invalid level " << level << " or workers " << workers << std::endl;
+    return false;
+  }
+  threshold_ = threshold;
+  level_ = level;
+  for (int i = 0; i < workers; ++i) {
+    workers_.push_back(std::unique_ptr<EventLoopThread>(new EventLoopThread()));
+    workers_.back()->Start();
+  }
+  std::cout << "CompressContext: threshold " << threshold_ << " bytes, level " << level_ << ", "
+            << workers << " workers" << std::endl;
+  return true;
+}
+#else
+bool CompressContext::Available() {
+  return false;
+}
+bool CompressContext::Init(size_t threshold, int level, int workers) {
+  std::cerr << "CompressContext: built without compression support, reconfigure with -DENABLE_COMPRESSION=ON" << std::endl;
+  return false;
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef _COMPRESSCONTEXT_H_
+#define _COMPRESSCONTEXT_H_
+//压缩上下文：阈值、压缩级别、统计和可选的压缩线程，开启压缩的连接共用一个，须比连接存活更久
+//编译时打开ENABLE_COMPRESSION才会链接zlib，否则Init总是失败
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+class EventLoop;
+class EventLoopThread;
+class CompressContext {
+public:
+  //统计，由各IO线程和压缩线程更新
+  struct Stats {
+    std::atomic<uint64_t> framesout;//发出的帧数
+    std::atomic<uint64_t> compressedout;//其中压缩的帧数
+    std::atomic<uint64_t> plainout;//压缩帧压缩前的字节数
+    std::atomic<uint64_t> wireout;//压缩帧压缩后的字节数，plainout/wireout即发送方向的压缩比
+    std::atomic<uint64_t> framesin;//收到的帧数
+    std::atomic<uint64_t> plainin;//压缩帧解压后的字节数
+    std::atomic<uint64_t> wirein;//压缩帧解压前的字节数
+    std::atomic<uint64_t> compressns;//压缩占用的线程CPU时间，单位ns
+    std::atomic<uint64_t> decompressns;//解压占用的线程CPU时间，单位ns
+    std::atomic<uint64_t> offloaded;//交给压缩线程的批次数
+    Stats() : framesout(0), compressedout(0), plainout(0), wireout(0), framesin(0), plainin(0), wirein(0),
+              compressns(0), decompressns(0), offloaded(0) {}
+  };
+  CompressContext();
+  ~CompressContext();
+  //不小于threshold字节的发送数据压缩，level为zlib压缩级别（1最快，9最小）；
+  //workers大于0时启动这么多个压缩线程，发送方向的压缩交给它们，IO线程只做分帧和解压，失败返回false
+  bool Init(size_t threshold, int level, int workers);
+  //是否编译了压缩支持
+  static bool Available();
+  size_t Threshold() const { return threshold_; }
+  int Level() const { return level_; }
+  bool HasWorkers() const { return !workers_.empty(); }
+  //轮流返回压缩线程的loop，须在HasWorkers时调用
+  EventLoop* NextWorker();
+  Stats& GetStats() { return stats_; }
+private:
+  size_t threshold_;
+  int level_;
+  std::vector<std::unique_ptr<EventLoopThread> > workers_;
+  std::atomic<size_t> next_;
+  Stats stats_;
+};
+#endif // !_COMPRESSCONTEXT_H_
@@ -0,0 +1,165 @@
+#include "CompressStream.h"
+#ifdef ENABLE_COMPRESSION
+#include <iostream>
+#include <algorithm>
+#include <time.h>
+#include <zlib.h>
+#define FRAME_INPUT_LIMIT (1UL << 20) //每帧最多带的明文字节数，大数据拆成多帧
+#define FRAME_PAYLOAD_LIMIT (16UL << 20) //帧负载长度上限，超过视为数据损坏
+#define INFLATE_LIMIT (64UL << 20) //一帧最多解出的明文字节数，防止解压炸弹
+//本线程占用的CPU时间，单位ns
+static int64_t ThreadCpuTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+static void AppendHeader(std::string& out, int type, size_t len) {
+  char header[CompressStream::HEADER_SIZE];
+  header[0] = static_cast<char>(type);
+  header[1] = static_cast<char>((len >> 24) & 0xff);
+  header[2] = static_cast<char>((len >> 16) & 0xff);
+  header[3] = static_cast<char>((len >> 8) & 0xff);
+  header[4] = static_cast<char>(len & 0xff);
+  out.append(header, sizeof(header));
+}
+CompressStream::CompressStream(CompressContext* context) : context_(context), deflate_(nullptr), inflate_(nullptr) {
+}
+CompressStream::~CompressStream() {
+  if (deflate_) {
+    deflateEnd(deflate_);
+    delete deflate_;
+  }
+  if (inflate_) {
+    inflateEnd(inflate_);
+    delete inflate_;
+  }
+}
+bool CompressStream::Init() {
+  deflate_ = new z_stream();
+  if (deflateInit(deflate_, context_->Level()) != Z_OK) {
+    std::cerr << "CompressStream: deflateInit failed" << std::endl;
+    delete deflate_;
+    deflate_ = nullptr;
+    return false;
+  }
+  inflate_ = new z_stream();
+  if (inflateInit(inflate_) != Z_OK) {
+    std::cerr << "CompressStream: inflateInit failed" << std::endl;
+    delete inflate_;
+    inflate_ = nullptr;
+    return false;
+  }
+  return true;
+}
+bool CompressStream::Compress(const char* data, size_t len, std::string& out) {
+  CompressContext::Stats& stats = context_->GetStats();
+  int64_t start = ThreadCpuTime();
+  bool ok = true;
+  while (len > 0 && ok) {
+    size_t n = std::min(len, static_cast<size_t>(FRAME_INPUT_LIMIT));
+    ++stats.framesout;
+    if (n < context_->Threshold()) {
+      AppendHeader(out, FRAME_RAW, n);
+      out.append(data, n);
+    } else {
+      size_t headerpos = out.size();
+      AppendHeader(out, FRAME_DEFLATE, 0);
+      size_t payload = out.size();
+      deflate_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      deflate_->avail_in = static_cast<uInt>(n);
+      size_t chunk = deflateBound(deflate_, n) + 16;
+      //Z_SYNC_FLUSH后输出缓冲没被填满，说明输入都已压缩并刷出
+      do {
+        size_t used = out.size();
+        out.resize(used + chunk);
+        deflate_->next_out = reinterpret_cast<Bytef*>(&out[used]);
+        deflate_->avail_out = static_cast<uInt>(chunk);
+        int ret = deflate(deflate_, Z_SYNC_FLUSH);
+        out.resize(used + chunk - deflate_->avail_out);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+          std::cerr << "CompressStream: deflate error " << ret << std::endl;
+          ok = false;
+          break;
+        }
+      } while (deflate_->avail_out == 0);
+      size_t wire = out.size() - payload;
+      out[headerpos + 1] = static_cast<char>((wire >> 24) & 0xff);
+      out[headerpos + 2] = static_cast<char>((wire >> 16) & 0xff);
+      out[headerpos + 3] = static_cast<char>((wire >> 8) & 0xff);
+      out[headerpos + 4] = static_cast<char>(wire & 0xff);
+      ++stats.compressedout;
+      stats.plainout += n;
+      stats.wireout += wire;
+    }
+    data += n;
+    len -= n;
+  }
+  stats.compressns += ThreadCpuTime() - start;
+  return ok;
+}
+bool CompressStream::Decompress(std::string& input, std::string& out) {
+  CompressContext::Stats& stats = context_->GetStats();
+  int64_t start = ThreadCpuTime();
+  bool ok = true;
+  size_t pos = 0;
+  while (input.size() - pos >= HEADER_SIZE) {
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(input.data() + pos);
+    size_t len = (static_cast<size_t>(header[1]) << 24) | (static_cast<size_t>(header[2]) << 16) |
+                 (static_cast<size_t>(header[3]) << 8) | header[4];
+    if (header[0] > FRAME_DEFLATE || len > FRAME_PAYLOAD_LIMIT) {
+      ok = false;
+      break;
+    }
+    if (input.size() - pos - HEADER_SIZE < len) {
+      break; //帧还没收全
+    }
+    const char* payload = input.data() + pos + HEADER_SIZE;
+    ++stats.framesin;
+    if (header[0] == FRAME_RAW) {
+      out.append(payload, len);
+    } else {
+      size_t begin = out.size();
+      inflate_->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(payload));
+      inflate_->avail_in = static_cast<uInt>(len);
+      size_t chunk = std::max(len * 4, static_cast<size_t>(4096));
+      do {
+        size_t used = out.size();
+        out.resize(used + chunk);
+        inflate_->next_out = reinterpret_cast<Bytef*>(&out[used]);
+        inflate_->avail_out = static_cast<uInt>(chunk);
+        int ret = inflate(inflate_, Z_SYNC_FLUSH);
+        out.resize(used + chunk - inflate_->avail_out);
+        //还有输入、输出缓冲也有空间却没法前进，或者流提前结束，都是数据损坏
+        if ((ret != Z_OK && ret != Z_BUF_ERROR) || (ret == Z_BUF_ERROR && inflate_->avail_in > 0 && inflate_->avail_out > 0) ||
+            out.size() - begin > INFLATE_LIMIT) {
+          ok = false;
+          break;
+        }
+      } while (inflate_->avail_in > 0 || inflate_->avail_out == 0);
+      if (!ok) {
+        break;
+      }
+      stats.plainin += out.size() - begin;
+      stats.wirein += len;
+    }
+    pos += HEADER_SIZE + len;
+  }
+  input.erase(0, pos);
+  stats.decompressns += ThreadCpuTime() - start;
+  return ok;
+}
+#else
+CompressStream::CompressStream(CompressContext* context) : context_(context), deflate_(nullptr), inflate_(nullptr) {
+}
+CompressStream::~CompressStream() {
+}
+bool CompressStream::Init() {
+  return false;
+}
+bool CompressStream::Compress(const char* data, size_t len, std::string& out) {
+  return false;
+}
+bool CompressStream::Decompress(std::string& input, std::string& out) {
+  return false;
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef _COMPRESSSTREAM_H_
+#define _COMPRESSSTREAM_H_
+//一条连接上的压缩状态：发送方向和接收方向各一个zlib流，压缩帧之间共用滑动窗口，后面的帧可以引用前面帧里的内容
+//开启压缩后连接上的字节流按帧传输，两端都要开启：帧头1字节类型（0原样、1压缩）+ 4字节大端的负载长度
+//压缩帧是zlib流用Z_SYNC_FLUSH刷出的一段，必须按顺序解压；小于阈值的数据作为原样帧发送，不经过zlib流，也不进入窗口
+//发送方向可以在压缩线程里执行，但同一时刻只能有一个线程使用，由连接保证；接收方向只在IO线程使用
+#include <string>
+#include "CompressContext.h"
+struct z_stream_s;
+class CompressStream {
+public:
+  enum { FRAME_RAW = 0, FRAME_DEFLATE = 1 };
+  enum { HEADER_SIZE = 5 };
+  explicit CompressStream(CompressContext* context);
+  ~CompressStream();
+  //初始化两个方向的zlib流，失败返回false
+  bool Init();
+  //把data分帧追加到out：不小于阈值的部分压缩，其余原样，出错返回false
+  bool Compress(const char* data, size_t len, std::string& out);
+  //从input里解出完整的帧，明文追加到out，解出的帧从input移除，不完整的帧留到下次；数据损坏返回false
+  bool Decompress(std::string& input, std::string& out);
+  CompressContext* GetContext() const { return context_; }
+private:
+  CompressStream(const CompressStream&) = delete;
+  CompressStream& operator=(const CompressStream&) = delete;
+  CompressContext* context_;
+  struct z_stream_s* deflate_;
+  struct z_stream_s* inflate_;
+};
+#endif // !_COMPRESSSTREAM_H_
@@ -0,0 +1,192 @@
+#include "Connector.h"
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "TimerManager.h"
+#define INIT_RETRY_DELAY 500 //首次重试间隔，单位ms
+#define MAX_RETRY_DELAY 30000 //最大重试间隔，单位ms
+#define CONNECT_TIMEOUT 5000 //单次connect的默认超时，单位ms；SYN被丢弃时内核要约两分钟才放弃
+Connector::Connector(EventLoop* loop, const struct sockaddr_in& serveraddr)
+    : loop_(loop), serveraddr_(serveraddr), state_(DISCONNECTED), connect_(false), channel_(),
+      retrydelay_(INIT_RETRY_DELAY), retries_(0), maxretries_(-1), connecttimeout_(CONNECT_TIMEOUT), attempts_(0),
+      retrytimer_(0, Timer::TIMER_ONCE, Timer::CallBack_()) {
+  channel_.setWriteHandler(std::bind(&Connector::HandleWrite, this));
+  channel_.setErrorHandler(std::bind(&Connector::HandleWrite, this));
+  //重试依赖时间轮，确保定时器线程已经启动
+  TimerManager::GetInstance()->Start();
+}
+Connector::~Connector() {
+  if (state_ == CONNECTING) {
+    close(RemoveChannel());
+  }
+}
+void Connector::Start() {
+  connect_ = true;
+  if (loop_->GetThreadId() == std::this_thread::get_id()) {
+    StartInLoop();
+  } else {
+    loop_->AddTask(std::bind(&Connector::StartInLoop, shared_from_this()));
+  }
+}
+void Connector::Stop() {
+  connect_ = false;
+  if (loop_->GetThreadId() == std::this_thread::get_id()) {
+    StopInLoop();
+  } else {
+    loop_->AddTask(std::bind(&Connector::StopInLoop, shared_from_this()));
+  }
+}
+void Connector::Restart() {
+  state_ = DISCONNECTED;
+  retrydelay_ = INIT_RETRY_DELAY;
+  retries_ = 0;
+  connect_ = true;
+  StartInLoop();
+}
+void Connector::StartInLoop() {
+  if (!connect_ || state_ != DISCONNECTED) {
+    return;
+  }
+  Connect();
+}
+void Connector::StopInLoop() {
+  retrytimer_.Stop();
+  if (state_ == CONNECTING) {
+    close(RemoveChannel());
+    state_ = DISCONNECTED;
+  }
+}
+void Connector::Connect() {
+  int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sockfd < 0) {
+    perror("connector socket");
+    Retry(-1);
+    return;
+  }
+  int ret = connect(sockfd, (struct sockaddr*)&serveraddr_, sizeof(serveraddr_));
+  int err = (ret == 0) ? 0 : errno;
+  switch (err) {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+      Connecting(sockfd);
+      break;
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case EHOSTUNREACH:
+    case ETIMEDOUT:
+      Retry(sockfd);
+      break;
+    default:
+      //地址错误等无法通过重试恢复的错误
+      perror("connect");
+      close(sockfd);
+      if (errorcallback_) {
+        errorcallback_();
+      }
+      break;
+  }
+}
+void Connector::Connecting(int sockfd) {
+  state_ = CONNECTING;
+  ++attempts_;
+  channel_.SetFd(sockfd);
+  channel_.SetEvents(EPOLLOUT);
+  loop_->AddChannelToPoller(&channel_);
+  if (connecttimeout_ > 0) {
+    std::weak_ptr<Connector> wpconnector(shared_from_this());
+    retrytimer_.Adjust(connecttimeout_, Timer::TIMER_ONCE, std::bind(&Connector::OnConnectTimer, loop_, wpconnector, attempts_));
+  }
+}
+int Connector::RemoveChannel() {
+  loop_->RemoveChannelFromPoller(&channel_);
+  return channel_.GetFd();
+}
+void Connector::HandleWrite() {
+  //连接失败时可写和错误事件会同时触发，只处理一次
+  if (state_ != CONNECTING) {
+    return;
+  }
+  retrytimer_.Stop();
+  int sockfd = RemoveChannel();
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+    err = errno;
+  }
+  if (err != 0) {
+    std::cerr << "Connector connect error: " << strerror(err) << std::endl;
+    Retry(sockfd);
+    return;
+  }
+  //本地端口和目标端口相同时会发生自连接
+  struct sockaddr_in localaddr;
+  struct sockaddr_in peeraddr;
+  socklen_t addrlen = sizeof(localaddr);
+  getsockname(sockfd, (struct sockaddr*)&localaddr, &addrlen);
+  addrlen = sizeof(peeraddr);
+  getpeername(sockfd, (struct sockaddr*)&peeraddr, &addrlen);
+  if (localaddr.sin_port == peeraddr.sin_port && localaddr.sin_addr.s_addr == peeraddr.sin_addr.s_addr) {
+    std::cerr << "Connector self connect, retry." << std::endl;
+    Retry(sockfd);
+    return;
+  }
+  state_ = CONNECTED;
+  if (connect_ && newconnectioncallback_) {
+    newconnectioncallback_(sockfd);
+  } else {
+    close(sockfd);
+  }
+}
+void Connector::Retry(int sockfd) {
+  if (sockfd >= 0) {
+    close(sockfd);
+  }
+  state_ = DISCONNECTED;
+  if (!connect_) {
+    return;
+  }
+  if (maxretries_ >= 0 && retries_ >= maxretries_) {
+    std::cerr << "Connector gave up after " << retries_ << " retries." << std::endl;
+    connect_ = false;
+    if (errorcallback_) {
+      errorcallback_();
+    }
+    return;
+  }
+  ++retries_;
+  std::weak_ptr<Connector> wpconnector(shared_from_this());
+  retrytimer_.Adjust(retrydelay_, Timer::TIMER_ONCE, std::bind(&Connector::OnRetryTimer, loop_, wpconnector));
+  retrydelay_ = std::min(retrydelay_ * 2, MAX_RETRY_DELAY);
+}
+void Connector::OnRetryTimer(EventLoop* loop, const std::weak_ptr<Connector>& wpconnector) {
+  //定时器线程里不持有Connector，否则可能在持有时间轮锁时析构
+  loop->AddTask(std::bind(&Connector::RetryInLoop, wpconnector));
+}
+void Connector::RetryInLoop(const std::weak_ptr<Connector>& wpconnector) {
+  std::shared_ptr<Connector> connector = wpconnector.lock();
+  if (connector) {
+    connector->StartInLoop();
+  }
+}
+void Connector::OnConnectTimer(EventLoop* loop, const std::weak_ptr<Connector>& wpconnector, uint64_t attempt) {
+  loop->AddTask(std::bind(&Connector::ConnectTimeoutInLoop, wpconnector, attempt));
+}
+void Connector::ConnectTimeoutInLoop(const std::weak_ptr<Connector>& wpconnector, uint64_t attempt) {
+  std::shared_ptr<Connector> connector = wpconnector.lock();
+  //超时任务排队期间这次尝试可能已经连上、失败或被停止
+  if (!connector || connector->state_ != CONNECTING || connector->attempts_ != attempt) {
+    return;
+  }
+  std::cerr << "Connector connect timed out after " << connector->connecttimeout_ << " ms." << std::endl;
+  connector->Retry(connector->RemoveChannel());
+}
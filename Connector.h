@@ -0,0 +1,73 @@
+#ifndef _CONNECTOR_H_
+#define _CONNECTOR_H_
+//主动连接器：在指定loop上发起非阻塞connect，失败后按指数退避重试
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Timer.h"
+class Connector : public std::enable_shared_from_this<Connector> {
+public:
+  typedef std::shared_ptr<Connector> spConnector;
+  //连接建立成功回调，参数为已连接的非阻塞socket，所有权交给回调
+  typedef std::function<void(int)> NewConnectionCallBack;
+  //重试次数用完仍未连上的回调
+  typedef std::function<void()> ErrorCallBack;
+  Connector(EventLoop* loop, const struct sockaddr_in& serveraddr);
+  ~Connector();
+  void SetNewConnectionCallBack(NewConnectionCallBack &&cb) {
+    newconnectioncallback_ = std::move(cb);
+  }
+  void SetErrorCallBack(ErrorCallBack &&cb) {
+    errorcallback_ = std::move(cb);
+  }
+  //最大重试次数，-1为无限重试
+  void SetMaxRetries(int maxretries) { maxretries_ = maxretries; }
+  //单次connect的超时，单位ms，超时后关闭这次尝试并按退避重试；0为等内核超时
+  void SetConnectTimeout(int timeoutms) { connecttimeout_ = timeoutms; }
+  const struct sockaddr_in& GetServerAddr() const { return serveraddr_; }
+  //开始连接，可跨线程调用
+  void Start();
+  //停止连接和重试，可跨线程调用
+  void Stop();
+  //连接断开后重新开始连接，须在loop线程调用
+  void Restart();
+private:
+  typedef enum {
+    DISCONNECTED = 0,
+    CONNECTING,
+    CONNECTED
+  } State;
+  void StartInLoop();
+  void StopInLoop();
+  void Connect();
+  //connect返回EINPROGRESS，等待socket可写
+  void Connecting(int sockfd);
+  //socket可写或出错，检查连接结果
+  void HandleWrite();
+  //关闭本次尝试的socket，稍后重试
+  void Retry(int sockfd);
+  //把channel从poller上摘下，返回其中的socket
+  int RemoveChannel();
+  //重试定时器到期，在定时器线程中执行，转交给loop线程
+  static void OnRetryTimer(EventLoop* loop, const std::weak_ptr<Connector>& wpconnector);
+  static void RetryInLoop(const std::weak_ptr<Connector>& wpconnector);
+  //connect超时，在定时器线程中执行，转交给loop线程；attempt为超时的是第几次尝试
+  static void OnConnectTimer(EventLoop* loop, const std::weak_ptr<Connector>& wpconnector, uint64_t attempt);
+  static void ConnectTimeoutInLoop(const std::weak_ptr<Connector>& wpconnector, uint64_t attempt);
+  EventLoop* loop_;
+  struct sockaddr_in serveraddr_;
+  State state_;
+  bool connect_;//是否需要继续连接，Stop后为false
+  Channel channel_;//正在连接的socket的事件，每次尝试复用
+  int retrydelay_;//当前重试间隔，单位ms
+  int retries_;//已重试次数
+  int maxretries_;
+  int connecttimeout_;//单次connect的超时，单位ms
+  uint64_t attempts_;//已发起的connect次数，超时任务据此忽略已经结束的尝试
+  Timer retrytimer_;//重试定时器，连接中时兼作connect超时定时器
+  NewConnectionCallBack newconnectioncallback_;
+  ErrorCallBack errorcallback_;
+};
+#endif // !_CONNECTOR_H_
@@ -0,0 +1,75 @@
+#include "Coroutine.h"
+#ifdef ENABLE_COROUTINES
+#include <cstdlib>
+#include <new>
+#include "TimerManager.h"
+#define FRAME_GRANULE 64 //协程帧按64字节分级
+#define FRAME_CLASSES 64 //最大分级为64*64=4KB，更大的帧直接走malloc
+#define FRAME_CACHE_LIMIT 1024 //每级最多缓存的空闲帧数，多余的还给malloc
+struct FreeFrame {
+  FreeFrame* next;
+};
+//每个线程一份空闲链表，IO线程上的协程只在本线程创建和销毁，不需要加锁
+struct FrameCache {
+  FreeFrame* heads[FRAME_CLASSES];
+  size_t counts[FRAME_CLASSES];
+  FrameCache() {
+    for (int i = 0; i < FRAME_CLASSES; ++i) {
+      heads[i] = nullptr;
+      counts[i] = 0;
+    }
+  }
+  ~FrameCache() {
+    for (int i = 0; i < FRAME_CLASSES; ++i) {
+      while (heads[i] != nullptr) {
+        FreeFrame* frame = heads[i];
+        heads[i] = frame->next;
+        free(frame);
+      }
+    }
+  }
+};
+static thread_local FrameCache framecache;
+void* FramePool::Allocate(size_t size) {
+  size_t index = (size + FRAME_GRANULE - 1) / FRAME_GRANULE - 1;
+  if (index >= FRAME_CLASSES) {
+    void* ptr = malloc(size);
+    if (ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+    return ptr;
+  }
+  FreeFrame* frame = framecache.heads[index];
+  if (frame != nullptr) {
+    framecache.heads[index] = frame->next;
+    --framecache.counts[index];
+    return frame;
+  }
+  //按级别的整块大小分配，归还后能给同级的任何帧复用
+  void* ptr = malloc((index + 1) * FRAME_GRANULE);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void FramePool::Free(void* ptr, size_t size) {
+  size_t index = (size + FRAME_GRANULE - 1) / FRAME_GRANULE - 1;
+  if (index >= FRAME_CLASSES || framecache.counts[index] >= FRAME_CACHE_LIMIT) {
+    free(ptr);
+    return;
+  }
+  FreeFrame* frame = static_cast<FreeFrame*>(ptr);
+  frame->next = framecache.heads[index];
+  framecache.heads[index] = frame;
+  ++framecache.counts[index];
+}
+void SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  EventLoop* loop = loop_;
+  //定时器回调在定时器线程里持有时间轮锁执行，只投递任务，由loop线程恢复协程
+  timer_.reset(new Timer(ms_, Timer::TIMER_ONCE, [loop, handle]() {
+    loop->AddTask([handle]() { handle.resume(); });
+  }));
+  TimerManager::GetInstance()->Start();
+  timer_->Start();
+}
+#endif // ENABLE_COROUTINES
@@ -0,0 +1,139 @@
+#ifndef _COROUTINE_H_
+#define _COROUTINE_H_
+//C++20协程支持，以-DENABLE_COROUTINES=ON编译：
+//Task<T>是惰性启动的协程，co_await时才开始执行，结束时直接切回等待它的协程（对称转移），不经过任务队列
+//协程帧从FramePool分配，每个IO线程一份按大小分级的空闲链表，稳定后处理请求不再调用malloc
+#ifdef ENABLE_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <memory>
+#include <optional>
+#include <cstddef>
+#include "EventLoop.h"
+#include "Timer.h"
+//协程帧分配器，线程局部，不加锁；帧在哪个线程释放就归还到哪个线程的空闲链表
+class FramePool {
+public:
+  static void* Allocate(size_t size);
+  static void Free(void* ptr, size_t size);
+};
+template <typename T = void> class Task;
+//Task的promise公共部分：记录等待者，结束时切回等待者
+class TaskPromiseBase {
+public:
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      std::coroutine_handle<> continuation = handle.promise().continuation_;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+  FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+  void unhandled_exception() { exception_ = std::current_exception(); }
+  void SetContinuation(std::coroutine_handle<> continuation) { continuation_ = continuation; }
+  void RethrowIfFailed() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+  static void* operator new(size_t size) { return FramePool::Allocate(size); }
+  static void operator delete(void* ptr, size_t size) { FramePool::Free(ptr, size); }
+private:
+  std::coroutine_handle<> continuation_;
+  std::exception_ptr exception_;
+};
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+  T& Result() {
+    RethrowIfFailed();
+    return *value_;
+  }
+private:
+  std::optional<T> value_;
+};
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object();
+  void return_void() {}
+  void Result() { RethrowIfFailed(); }
+};
+//协程任务，只能移动；析构时销毁协程帧，因此co_await完成之前Task必须一直有效
+template <typename T>
+class Task {
+public:
+  typedef TaskPromise<T> promise_type;
+  typedef std::coroutine_handle<promise_type> Handle;
+  explicit Task(Handle handle) : handle_(handle) {}
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+  bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+    handle_.promise().SetContinuation(awaiter);
+    return handle_; //直接切到被等待的协程执行
+  }
+  decltype(auto) await_resume() { return handle_.promise().Result(); }
+private:
+  Handle handle_;
+};
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+//顶层协程：立即开始执行，结束时自己释放协程帧，用来启动连接处理协程
+class DetachedTask {
+public:
+  struct promise_type {
+    DetachedTask get_return_object() { return DetachedTask(); }
+    std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+    std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+    static void* operator new(size_t size) { return FramePool::Allocate(size); }
+    static void operator delete(void* ptr, size_t size) { FramePool::Free(ptr, size); }
+  };
+};
+//co_await CoSleep(loop, ms)：定时器线程到期后把恢复协程的任务投递回loop，协程仍在loop线程继续执行
+//等待期间协程帧不能销毁
+class SleepAwaiter {
+public:
+  SleepAwaiter(EventLoop* loop, int ms) : loop_(loop), ms_(ms), timer_() {}
+  bool await_ready() const noexcept { return ms_ <= 0; }
+  void await_suspend(std::coroutine_handle<> handle);
+  void await_resume() noexcept {}
+private:
+  EventLoop* loop_;
+  int ms_;
+  std::unique_ptr<Timer> timer_;
+};
+inline SleepAwaiter CoSleep(EventLoop* loop, int ms) {
+  return SleepAwaiter(loop, ms);
+}
+#endif // ENABLE_COROUTINES
+#endif // !_COROUTINE_H_
@@ -1,19 +1,43 @@
 #include "EchoServer.h"
 #include <iostream>
 #include <functional>
-EchoServer::EchoServer(EventLoop* loop, const uint16_t port, const int threadnum)
-    : server_(loop, port, threadnum) {
-    server_.SetNewConnectionCallback(std::bind(&EchoServer::HandleNewConnection, this, std::placeholders::_1));
-    server_.SetMessageCallback(std::bind(&EchoServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
-    server_.SetSendCompleteCallback(std::bind(&EchoServer::HandleSendComplete, this, std::placeholders::_1));
-    server_.SetCloseCallback(std::bind(&EchoServer::HandleClose, this, std::placeholders::_1));
-    server_.SetErrorCallback(std::bind(&EchoServer::HandleError, this, std::placeholders::_1));
+#include <utility>
+EchoServer::EchoServer(EventLoop* loop, const uint16_t port, const int threadnum, const ServerOptions& options)
+    : EchoServer(loop, SockAddress::Inet(port), threadnum, options) {
+}
+EchoServer::EchoServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const ServerOptions& options)
+    : server_(loop, listenaddr, this, threadnum, options) {
 }
 EchoServer::~EchoServer() {
     // 这里可以添加清理资源的代码
 }
 void EchoServer::Start() {
     server_.Start();
+    if (udpserver_) {
+        udpserver_->Start();
+    }
+}
+void EchoServer::EnableHotUpgrade(const std::string& path, bool handoverconns) {
+    server_.EnableHotUpgrade(path, handoverconns);
+}
+TcpServer::Listener* EchoServer::AddListener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options) {
+    TcpServer::Listener* listener = server_.AddListener(name, listenaddr, options);
+    //附加监听不走编译期回调表，回调经std::bind绑定到同一组处理函数
+    listener->SetNewConnectionCallback(std::bind(&EchoServer::HandleNewConnection, this, std::placeholders::_1));
+    listener->SetMessageCallback(std::bind(&EchoServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
+    listener->SetSendCompleteCallback(std::bind(&EchoServer::HandleSendComplete, this, std::placeholders::_1));
+    listener->SetCloseCallback(std::bind(&EchoServer::HandleClose, this, std::placeholders::_1));
+    listener->SetErrorCallback(std::bind(&EchoServer::HandleError, this, std::placeholders::_1));
+    return listener;
+}
+void EchoServer::EnableUdp(const int udpport, const UdpServer::Options& options) {
+    udpserver_.reset(new UdpServer(server_.GetThreadPool(), udpport, options));
+    udpserver_->SetDatagramCallback(std::bind(&EchoServer::HandleDatagram, this, std::placeholders::_1,
+        std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
+}
+void EchoServer::HandleDatagram(UdpServer::Worker* worker, const struct sockaddr_in& peeraddr, const char* data, size_t len) {
+    //回包进入发送批，本批收到的数据报处理完后一次sendmmsg发出
+    worker->Send(peeraddr, data, len);
 }
 void EchoServer::HandleNewConnection(const TcpConnectionPtr& conn) {
     std::cout << "New connection established." << std::endl;
@@ -25,7 +49,7 @@ void EchoServer::HandleMessage(const TcpConnectionPtr& conn, std::string& messag
     std::string msg;
     msg.swap(message);
     msg.insert(0, "reply Echo: ");
-    conn->Send(msg); // 发送回显消息
+    conn->Send(std::move(msg)); // 发送回显消息
 }
 void EchoServer::HandleSendComplete(const TcpConnectionPtr& conn) {
     std::cout << "Message sent successfully." << std::endl;
@@ -2,23 +2,53 @@
 #define _ECHOSERVER_H_
 #include <string>
 #include "TcpServer.h"
+#include "BasicTcpServer.h"
 #include "EventLoop.h"
 #include "TcpConnection.h"
 #include "Timer.h"
+#include "UdpServer.h"
 class EchoServer {
 public:
   typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
   typedef std::shared_ptr<Timer> TimerPtr;
-  EchoServer(EventLoop* loop,const uint16_t port,const int threadnum);
+  EchoServer(EventLoop* loop,const uint16_t port,const int threadnum,const ServerOptions& options=ServerOptions());
+  //监听任意类型的地址，见SockAddress
+  EchoServer(EventLoop* loop,const SockAddress& listenaddr,const int threadnum,const ServerOptions& options=ServerOptions());
   ~EchoServer();
   void Start();
+  //开启热升级，见TcpServer::EnableHotUpgrade
+  void EnableHotUpgrade(const std::string& path, bool handoverconns);
+  //同时在udpport上提供UDP回显，与TCP共用IO线程，须在Start之前调用
+  void EnableUdp(const int udpport, const UdpServer::Options& options = UdpServer::Options());
+  //开启TLS，须在Start之前调用
+  void EnableTls(const std::shared_ptr<TlsContext>& context) { server_.EnableTls(context); }
+  void EnableCompression(const std::shared_ptr<CompressContext>& context) { server_.EnableCompression(context); }
+  //开启流量录制，见TcpServer::EnableCapture
+  bool EnableCapture(const std::string& path, size_t maxbytes) { return server_.EnableCapture(path, maxbytes); }
+  //IO线程的loop统计
+  EventLoop::LoopStats GetLoopStats() { return server_.GetLoopStats(); }
+  size_t BufferMemory() { return server_.BufferMemory(); }
+  BufferPool::Stats BufferPoolStats() { return server_.BufferPoolStats(); }
+  uint64_t RefusedConnections() const { return server_.RefusedConnections(); }
+  //运行中增删IO线程，见TcpServer::AddLoop/DrainLoop
+  EventLoop* AddLoop() { return server_.AddLoop(); }
+  EventLoop* DrainLoop() { return server_.DrainLoop(); }
+  EventLoopThreadPool* GetThreadPool() { return server_.GetThreadPool(); }
+  //增加一个附加监听，回显协议与主监听相同，共用IO线程，有自己的地址和socket选项；须在主loop线程调用，见TcpServer::AddListener
+  TcpServer::Listener* AddListener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options = ServerOptions());
+  //底层的TcpServer，用于增加附加监听（如管理端口）共用IO线程
+  TcpServer* GetServer() { return &server_; }
 private:
+  //回调在编译期绑定，由BasicTcpServer的跳板函数直接调用
+  friend class BasicTcpServer<EchoServer>;
   void HandleNewConnection(const TcpConnectionPtr& conn);
   void HandleMessage(const TcpConnectionPtr& conn,std::string& message);
   void HandleSendComplete(const TcpConnectionPtr& conn);
   void HandleClose(const TcpConnectionPtr& conn);
   void HandleError(const TcpConnectionPtr& conn);
-  TcpServer server_;
+  void HandleDatagram(UdpServer::Worker* worker, const struct sockaddr_in& peeraddr, const char* data, size_t len);
+  BasicTcpServer<EchoServer> server_;
+  std::unique_ptr<UdpServer> udpserver_;
 };
 
 #endif // !1
\ No newline at end of file
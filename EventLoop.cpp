@@ -1,8 +1,12 @@
 #include "EventLoop.h"
+#include "TcpConnection.h"
+#include "LoopWatchdog.h"
+#include "LoopChannel.h"
 #include <iostream>
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include <stdlib.h>
+#define SLOW_LOG_INTERVAL 1000000000 //慢回调最多每秒打印一次，单位ns
 //参照muduo，实现跨线程唤醒
 int CreateEventFd() {
     int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -14,13 +18,41 @@ int CreateEventFd() {
 }
 EventLoop::EventLoop()
     : functors_(),
+      runningtasks_(),
+      nexttask_(0),
       channels_(),
       activechannels_(),
       poller(),
       quit_(true),
       tid(std::this_thread::get_id()),
       wakeupfd_(CreateEventFd()),
-      wakeupchannel_() {
+      wakeupchannel_(),
+      buffermemory_(0),
+      bufferpool_(new BufferPool()),
+      zerocopylingers_(),
+      connections_(),
+      conncount_(0),
+      incoming_(0),
+      dispatching_(false),
+      dirtyconnections_(),
+      inboxes_(),
+      stats_(),
+      threadhandle_(pthread_self()),
+      watched_(false),
+      callbackbudget_(0),
+      taskqueuelimit_(0),
+      lastslowlog_(0),
+      busysince_(0),
+      currentfd_(-1),
+      currenttask_(nullptr),
+      stalls_(0),
+      measurebusy_(false),
+      busyns_(0),
+      scheduling_(false),
+      ioslice_(0),
+      taskslice_(0),
+      stamptasks_(false),
+      deferredchannels_(), fresh_() {
         wakeupchannel_.SetFd(wakeupfd_);
         wakeupchannel_.SetEvents(EPOLLIN| EPOLLET);
         wakeupchannel_.setReadHandler(std::bind(&EventLoop::HandleRead, this));
@@ -28,9 +60,13 @@ EventLoop::EventLoop()
         AddChannelToPoller(&wakeupchannel_);
       }
 EventLoop::~EventLoop() {
+    if (watched_) {
+        LoopWatchdog::GetInstance()->Unregister(this);
+    }
     if (wakeupfd_ != -1) {  
         close(wakeupfd_);
     }
+    bufferpool_->Release();
   }
   void EventLoop::wakeup() {
     uint64_t one = 1;
@@ -50,14 +86,277 @@ EventLoop::~EventLoop() {
     std::cerr << "EventLoop error occurred." << std::endl;
     // 可以添加更多错误处理逻辑
   }
+  void EventLoop::AddConnection(const std::shared_ptr<TcpConnection>& conn) {
+    connections_[conn->fd()] = conn;
+    conncount_.store(connections_.size(), std::memory_order_relaxed);
+  }
+  void EventLoop::RemoveConnection(const std::shared_ptr<TcpConnection>& conn) {
+    auto it = connections_.find(conn->fd());
+    //只删除登记的是同一个连接的项
+    if (it != connections_.end() && it->second == conn) {
+      connections_.erase(it);
+      conncount_.store(connections_.size(), std::memory_order_relaxed);
+    }
+  }
+  void EventLoop::FlushDirtyConnections() {
+    //发送时可能又登记新的连接（如半关闭后的清理），换出来再处理
+    std::vector<std::shared_ptr<TcpConnection> > dirty;
+    while (!dirtyconnections_.empty()) {
+      dirty.swap(dirtyconnections_);
+      for (auto &conn : dirty) {
+        conn->FlushCorked();
+      }
+      dirty.clear();
+    }
+  }
+  void EventLoop::EnableStallDetection(int budgetus, int stallms, size_t taskqueuelimit) {
+    callbackbudget_ = static_cast<int64_t>(budgetus) * 1000;
+    taskqueuelimit_ = taskqueuelimit;
+    if (!watched_) {
+      watched_ = true;
+      LoopWatchdog::GetInstance()->Register(this, stallms);
+    }
+  }
+  void EventLoop::RecordCallback(int fd, const char* task, int64_t costns) {
+    uint64_t costus = costns / 1000;
+    if (costus > stats_.maxcallbackus) {
+      stats_.maxcallbackus = costus;
+    }
+    if (costns <= callbackbudget_) {
+      return;
+    }
+    if (fd >= 0) {
+      ++stats_.slowevents;
+    } else {
+      ++stats_.slowtasks;
+    }
+    int64_t now = LoopWatchdog::Now();
+    if (now - lastslowlog_ < SLOW_LOG_INTERVAL) {
+      return;
+    }
+    lastslowlog_ = now;
+    if (fd >= 0) {
+      std::cerr << "EventLoop slow callback: fd " << fd << " took " << costus << " us" << std::endl;
+    } else {
+      std::cerr << "EventLoop slow task: " << LoopWatchdog::Demangle(task) << " took " << costus << " us" << std::endl;
+    }
+  }
+  void EventLoop::EnableScheduling(int iosliceus, int tasksliceus) {
+    scheduling_ = true;
+    ioslice_ = static_cast<int64_t>(iosliceus) * 1000;
+    taskslice_ = static_cast<int64_t>(tasksliceus) * 1000;
+    stamptasks_.store(true, std::memory_order_relaxed);
+  }
+  bool EventLoop::HasDeferredWork() const {
+    return !deferredchannels_.empty() || nexttask_ < runningtasks_.size();
+  }
+  void EventLoop::ScheduleChannels() {
+    int64_t now = LoopWatchdog::Now();
+    //这一轮再次就绪的推迟channel：把新事件并进推迟的事件，只在下面按推迟的身份排一次，保留首次就绪的时间；
+    //边缘触发不会再报告这次的新事件（如EPOLLOUT），不能丢
+    for (auto &channel : activechannels_) {
+      if (channel->GetDeferred() != 0) {
+        channel->SetRevents(channel->GetRevents() | channel->GetDeferred());
+        channel->Defer();
+        continue;
+      }
+      channel->SetReadyTime(now);
+      fresh_.push_back(channel);
+    }
+    activechannels_.clear();
+    //上一轮推迟的排在同优先级的前面；期间被移除的channel不再分发，同一地址上新建的channel没有推迟的事件
+    for (auto &deferred : deferredchannels_) {
+      Channel* channel = deferred.second;
+      if (poller.HasChannel(deferred.first, channel) && channel->GetDeferred() != 0) {
+        channel->SetRevents(channel->TakeDeferred());
+        prioritized_[channel->GetPriority()].push_back(channel);
+      }
+    }
+    deferredchannels_.clear();
+    for (auto &channel : fresh_) {
+      prioritized_[channel->GetPriority()].push_back(channel);
+    }
+    fresh_.clear();
+    for (int i = 0; i < Channel::PRIORITY_CLASSES; ++i) {
+      activechannels_.insert(activechannels_.end(), prioritized_[i].begin(), prioritized_[i].end());
+      prioritized_[i].clear();
+    }
+  }
+  void EventLoop::DeferChannels(size_t from) {
+    for (size_t i = from; i < activechannels_.size(); ++i) {
+      Channel* channel = activechannels_[i];
+      channel->Defer();
+      deferredchannels_.push_back(std::make_pair(channel->GetFd(), channel));
+    }
+    stats_.deferredevents += activechannels_.size() - from;
+  }
+  void EventLoop::DispatchChannel(Channel* channel) {
+    if (!watched_) {
+      channel->HandleEvent();//处理事件
+      return;
+    }
+    //回调里可能关闭连接并析构channel，先取出fd
+    int fd = channel->GetFd();
+    currentfd_.store(fd, std::memory_order_relaxed);
+    int64_t start = LoopWatchdog::Now();
+    channel->HandleEvent();
+    int64_t cost = LoopWatchdog::Now() - start;
+    currentfd_.store(-1, std::memory_order_relaxed);
+    RecordCallback(fd, nullptr, cost);
+  }
+  void EventLoop::RunTask(Functor& functor) {
+    if (!watched_) {
+      functor();
+      return;
+    }
+    const char* task = functor.target_type().name();
+    currenttask_.store(task, std::memory_order_relaxed);
+    int64_t start = LoopWatchdog::Now();
+    functor();
+    int64_t cost = LoopWatchdog::Now() - start;
+    currenttask_.store(nullptr, std::memory_order_relaxed);
+    RecordCallback(-1, task, cost);
+  }
+  void EventLoop::ExecuteTask() {
+    size_t taken = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      taken = functors_.size();
+      if (runningtasks_.empty()) {
+        runningtasks_.swap(functors_);
+      } else {
+        //上一轮推迟的任务先执行，新任务排在后面
+        for (auto &task : functors_) {
+          runningtasks_.push_back(std::move(task));
+        }
+        functors_.clear();
+      }
+    }
+    TRACE2(task_run, this, runningtasks_.size() - nexttask_);
+    if (watched_) {
+      if (taken > stats_.maxtaskqueue) {
+        stats_.maxtaskqueue = taken;
+      }
+      if (taskqueuelimit_ > 0 && taken > taskqueuelimit_) {
+        ++stats_.longtaskqueues;
+      }
+    }
+    size_t i = nexttask_;
+    if (!scheduling_) {
+      for (; i < runningtasks_.size(); ++i) {
+        RunTask(runningtasks_[i].functor);
+      }
+    } else {
+      int64_t start = LoopWatchdog::Now();
+      for (; i < runningtasks_.size(); ++i) {
+        int64_t now = LoopWatchdog::Now();
+        //至少执行一个任务，保证推迟的任务总能往前走
+        if (taskslice_ > 0 && i > nexttask_ && now - start > taskslice_) {
+          break;
+        }
+        if (runningtasks_[i].queuedat > 0) {
+          stats_.taskdelay.Add(now - runningtasks_[i].queuedat);
+        }
+        RunTask(runningtasks_[i].functor);
+      }
+    }
+    if (i < runningtasks_.size()) {
+      stats_.deferredtasks += runningtasks_.size() - i;
+      nexttask_ = i;
+    } else {
+      runningtasks_.clear();
+      nexttask_ = 0;
+    }
+  }
   void EventLoop::loop() {
     quit_ = false;
+    threadhandle_ = pthread_self();
     while (!quit_) {
-      poller.poll(activechannels_);
-      for (auto &channel : activechannels_) {
-        channel->HandleEvent();//处理事件
+      //还有推迟的事件或任务时只取一下新事件，不阻塞
+      poller.poll(activechannels_, HasDeferredWork() ? 0 : -1);
+      ++stats_.iterations;
+      int64_t busystart = 0;
+      if (watched_ || measurebusy_) {
+        busystart = LoopWatchdog::Now();
+      }
+      if (watched_) {
+        busysince_.store(busystart, std::memory_order_relaxed);
       }
+      if (scheduling_) {
+        ScheduleChannels();
+      }
+      dispatching_ = true;
+      if (!scheduling_) {
+        for (auto &channel : activechannels_) {
+          DispatchChannel(channel);
+        }
+      } else {
+        int64_t iostart = LoopWatchdog::Now();
+        for (size_t i = 0; i < activechannels_.size(); ++i) {
+          Channel* channel = activechannels_[i];
+          int64_t now = LoopWatchdog::Now();
+          //高优先级排在最前面，不受时间片限制；至少分发一个事件
+          if (ioslice_ > 0 && i > 0 && channel->GetPriority() != Channel::PRIORITY_HIGH && now - iostart > ioslice_) {
+            DeferChannels(i);
+            break;
+          }
+          stats_.iodelay.Add(now - channel->GetReadyTime());
+          DispatchChannel(channel);
+        }
+      }
+      dispatching_ = false;
       activechannels_.clear();
+      FlushDirtyConnections(); //本轮事件处理中推迟的发送一次写出
+      dispatching_ = true;
       ExecuteTask(); //执行任务队列中的任务
+      for (size_t i = 0; i < inboxes_.size(); ++i) {
+        inboxes_[i]->Drain(); //取空其他loop发来的消息
+      }
+      dispatching_ = false;
+      FlushDirtyConnections();
+      if (watched_) {
+        busysince_.store(0, std::memory_order_relaxed);
+      }
+      if (measurebusy_ && busystart > 0) {
+        busyns_.fetch_add(LoopWatchdog::Now() - busystart, std::memory_order_relaxed);
+      }
+    }
+  }
+  void EventLoop::DelayHistogram::Add(int64_t ns) {
+    uint64_t us = ns > 0 ? static_cast<uint64_t>(ns) / 1000 : 0;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= BUCKETS) {
+      bucket = BUCKETS - 1;
+    }
+    ++buckets[bucket];
+  }
+  void EventLoop::DelayHistogram::Merge(const DelayHistogram& other) {
+    for (int i = 0; i < BUCKETS; ++i) {
+      buckets[i] += other.buckets[i];
+    }
+  }
+  uint64_t EventLoop::DelayHistogram::Count() const {
+    uint64_t count = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+      count += buckets[i];
+    }
+    return count;
+  }
+  uint64_t EventLoop::DelayHistogram::Percentile(double p) const {
+    uint64_t count = Count();
+    if (count == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * count);
+    if (rank >= count) {
+      rank = count - 1;
     }
-  }
\ No newline at end of file
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+      seen += buckets[i];
+      if (seen > rank) {
+        return 1ULL << i;
+      }
+    }
+    return 1ULL << (BUCKETS - 1);
+  }
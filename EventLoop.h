@@ -6,8 +6,21 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include <set>
+#include <cstdint>
+#include <pthread.h>
 #include "Poller.h"
 #include "Channel.h"
+#include "OutputQueue.h"
+#include "BufferPool.h"
+#include "Trace.h"
+#include "LoopWatchdog.h"
+class TcpConnection;
+class LoopInbox;
+struct ZeroCopyLinger;
 
 class EventLoop {
 public:
@@ -15,6 +28,44 @@ public:
     typedef std::function<void()> Functor;
     //事件列表类型
     typedef std::vector<Channel *> ChannelList;
+    //本loop上的连接分片，fd到连接的映射
+    typedef std::unordered_map<int, std::shared_ptr<TcpConnection> > ConnectionMap;
+    //排队时延直方图，按2的幂分桶：第0桶不到1us，第i桶为[2^(i-1), 2^i)us，最后一桶收纳更长的
+    struct DelayHistogram {
+      enum { BUCKETS = 24 };
+      uint64_t buckets[BUCKETS];
+      DelayHistogram() : buckets() {}
+      void Add(int64_t ns);
+      void Merge(const DelayHistogram& other);
+      uint64_t Count() const;
+      //第p（0到1）分位所在桶的上界，单位us，没有样本时为0
+      uint64_t Percentile(double p) const;
+    };
+    //loop统计，只在本loop线程更新
+    struct LoopStats {
+      uint64_t iterations;//循环次数
+      uint64_t corkedsends;//开启自动合并写后被推迟的Send次数
+      uint64_t corkflushes;//迭代末尾合并后实际写socket的次数，corkedsends-corkflushes即省下的系统调用
+      OutputQueue::ZeroCopyStats zerocopy;//零拷贝发送统计
+      //以下为卡顿检测统计，开启EnableStallDetection后才更新
+      uint64_t slowevents;//超出预算的事件回调次数
+      uint64_t slowtasks;//超出预算的任务次数
+      uint64_t maxcallbackus;//单个回调或任务的最长耗时，单位us
+      uint64_t longtaskqueues;//一次取出的任务数超过上限的次数
+      uint64_t maxtaskqueue;//一次取出的最多任务数
+      uint64_t stalls;//看门狗报告的卡顿次数，由StallCount汇总，GetStats里不更新
+      uint64_t buffershrinks;//空闲连接释放缓冲的次数
+      uint64_t shedconnections;//超过内存上限时关闭的连接数
+      uint64_t migrations;//迁出到其他loop的连接数
+      //以下为loop调度统计，开启EnableScheduling后才更新
+      DelayHistogram iodelay;//就绪事件从epoll_wait返回到分发的时延
+      DelayHistogram taskdelay;//任务从AddTask到执行的时延
+      uint64_t deferredevents;//IO时间片用完推迟到下一轮分发的事件数
+      uint64_t deferredtasks;//任务时间片用完推迟到下一轮执行的任务数
+      LoopStats() : iterations(0), corkedsends(0), corkflushes(0), zerocopy(), slowevents(0), slowtasks(0),
+                    maxcallbackus(0), longtaskqueues(0), maxtaskqueue(0), stalls(0), buffershrinks(0), shedconnections(0),
+                    migrations(0), iodelay(), taskdelay(), deferredevents(0), deferredtasks(0) {}
+    };
     EventLoop();
     ~EventLoop();
 
@@ -47,35 +98,180 @@ public:
     //向任务队列添加任务
     void AddTask(Functor functor)
     {
+      //开启调度后记下入队时间，统计任务排队时延
+      int64_t queuedat = stamptasks_.load(std::memory_order_relaxed) ? LoopWatchdog::Now() : 0;
       {
         std::lock_guard<std::mutex> lock(mutex_);
-        functors_.push_back(std::move(functor));
+        functors_.push_back(QueuedTask(std::move(functor), queuedat));
       }
+      TRACE1(task_add, this);
       wakeup();
     }
-    //执行任务队列的任务
-    void ExecuteTask(){
-      std::vector<Functor> functorlist;
-      {
-        std::lock_guard<std::mutex> lock(mutex_);
-        functorlist.swap(functors_);
-      }
-      for(auto &functor:functorlist) {
-        functor();
-      }
-      functorlist.clear();
+    //连接分片只在本loop线程里增删和遍历，不需要加锁
+    void AddConnection(const std::shared_ptr<TcpConnection>& conn);
+    void RemoveConnection(const std::shared_ptr<TcpConnection>& conn);
+    const ConnectionMap& GetConnections() const
+    {
+      return connections_;
+    }
+    //本loop上的连接数，任意线程可读
+    size_t ConnectionCount() const
+    {
+      return conncount_.load(std::memory_order_relaxed);
+    }
+    //正在迁移到本loop、还没登记的连接数，任意线程可读写；移除loop前须为0
+    size_t IncomingConnections() const
+    {
+      return incoming_.load();
+    }
+    void AddIncoming(int delta)
+    {
+      incoming_.fetch_add(delta);
+    }
+    //本loop上连接缓冲占用的内存，由连接在读写后更新，任意线程可读
+    size_t BufferMemory() const
+    {
+      return static_cast<size_t>(buffermemory_.load(std::memory_order_relaxed));
+    }
+    //连接析构可能发生在其他线程，用原子加
+    void AddBufferMemory(int64_t delta)
+    {
+      buffermemory_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    //是否正在分发事件或执行任务，期间开启自动合并写的连接只入队不写socket
+    bool Dispatching() const
+    {
+      return dispatching_;
+    }
+    //登记有待发送数据的连接，本轮迭代末尾统一发送
+    void AddDirtyConnection(const std::shared_ptr<TcpConnection>& conn)
+    {
+      dirtyconnections_.push_back(conn);
+    }
+    LoopStats& GetStats()
+    {
+      return stats_;
+    }
+    //开启卡顿检测，须在本loop线程调用：每个事件回调和任务计时，超过budgetus记为慢回调；
+    //一次取出的任务超过taskqueuelimit个记为任务积压，0为不检查；离开epoll_wait超过stallms由看门狗报告并采栈
+    void EnableStallDetection(int budgetus, int stallms, size_t taskqueuelimit = 0);
+    //以下供看门狗线程读取
+    //本轮迭代离开epoll_wait的时间，单位ns，在epoll_wait中或未开启检测时为0
+    int64_t BusySince() const
+    {
+      return busysince_.load(std::memory_order_relaxed);
+    }
+    //正在处理的事件fd，不在事件回调中为-1
+    int CurrentFd() const
+    {
+      return currentfd_.load(std::memory_order_relaxed);
+    }
+    //正在执行的任务的typeid名字，不在任务中为空
+    const char* CurrentTask() const
+    {
+      return currenttask_.load(std::memory_order_relaxed);
+    }
+    pthread_t ThreadHandle() const
+    {
+      return threadhandle_;
+    }
+    void CountStall()
+    {
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t StallCount() const
+    {
+      return stalls_.load(std::memory_order_relaxed);
+    }
+    //开启忙碌时间统计，须在本loop线程调用：累计每轮迭代离开epoll_wait后处理事件和任务的时间
+    void EnableBusyTime()
+    {
+      measurebusy_ = true;
+    }
+    //累计的忙碌时间，单位ns，任意线程可读，两次读数之差除以间隔即这段时间的利用率
+    int64_t BusyTime() const
+    {
+      return busyns_.load(std::memory_order_relaxed);
+    }
+    //登记loop间消息通道的收件箱，每轮迭代执行完任务后取空一次，须在本loop线程调用，见LoopChannel.h
+    void AddInbox(LoopInbox* inbox)
+    {
+      inboxes_.push_back(inbox);
+    }
+    //开启loop调度，须在本loop线程调用：同一轮就绪的channel按优先级分发（见Channel::Priority），
+    //分发事件超过iosliceus后其余非高优先级事件推迟到下一轮，执行任务超过tasksliceus后其余任务推迟到下一轮，0为不限制；
+    //有推迟的事件或任务时下一轮epoll_wait不阻塞。同时统计事件和任务的排队时延
+    void EnableScheduling(int iosliceus, int tasksliceus);
+    //本loop的IO缓冲池，连接的发送队列从这里分配，见BufferPool.h
+    BufferPool* GetBufferPool()
+    {
+      return bufferpool_;
+    }
+    //连接关闭后还在等零拷贝完成通知的socket，只在本loop线程里增删，见TcpConnection.cpp
+    void AddZeroCopyLinger(const std::shared_ptr<ZeroCopyLinger>& linger)
+    {
+      zerocopylingers_.insert(linger);
+    }
+    void RemoveZeroCopyLinger(const std::shared_ptr<ZeroCopyLinger>& linger)
+    {
+      zerocopylingers_.erase(linger);
     }
+    //执行任务队列的任务，开启调度后受任务时间片限制
+    void ExecuteTask();
 private:
+    //排队的任务，queuedat为入队时间，未开启调度时为0
+    struct QueuedTask {
+      Functor functor;
+      int64_t queuedat;
+      QueuedTask(Functor&& f, int64_t t) : functor(std::move(f)), queuedat(t) {}
+    };
     //任务列表 
-    std::vector<Functor> functors_;       // 任务队列（跨线程提交的任务）
+    std::vector<QueuedTask> functors_;    // 任务队列（跨线程提交的任务）
+    std::vector<QueuedTask> runningtasks_; // 已取出的任务，nexttask_之前的已执行，之后的是上一轮时间片用完推迟的
+    size_t nexttask_;                     // 下一个要执行的取出任务
     ChannelList channels_;            // 所有注册的事件通道（Channel）
     ChannelList activechannels_;          // 就绪事件列表（epoll_wait 返回的活跃事件）
     Poller poller;                        // 封装 epoll 操作（I/O 多路复用核心）
-    bool quit_;                           // 循环运行状态（控制 loop() 退出）
+    std::atomic<bool> quit_;              // 循环运行状态（控制 loop() 退出），可由其他线程置位
     std::thread::id tid;                  // 事件循环所属线程 ID（线程亲和性）
     std::mutex mutex_;                    // 保护任务队列的互斥锁
     int wakeupfd_;                        // 跨线程唤醒 FD（用于唤醒阻塞的 epoll_wait）
     Channel wakeupchannel_;               // 唤醒事件通道（监听 wakeupfd_ 的可读事件）
+    std::atomic<int64_t> buffermemory_;   // 连接缓冲占用的内存，排在连接分片之前，连接析构时仍有效
+    BufferPool* bufferpool_;              // IO缓冲池，析构时只释放loop持有的引用，连接归还最后一块后池才释放
+    std::set<std::shared_ptr<ZeroCopyLinger> > zerocopylingers_; // 等零拷贝完成通知的socket，排在连接分片之前，连接析构时仍可登记
+    ConnectionMap connections_;           // 本loop上的连接分片
+    std::atomic<size_t> conncount_;       // 连接分片大小，供其他线程统计
+    std::atomic<size_t> incoming_;        // 正在迁入的连接数
+    bool dispatching_;                    // 正在分发事件或执行任务
+    std::vector<std::shared_ptr<TcpConnection> > dirtyconnections_; // 本轮迭代中推迟发送的连接
+    std::vector<LoopInbox*> inboxes_;     // loop间消息通道的收件箱
+    LoopStats stats_;                     // loop统计
+    pthread_t threadhandle_;              // 运行loop的线程，看门狗向它发信号采栈
+    bool watched_;                        // 已开启卡顿检测
+    int64_t callbackbudget_;              // 单个回调的耗时预算，单位ns
+    size_t taskqueuelimit_;               // 一次取出的任务数上限，0为不检查
+    int64_t lastslowlog_;                 // 上次打印慢回调的时间，限制打印频率
+    std::atomic<int64_t> busysince_;      // 本轮迭代离开epoll_wait的时间
+    std::atomic<int> currentfd_;          // 正在处理的事件fd
+    std::atomic<const char*> currenttask_; // 正在执行的任务类型
+    std::atomic<uint64_t> stalls_;        // 看门狗报告的卡顿次数
+    bool measurebusy_;                    // 已开启忙碌时间统计
+    std::atomic<int64_t> busyns_;         // 累计忙碌时间
+    bool scheduling_;                     // 已开启loop调度
+    int64_t ioslice_;                     // 每轮分发事件的时间片，单位ns，0为不限制
+    int64_t taskslice_;                   // 每轮执行任务的时间片，单位ns，0为不限制
+    std::atomic<bool> stamptasks_;        // AddTask记录入队时间，其他线程读
+    std::vector<std::pair<int, Channel*> > deferredchannels_; // 推迟到下一轮分发的channel及其fd
+    ChannelList prioritized_[Channel::PRIORITY_CLASSES]; // 按优先级分桶排序就绪channel的临时数组
+    ChannelList fresh_; // 本轮新就绪、不带推迟事件的channel，排在推迟的后面
+    void FlushDirtyConnections();         // 发送本轮迭代推迟的数据
+    bool HasDeferredWork() const;         // 有推迟的事件或任务
+    void ScheduleChannels();              // 合并上一轮推迟的事件，按优先级重排就绪列表
+    void DeferChannels(size_t from);      // 把就绪列表from之后的channel推迟到下一轮
+    void DispatchChannel(Channel* channel); // 分发一个channel的事件，开启卡顿检测时计时
+    void RunTask(Functor& functor);       // 执行一个任务，开启卡顿检测时计时
+    void RecordCallback(int fd, const char* task, int64_t costns); // 记录一次回调耗时，超出预算时计数并打印
 };
 
 #endif // !_EVENTLOOP_H_
@@ -2,22 +2,35 @@
 #include <iostream>
 #include <sstream>
 EventLoopThread::EventLoopThread()
-    : thread_(), threadid_(-1), threadname_("IO thread"), loop_(nullptr) {}
+    : thread_(), threadid_(-1), threadname_("IO thread"), loop_(nullptr), ownedloop_() {}
 EventLoopThread::~EventLoopThread() {
   //线程结束时清理
   std::cout << "EventLoopThread destructor called." << std::endl;
   loop_->quit();
+  loop_->wakeup();
   thread_.join();
 }
 EventLoop *EventLoopThread::GetLoop() {
   return loop_;
 }
+std::shared_ptr<EventLoop> EventLoopThread::GetLoopRef() {
+  return ownedloop_;
+}
 void EventLoopThread::Start() {
   thread_=std::thread(&EventLoopThread::ThreadFunc, this);
+  //等待子线程创建好loop，避免GetLoop返回空指针
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (loop_ == nullptr) {
+    cond_.wait(lock);
+  }
 }
 void EventLoopThread::ThreadFunc() {
-  EventLoop loop;
-  loop_ = &loop;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ownedloop_.reset(new EventLoop());
+    loop_ = ownedloop_.get();
+  }
+  cond_.notify_one();
   threadid_ = std::this_thread::get_id();
   std::stringstream sin;
   sin<<threadid_;
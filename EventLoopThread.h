@@ -3,6 +3,9 @@
 #include <iostream>
 #include <string>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include "EventLoop.h"
 
 class EventLoopThread {
@@ -10,6 +13,8 @@ public:
   EventLoopThread();
   ~EventLoopThread();
   EventLoop *GetLoop();
+  //持有loop的引用，线程退出、本对象析构后loop仍然有效，直到最后一个引用释放
+  std::shared_ptr<EventLoop> GetLoopRef();
   void Start();
   void ThreadFunc();
 private:
@@ -17,5 +22,9 @@ private:
   std::thread::id threadid_;
   std::string threadname_;
   EventLoop *loop_;
+  //loop在子线程里创建，引用计数持有，线程退出后其他线程通过GetLoopRef取到的引用仍然有效
+  std::shared_ptr<EventLoop> ownedloop_;
+  std::mutex mutex_;
+  std::condition_variable cond_;//Start等待子线程中的loop创建完成
 };
 #endif // !_EVENTLOOPTHREAD_H_
\ No newline at end of file
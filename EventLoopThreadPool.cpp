@@ -1,15 +1,18 @@
 #include "EventLoopThreadPool.h"
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *mainloop, int threadnum)
-    : mainloop_(mainloop), threadnum_(threadnum), threads_(),index_(0) {
+    : mainloop_(mainloop), threadnum_(threadnum), threads_(), index_(0),
+      addedcallbacks_(), removedcallbacks_(), mutex_() {
   for(int i=0;i<threadnum_;i++) {
-    EventLoopThread *thread = new EventLoopThread();
-    threads_.push_back(thread);
+    LoopEntry entry;
+    entry.thread = new EventLoopThread();
+    entry.draining = false;
+    threads_.push_back(entry);
   }
 }
 EventLoopThreadPool::~EventLoopThreadPool() {
   std::cout << "EventLoopThreadPool destructor called." << std::endl;
-  for(auto &thread : threads_) {
-    delete thread;
+  for(auto &entry : threads_) {
+    delete entry.thread;
   }
   threads_.clear();
 }
@@ -18,7 +21,7 @@ void EventLoopThreadPool::Start() {
   {
     for (int i = 0; i < threadnum_; i++)
     {
-      threads_[i]->Start();
+      threads_[i].thread->Start();
     }
     
   }else
@@ -26,11 +29,162 @@ void EventLoopThreadPool::Start() {
     std::cout << "No threads to start in EventLoopThreadPool." << std::endl;
   }
 }
+std::vector<EventLoop *> EventLoopThreadPool::GetAllLoops() {
+  std::vector<EventLoop *> loops;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (threads_.empty()) {
+    loops.push_back(mainloop_);
+  }
+  for (auto &entry : threads_) {
+    loops.push_back(entry.thread->GetLoop());
+  }
+  return loops;
+}
+std::vector<std::shared_ptr<EventLoop> > EventLoopThreadPool::GetLoopRefs() {
+  std::vector<std::shared_ptr<EventLoop> > loops;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (threads_.empty()) {
+    loops.push_back(std::shared_ptr<EventLoop>(std::shared_ptr<EventLoop>(), mainloop_));
+  }
+  for (auto &entry : threads_) {
+    loops.push_back(entry.thread->GetLoopRef());
+  }
+  return loops;
+}
 EventLoop *EventLoopThreadPool::GetNextLoop() {
+  std::lock_guard<std::mutex> lock(mutex_);
   if (threads_.empty()) {
     return mainloop_;
   }
-  EventLoop *nextLoop = threads_[index_]->GetLoop();
-  index_ = (index_ + 1) % threadnum_;
-  return nextLoop;
-}
\ No newline at end of file
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    LoopEntry &entry = threads_[index_++ % threads_.size()];
+    if (!entry.draining) {
+      return entry.thread->GetLoop();
+    }
+  }
+  return mainloop_;
+}
+EventLoop *EventLoopThreadPool::AddLoop() {
+  if (threadnum_ == 0) {
+    return nullptr; //连接都在主loop上，扩容后GetAllLoops会漏掉主loop
+  }
+  EventLoopThread *thread = new EventLoopThread();
+  thread->Start();
+  EventLoop *loop = thread->GetLoop();
+  std::vector<LoopCallback> added;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoopEntry entry;
+    entry.thread = thread;
+    entry.draining = false;
+    threads_.push_back(entry);
+    added = addedcallbacks_;
+  }
+  for (auto &cb : added) {
+    cb(loop);
+  }
+  return loop;
+}
+EventLoop *EventLoopThreadPool::DrainLoop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int active = 0;
+  for (auto &entry : threads_) {
+    if (!entry.draining) {
+      ++active;
+    }
+  }
+  if (active <= 1) {
+    return nullptr;
+  }
+  for (auto it = threads_.rbegin(); it != threads_.rend(); ++it) {
+    if (!it->draining) {
+      it->draining = true;
+      return it->thread->GetLoop();
+    }
+  }
+  return nullptr;
+}
+bool EventLoopThreadPool::IsDraining(EventLoop *loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : threads_) {
+    if (entry.thread->GetLoop() == loop) {
+      return entry.draining;
+    }
+  }
+  return false;
+}
+bool EventLoopThreadPool::IsActive(EventLoop *loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (threads_.empty()) {
+    return loop == mainloop_;
+  }
+  for (auto &entry : threads_) {
+    if (entry.thread->GetLoop() == loop) {
+      return !entry.draining;
+    }
+  }
+  return false;
+}
+int EventLoopThreadPool::ActiveLoopCount() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (threads_.empty()) {
+    return 1;
+  }
+  int active = 0;
+  for (auto &entry : threads_) {
+    if (!entry.draining) {
+      ++active;
+    }
+  }
+  return active;
+}
+void EventLoopThreadPool::RemoveLoop(EventLoop *loop) {
+  if (!IsDraining(loop)) {
+    return;
+  }
+  loop->AddTask(std::bind(&EventLoopThreadPool::RetireInLoop, this, loop));
+}
+void EventLoopThreadPool::RetireInLoop(EventLoop *loop) {
+  //排空前分到这个loop的连接可能刚刚登记上，迁移中的连接也可能正要登记
+  if (loop->ConnectionCount() > 0 || loop->IncomingConnections() > 0 || !IsDraining(loop)) {
+    return;
+  }
+  std::vector<LoopCallback> removed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    removed = removedcallbacks_;
+  }
+  for (auto &cb : removed) {
+    cb(loop);
+  }
+  //回到主loop再摘下：主loop里先取到这个loop再投递的任务都排在退出之前执行
+  mainloop_->AddTask(std::bind(&EventLoopThreadPool::FinishRemove, this, loop));
+}
+void EventLoopThreadPool::FinishRemove(EventLoop *loop) {
+  EventLoopThread *thread = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = threads_.begin(); it != threads_.end(); ++it) {
+      if (it->thread->GetLoop() == loop) {
+        thread = it->thread;
+        threads_.erase(it);
+        break;
+      }
+    }
+  }
+  if (!thread) {
+    return;
+  }
+  //摘下后主loop线程不会再取到它；析构让loop退出并等待线程结束，其他线程持有的引用让loop对象活到用完
+  delete thread;
+  std::cout << "EventLoopThreadPool: removed a drained loop" << std::endl;
+}
+void EventLoopThreadPool::AddObserver(const LoopCallback& added, const LoopCallback& removed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (added) {
+    addedcallbacks_.push_back(added);
+  }
+  if (removed) {
+    removedcallbacks_.push_back(removed);
+  }
+}
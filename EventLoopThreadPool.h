@@ -3,19 +3,58 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <cstdint>
 #include "EventLoop.h"
 #include "EventLoopThread.h"
+//IO线程池，运行中可以增加loop，或者把loop标记为排空：不再分到新连接，现有连接处理完后移除
 class EventLoopThreadPool {
 public:
+  typedef std::function<void(EventLoop*)> LoopCallback;
   EventLoopThreadPool(EventLoop *mainloop, int threadnum=0);
   ~EventLoopThreadPool();
   void Start();
-  //获取下一个被分发的loop，依据RR轮询策略
+  //获取下一个被分发的loop，依据RR轮询策略，跳过正在排空的loop
   EventLoop *GetNextLoop();
+  //获取所有IO线程的loop（包括正在排空的），没有IO线程时为主loop，须在Start之后调用
+  //loop在主loop线程里摘下并释放，返回的指针只能在主loop线程的当前任务里使用，其他线程用GetLoopRefs
+  std::vector<EventLoop *> GetAllLoops();
+  //同GetAllLoops，但持有每个loop的引用，loop在此期间被移除也不会释放；主loop不归线程池所有，它的引用不计数
+  //不要把引用绑进投递给该loop自己的任务，loop退出后没执行的任务会和它互相持有
+  std::vector<std::shared_ptr<EventLoop> > GetLoopRefs();
+  //新增一个IO线程，返回它的loop；只有主loop的线程池不能扩容，返回空
+  EventLoop *AddLoop();
+  //把最后加入且未排空的loop标记为排空并返回，至少保留一个可分配的loop，不能排空时返回空
+  EventLoop *DrainLoop();
+  //loop是否正在排空，已移除或不属于本线程池的loop返回false
+  bool IsDraining(EventLoop *loop);
+  //loop是否在线程池里且可以分配新连接（没有IO线程时为主loop）
+  bool IsActive(EventLoop *loop);
+  //可分配新连接的loop数
+  int ActiveLoopCount();
+  //移除正在排空的loop：在该loop里确认没有连接（包括正在迁入的）后依次调用removed回调，再回到主loop把它从线程池摘下，
+  //让它退出并等待线程结束；loop对象在最后一个引用（见GetLoopRefs）释放时析构。还有连接时放弃，等连接关闭后再次调用；可在任意线程调用
+  void RemoveLoop(EventLoop *loop);
+  //监听loop的增删：AddLoop新增的loop在调用AddLoop的线程里回调added；移除前在被移除的loop线程里回调removed
+  //Start时已有的loop不回调，须在修改线程池之前登记
+  void AddObserver(const LoopCallback& added, const LoopCallback& removed);
 private:
+  struct LoopEntry {
+    EventLoopThread *thread;
+    bool draining;//不再分配新连接
+  };
+  //在被移除的loop里执行
+  void RetireInLoop(EventLoop *loop);
+  //在主loop里把loop摘下，退出并回收线程
+  void FinishRemove(EventLoop *loop);
   EventLoop *mainloop_;
   int threadnum_;
-  std::vector<EventLoopThread *> threads_;
-  int index_; //用于轮询分发的索引
+  std::vector<LoopEntry> threads_;
+  size_t index_; //用于轮询分发的索引
+  std::vector<LoopCallback> addedcallbacks_;
+  std::vector<LoopCallback> removedcallbacks_;
+  std::mutex mutex_;//保护threads_、index_和回调列表，线程池可以在运行中扩缩容
 };
-#endif // !_EVENTLOOPTHREAD_H_
\ No newline at end of file
+#endif // !_EVENTLOOPTHREAD_H_
@@ -0,0 +1,285 @@
+#include "HotUpgrade.h"
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "TimerManager.h"
+#define UPGRADE_TIMEOUT 5 //新旧进程交接的超时时间，单位s
+#define UPGRADE_ACK 'A'
+//每条消息的固定头部，描述符挂在头部的辅助数据上
+struct UpgradeHeader {
+  uint32_t type;
+  uint32_t length;//头部之后的负载长度
+  uint32_t peerlen;//对端地址长度，0为没有地址
+  struct sockaddr_storage peeraddr;
+};
+static bool FillUnixAddr(const std::string& path, struct sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "upgrade socket path too long: " << path << std::endl;
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  return true;
+}
+static void SetTimeout(int sock) {
+  struct timeval tv;
+  tv.tv_sec = UPGRADE_TIMEOUT;
+  tv.tv_usec = 0;
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+static bool WriteAll(int sock, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(sock, data, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("upgrade write");
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+static bool ReadAll(int sock, char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(sock, data, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("upgrade read");
+      return false;
+    }
+    if (n == 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+HotUpgrade::HotUpgrade(EventLoop* loop, const std::string& path)
+    : loop_(loop), path_(path), ctrlfd_(-1), ctrlchannel_(), listenfd_(-1), connections_(), handovercallback_(),
+      acksock_(-1), ackchannel_(), acktimer_(0, Timer::TIMER_ONCE, Timer::CallBack_()), ackseq_(0), ackcallback_() {
+}
+HotUpgrade::~HotUpgrade() {
+  if (ctrlfd_ >= 0) {
+    loop_->RemoveChannelFromPoller(&ctrlchannel_);
+    close(ctrlfd_);
+  }
+  if (acksock_ >= 0) {
+    loop_->RemoveChannelFromPoller(&ackchannel_);
+  }
+}
+bool HotUpgrade::Inherit() {
+  struct sockaddr_un addr;
+  if (!FillUnixAddr(path_, addr)) return false;
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    perror("upgrade socket");
+    return false;
+  }
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    //没有旧进程在运行，正常冷启动
+    close(sock);
+    return false;
+  }
+  SetTimeout(sock);
+  std::cout << "Hot upgrade: inheriting sockets from " << path_ << std::endl;
+  for (;;) {
+    uint32_t type = 0;
+    int fd = -1;
+    SockAddress peeraddr;
+    std::string payload;
+    if (!RecvFd(sock, type, fd, peeraddr, payload)) {
+      break;
+    }
+    if (type == UPGRADE_END) {
+      SendAck(sock);
+      break;
+    } else if (type == UPGRADE_LISTENER && fd >= 0) {
+      listenfd_ = fd;
+      if (!SendAck(sock)) {
+        break;
+      }
+    } else if (type == UPGRADE_CONNECTION && fd >= 0) {
+      InheritedConnection conn;
+      conn.fd = fd;
+      conn.peeraddr = peeraddr;
+      conn.unread.swap(payload);
+      connections_.push_back(conn);
+    } else if (fd >= 0) {
+      close(fd);
+    }
+  }
+  close(sock);
+  std::cout << "Hot upgrade: inherited listener " << listenfd_ << " and "
+            << connections_.size() << " connections" << std::endl;
+  return listenfd_ >= 0;
+}
+void HotUpgrade::Listen(HandOverCallBack &&cb) {
+  handovercallback_ = std::move(cb);
+  struct sockaddr_un addr;
+  if (!FillUnixAddr(path_, addr)) return;
+  //旧进程已经交出了控制权，路径可以直接覆盖
+  unlink(path_.c_str());
+  ctrlfd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (ctrlfd_ < 0) {
+    perror("upgrade socket");
+    return;
+  }
+  if (bind(ctrlfd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(ctrlfd_, 1) < 0) {
+    perror("upgrade bind");
+    close(ctrlfd_);
+    ctrlfd_ = -1;
+    return;
+  }
+  ctrlchannel_.SetFd(ctrlfd_);
+  ctrlchannel_.SetEvents(EPOLLIN);
+  ctrlchannel_.setReadHandler(std::bind(&HotUpgrade::HandleAccept, this));
+  loop_->AddChannelToPoller(&ctrlchannel_);
+  std::cout << "Hot upgrade: waiting for successor on " << path_ << std::endl;
+}
+void HotUpgrade::HandleAccept() {
+  int sock = accept4(ctrlfd_, NULL, NULL, SOCK_CLOEXEC);
+  if (sock < 0) {
+    if (errno != EAGAIN) perror("upgrade accept");
+    return;
+  }
+  //同一时刻只交接给一个新进程，控制socket的路径留给新进程重新绑定
+  loop_->RemoveChannelFromPoller(&ctrlchannel_);
+  close(ctrlfd_);
+  ctrlfd_ = -1;
+  SetTimeout(sock);
+  handovercallback_(sock);
+}
+bool HotUpgrade::SendFd(int sock, uint32_t type, int fd, const SockAddress* peeraddr, const std::string& payload) {
+  UpgradeHeader header;
+  memset(&header, 0, sizeof(header));
+  header.type = type;
+  header.length = static_cast<uint32_t>(payload.size());
+  if (peeraddr) {
+    header.peerlen = peeraddr->Length();
+    memcpy(&header.peeraddr, peeraddr->GetSockAddr(), peeraddr->Length());
+  }
+  struct iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  char control[CMSG_SPACE(sizeof(int))];
+  if (fd >= 0) {
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+  ssize_t n;
+  do {
+    n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n != static_cast<ssize_t>(sizeof(header))) {
+    perror("upgrade sendmsg");
+    return false;
+  }
+  return WriteAll(sock, payload.data(), payload.size());
+}
+bool HotUpgrade::RecvFd(int sock, uint32_t& type, int& fd, SockAddress& peeraddr, std::string& payload) {
+  UpgradeHeader header;
+  struct iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  char control[CMSG_SPACE(sizeof(int))];
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n;
+  do {
+    n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n != static_cast<ssize_t>(sizeof(header))) {
+    if (n < 0) perror("upgrade recvmsg");
+    return false;
+  }
+  fd = -1;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+  }
+  type = header.type;
+  if (header.peerlen > sizeof(header.peeraddr)) {
+    header.peerlen = sizeof(header.peeraddr);
+  }
+  peeraddr = SockAddress(reinterpret_cast<const struct sockaddr*>(&header.peeraddr), header.peerlen);
+  payload.resize(header.length);
+  if (header.length > 0 && !ReadAll(sock, &payload[0], header.length)) {
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  return true;
+}
+bool HotUpgrade::SendAck(int sock) {
+  char ack = UPGRADE_ACK;
+  return WriteAll(sock, &ack, 1);
+}
+void HotUpgrade::WaitAck(int sock, AckCallBack &&cb) {
+  acksock_ = sock;
+  ackcallback_ = std::move(cb);
+  ++ackseq_;
+  ackchannel_.SetFd(sock);
+  ackchannel_.SetEvents(EPOLLIN);
+  ackchannel_.setReadHandler(std::bind(&HotUpgrade::HandleAck, this));
+  ackchannel_.setErrorHandler(std::bind(&HotUpgrade::HandleAck, this));
+  ackchannel_.setCloseHandler(std::bind(&HotUpgrade::HandleAck, this));
+  loop_->AddChannelToPoller(&ackchannel_);
+  TimerManager::GetInstance()->Start();
+  acktimer_.Adjust(UPGRADE_TIMEOUT * 1000, Timer::TIMER_ONCE, std::bind(&HotUpgrade::OnAckTimer, this, ackseq_));
+}
+void HotUpgrade::HandleAck() {
+  //读、错误和挂断可能在同一次事件里先后回调，结束后的回调直接忽略
+  if (acksock_ < 0) {
+    return;
+  }
+  char ack = 0;
+  ssize_t n = read(acksock_, &ack, 1);
+  if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return;
+  }
+  if (n < 0) {
+    perror("upgrade read");
+  }
+  FinishAck(n == 1 && ack == UPGRADE_ACK);
+}
+void HotUpgrade::OnAckTimer(uint64_t seq) {
+  loop_->AddTask(std::bind(&HotUpgrade::AckTimeout, this, seq));
+}
+void HotUpgrade::AckTimeout(uint64_t seq) {
+  if (seq != ackseq_ || acksock_ < 0) {
+    return;
+  }
+  std::cerr << "Hot upgrade: no acknowledgement from successor within " << UPGRADE_TIMEOUT << "s" << std::endl;
+  FinishAck(false);
+}
+void HotUpgrade::FinishAck(bool acked) {
+  acktimer_.Stop();
+  loop_->RemoveChannelFromPoller(&ackchannel_);
+  acksock_ = -1;
+  //回调里可能再次等待或关闭socket，放到任务里执行，不在这次事件分发中途改动channel
+  AckCallBack cb;
+  cb.swap(ackcallback_);
+  loop_->AddTask(std::bind(cb, acked));
+}
@@ -0,0 +1,73 @@
+#ifndef _HOTUPGRADE_H_
+#define _HOTUPGRADE_H_
+//热升级：新旧进程之间通过Unix域socket（SCM_RIGHTS）传递监听socket和空闲连接
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <netinet/in.h>
+#include "Channel.h"
+#include "EventLoop.h"
+#include "SockAddress.h"
+#include "Timer.h"
+class HotUpgrade {
+public:
+  //旧进程收到新进程的接管请求时回调，参数为与新进程通信的socket，由回调负责关闭
+  typedef std::function<void(int)> HandOverCallBack;
+  //等待新进程确认的结果回调，参数为是否收到了确认
+  typedef std::function<void(bool)> AckCallBack;
+  //消息类型
+  enum {
+    UPGRADE_LISTENER = 1,//监听socket，新进程收到后立即回复确认
+    UPGRADE_CONNECTION,//已建立的连接，附带未处理的读缓冲
+    UPGRADE_END//传递结束，新进程收到后再回复一次确认，旧进程这时才关闭交出去的连接
+  };
+  //从旧进程继承来的连接
+  struct InheritedConnection {
+    int fd;
+    SockAddress peeraddr;
+    std::string unread;//旧进程中尚未被业务层消费的数据
+  };
+  HotUpgrade(EventLoop* loop, const std::string& path);
+  ~HotUpgrade();
+  //新进程启动时调用：连接旧进程的控制socket并接管fd，旧进程不存在时返回false
+  bool Inherit();
+  //继承到的监听socket，没有则为-1
+  int GetListenFd() const { return listenfd_; }
+  //继承到的连接，取走后由调用者负责
+  std::vector<InheritedConnection>& GetConnections() { return connections_; }
+  //监听控制socket，等待下一个新进程来接管
+  void Listen(HandOverCallBack &&cb);
+  //发送一条消息，fd为-1时不附带描述符
+  static bool SendFd(int sock, uint32_t type, int fd, const SockAddress* peeraddr, const std::string& payload);
+  //接收一条消息，没有附带描述符时fd为-1
+  static bool RecvFd(int sock, uint32_t& type, int& fd, SockAddress& peeraddr, std::string& payload);
+  //新进程收到监听socket后回复确认，旧进程收到确认后才停止accept并摘下空闲连接，没有确认时什么都没交出去
+  static bool SendAck(int sock);
+  //在loop上等待一次确认，不阻塞loop：socket注册到loop上读取确认，超时由定时器检查；
+  //收到确认、对端关闭或超时后在loop的任务里回调，同一时刻只等待一次
+  void WaitAck(int sock, AckCallBack &&cb);
+private:
+  //控制socket可读，新进程发起接管
+  void HandleAccept();
+  //等待确认的socket可读或出错
+  void HandleAck();
+  //定时器线程：等待超时，交回loop线程处理
+  void OnAckTimer(uint64_t seq);
+  void AckTimeout(uint64_t seq);
+  //结束这次等待，从loop上摘下socket后回调
+  void FinishAck(bool acked);
+  EventLoop* loop_;
+  std::string path_;//控制socket路径
+  int ctrlfd_;//控制socket监听描述符
+  Channel ctrlchannel_;
+  int listenfd_;
+  std::vector<InheritedConnection> connections_;
+  HandOverCallBack handovercallback_;
+  int acksock_;//正在等待确认的socket，没有等待时为-1
+  Channel ackchannel_;
+  Timer acktimer_;
+  uint64_t ackseq_;//第几次等待，超时任务据此忽略已经结束的等待
+  AckCallBack ackcallback_;
+};
+#endif // !_HOTUPGRADE_H_
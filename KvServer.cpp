@@ -0,0 +1,306 @@
+#include "KvServer.h"
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include "RespCodec.h"
+#include "TimerManager.h"
+#include "LoopWatchdog.h"
+#define KV_EXPIRE_INTERVAL 100 //主动删除过期键的间隔，单位ms
+#define KV_EXPIRE_LIMIT 1000 //每个分片每次最多删除的过期键数，避免一次占用loop太久
+#define KV_CHANNEL_CAPACITY 1024 //每对loop之间通道的容量，单位为批次
+static ServerOptions FixedLoops(const ServerOptions& options) {
+  ServerOptions fixed = options;
+  fixed.maxloops = 0;
+  return fixed;
+}
+KvServer::KvServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const ServerOptions& options)
+    : channels_(), shards_(), server_(loop, listenaddr, this, threadnum, FixedLoops(options)), expiretimer_() {
+}
+KvServer::~KvServer() {
+}
+void KvServer::Start() {
+  server_.Start();
+  channels_.reset(new LoopChannels<ShardMessage>(server_.GetThreadPool()->GetAllLoops(), KV_CHANNEL_CAPACITY,
+      std::bind(&KvServer::OnShardMessage, this, std::placeholders::_1, std::placeholders::_2)));
+  for (size_t i = 0; i < channels_->Size(); ++i) {
+    shards_.push_back(std::unique_ptr<KvShard>(new KvShard()));
+  }
+  channels_->Start();
+  expiretimer_.reset(new Timer(KV_EXPIRE_INTERVAL, Timer::TIMER_PERIOD, std::bind(&KvServer::OnExpireTimer, this)));
+  TimerManager::GetInstance()->Start();
+  expiretimer_->Start();
+  std::cout << "KvServer started with " << shards_.size() << " shards" << std::endl;
+}
+int64_t KvServer::NowMs() {
+  return LoopWatchdog::Now() / 1000000;
+}
+size_t KvServer::ShardOf(const std::string& key) const {
+  return std::hash<std::string>()(key) % shards_.size();
+}
+void KvServer::HandleNewConnection(const TcpConnectionPtr& conn) {
+  //会话作为上下文，连接因此不会被迁移到别的loop
+  conn->SetContext(std::make_shared<Session>());
+}
+void KvServer::HandleMessage(const TcpConnectionPtr& conn, std::string& message) {
+  Session* session = static_cast<Session*>(conn->GetContext().get());
+  std::vector<Batch*> batches(shards_.size(), nullptr);
+  std::vector<std::string> args;
+  size_t pos = 0;
+  for (;;) {
+    int ret = RespCodec::Parse(message, pos, args);
+    if (ret == RespCodec::RESP_INCOMPLETE) {
+      break;
+    }
+    if (ret == RespCodec::RESP_ERROR) {
+      //协议错误后无法再找到下一条命令的起点，回复错误后关闭
+      Reply reply;
+      reply.kind = Reply::REPLY_PLAIN;
+      reply.pending = 0;
+      RespCodec::AppendError(reply.data, "Protocol error");
+      session->replies.push_back(std::move(reply));
+      session->quit = true;
+      pos = message.size();
+      break;
+    }
+    if (!args.empty()) {
+      Dispatch(conn, session, args, batches);
+    }
+    if (session->quit) {
+      pos = message.size();
+      break;
+    }
+  }
+  message.erase(0, pos);
+  int local = channels_->IndexOf(conn->GetLoop());
+  for (size_t i = 0; i < batches.size(); ++i) {
+    if (batches[i]) {
+      batches[i]->conn = conn;
+      batches[i]->origin = local;
+      batches[i]->shard = i;
+      Post(local, i, ShardMessage::MSG_EXECUTE, batches[i]);
+    }
+  }
+  FlushReplies(conn, session);
+}
+void KvServer::Dispatch(const TcpConnectionPtr& conn, Session* session, std::vector<std::string>& args, std::vector<Batch*>& batches) {
+  std::string& name = args[0];
+  std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+  int local = channels_->IndexOf(conn->GetLoop());
+  uint64_t seq = session->base + session->replies.size();
+  session->replies.push_back(Reply());
+  Reply& reply = session->replies.back();
+  reply.kind = Reply::REPLY_PLAIN;
+  reply.pending = 0;
+  reply.count = 0;
+  Op op;
+  op.seq = seq;
+  op.part = 0;
+  op.expireat = 0;
+  if (name == "GET" && args.size() == 2) {
+    op.type = Op::OP_GET;
+    op.key.swap(args[1]);
+    reply.pending = 1;
+    Route(session, local, op, batches);
+  } else if (name == "SET" && args.size() >= 3) {
+    op.type = Op::OP_SET;
+    if (args.size() == 5) {
+      std::string unit = args[3];
+      std::transform(unit.begin(), unit.end(), unit.begin(), ::toupper);
+      int64_t ttl = atoll(args[4].c_str());
+      if ((unit != "EX" && unit != "PX") || ttl <= 0) {
+        RespCodec::AppendError(reply.data, "syntax error");
+        return;
+      }
+      op.expireat = NowMs() + (unit == "EX" ? ttl * 1000 : ttl);
+    } else if (args.size() != 3) {
+      RespCodec::AppendError(reply.data, "syntax error");
+      return;
+    }
+    op.key.swap(args[1]);
+    op.value.swap(args[2]);
+    reply.pending = 1;
+    Route(session, local, op, batches);
+  } else if (name == "DEL" && args.size() >= 2) {
+    reply.kind = Reply::REPLY_COUNT;
+    op.type = Op::OP_DEL;
+    //先记下全部键数，本地分片的操作会立即返回，计数中途归零会提前编码回复
+    reply.pending = args.size() - 1;
+    for (size_t i = 1; i < args.size(); ++i) {
+      op.key.swap(args[i]);
+      Route(session, local, op, batches);
+    }
+  } else if (name == "MGET" && args.size() >= 2) {
+    reply.kind = Reply::REPLY_ARRAY;
+    reply.parts.resize(args.size() - 1);
+    op.type = Op::OP_GET;
+    reply.pending = args.size() - 1;
+    for (size_t i = 1; i < args.size(); ++i) {
+      op.part = i - 1;
+      op.key.swap(args[i]);
+      Route(session, local, op, batches);
+    }
+  } else if (name == "EXPIRE" && args.size() == 3) {
+    op.type = Op::OP_EXPIRE;
+    op.expireat = NowMs() + atoll(args[2].c_str()) * 1000;
+    op.key.swap(args[1]);
+    reply.pending = 1;
+    Route(session, local, op, batches);
+  } else if (name == "TTL" && args.size() == 2) {
+    op.type = Op::OP_TTL;
+    op.key.swap(args[1]);
+    reply.pending = 1;
+    Route(session, local, op, batches);
+  } else if (name == "PING") {
+    if (args.size() > 1) {
+      RespCodec::AppendBulk(reply.data, args[1].data(), args[1].size());
+    } else {
+      RespCodec::AppendStatus(reply.data, "PONG");
+    }
+  } else if (name == "CONFIG" || name == "COMMAND") {
+    RespCodec::AppendArrayHeader(reply.data, 0); //没有可报告的配置和命令表
+  } else if (name == "QUIT") {
+    RespCodec::AppendStatus(reply.data, "OK");
+    session->quit = true;
+  } else {
+    RespCodec::AppendError(reply.data, "unknown command or wrong number of arguments for '" + name + "'");
+  }
+}
+void KvServer::Route(Session* session, int local, Op& op, std::vector<Batch*>& batches) {
+  size_t shard = ShardOf(op.key);
+  if (static_cast<int>(shard) == local) {
+    Result result;
+    Execute(shards_[shard].get(), op, result, NowMs());
+    ApplyResult(session, result);
+    return;
+  }
+  if (!batches[shard]) {
+    batches[shard] = new Batch();
+  }
+  batches[shard]->ops.push_back(std::move(op));
+}
+void KvServer::Execute(KvShard* shard, Op& op, Result& result, int64_t now) {
+  result.seq = op.seq;
+  result.part = op.part;
+  result.count = 0;
+  switch (op.type) {
+    case Op::OP_GET:
+      shard->GetEncoded(op.key, now, result.data);
+      break;
+    case Op::OP_SET:
+      shard->Set(op.key, op.value, op.expireat);
+      RespCodec::AppendStatus(result.data, "OK");
+      break;
+    case Op::OP_DEL:
+      result.count = shard->Del(op.key, now);
+      break;
+    case Op::OP_EXPIRE:
+      RespCodec::AppendInteger(result.data, shard->Expire(op.key, op.expireat, now) ? 1 : 0);
+      break;
+    case Op::OP_TTL:
+    {
+      int64_t ttl = shard->Ttl(op.key, now);
+      RespCodec::AppendInteger(result.data, ttl < 0 ? ttl : (ttl + 999) / 1000);
+      break;
+    }
+  }
+}
+void KvServer::Post(int from, size_t to, int kind, Batch* batch) {
+  ShardMessage message;
+  message.kind = kind;
+  message.batch = batch;
+  if (from >= 0) {
+    //通道满时进入有序的溢出队列，不能退回AddTask：任务先于通道处理，同一连接的批次会乱序
+    channels_->Post(from, to, message);
+    return;
+  }
+  channels_->GetLoop(to)->AddTask(std::bind(&KvServer::OnShardMessage, this, static_cast<size_t>(from), message));
+}
+void KvServer::OnShardMessage(size_t from, ShardMessage& message) {
+  if (message.kind == ShardMessage::MSG_EXECUTE) {
+    ExecuteBatch(message.batch);
+  } else {
+    CompleteBatch(message.batch);
+  }
+}
+void KvServer::ExecuteBatch(Batch* batch) {
+  batch->results.resize(batch->ops.size());
+  int64_t now = NowMs();
+  for (size_t i = 0; i < batch->ops.size(); ++i) {
+    Execute(shards_[batch->shard].get(), batch->ops[i], batch->results[i], now);
+  }
+  if (batch->origin < 0) {
+    //连接不在通道的loop上（不会出现，分片固定在Start时的loop上），直接投递回连接所在的loop
+    batch->conn->GetLoop()->AddTask(std::bind(&KvServer::CompleteBatch, this, batch));
+    return;
+  }
+  Post(static_cast<int>(batch->shard), batch->origin, ShardMessage::MSG_COMPLETE, batch);
+}
+void KvServer::CompleteBatch(Batch* batch) {
+  std::unique_ptr<Batch> owner(batch);
+  const TcpConnectionPtr& conn = batch->conn;
+  if (conn->Disconnected()) {
+    return;
+  }
+  Session* session = static_cast<Session*>(conn->GetContext().get());
+  for (auto &result : batch->results) {
+    ApplyResult(session, result);
+  }
+  FlushReplies(conn, session);
+}
+void KvServer::ApplyResult(Session* session, Result& result) {
+  Reply& reply = session->replies[result.seq - session->base];
+  --reply.pending;
+  switch (reply.kind) {
+    case Reply::REPLY_PLAIN:
+      reply.data.swap(result.data);
+      break;
+    case Reply::REPLY_ARRAY:
+      reply.parts[result.part].swap(result.data);
+      if (reply.pending == 0) {
+        RespCodec::AppendArrayHeader(reply.data, reply.parts.size());
+        for (auto &part : reply.parts) {
+          reply.data += part;
+        }
+      }
+      break;
+    case Reply::REPLY_COUNT:
+      reply.count += result.count;
+      if (reply.pending == 0) {
+        RespCodec::AppendInteger(reply.data, reply.count);
+      }
+      break;
+  }
+}
+void KvServer::FlushReplies(const TcpConnectionPtr& conn, Session* session) {
+  std::string out;
+  while (!session->replies.empty() && session->replies.front().pending == 0) {
+    if (out.empty()) {
+      out.swap(session->replies.front().data);
+    } else {
+      out += session->replies.front().data;
+    }
+    session->replies.pop_front();
+    ++session->base;
+  }
+  if (!out.empty()) {
+    conn->Send(std::move(out));
+  }
+  if (session->quit && session->replies.empty()) {
+    conn->Shutdown();
+  }
+}
+void KvServer::OnExpireTimer() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    KvShard* shard = shards_[i].get();
+    channels_->GetLoop(i)->AddTask([shard]() {
+      shard->ExpireKeys(NowMs(), KV_EXPIRE_LIMIT);
+    });
+  }
+}
+void KvServer::HandleSendComplete(const TcpConnectionPtr& conn) {
+}
+void KvServer::HandleClose(const TcpConnectionPtr& conn) {
+}
+void KvServer::HandleError(const TcpConnectionPtr& conn) {
+}
@@ -0,0 +1,104 @@
+#ifndef _KVSERVER_H_
+#define _KVSERVER_H_
+//Redis协议的内存KV服务，可以用redis-benchmark/redis-cli测试
+//数据按键的哈希分片，每个IO线程持有一个分片，分片只在自己的线程里访问，互不加锁
+//连接上的命令落在本线程的分片时直接执行；落在其他分片的，一次读到的所有命令按分片攒成一批，经loop间消息通道交给分片所在的线程，
+//结果再成批送回连接所在的线程；流水线上的回复按命令顺序发出
+//支持GET、SET（EX/PX）、DEL、MGET、EXPIRE、TTL、PING，以及redis-benchmark启动时发送的CONFIG、COMMAND
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include "BasicTcpServer.h"
+#include "KvShard.h"
+#include "LoopChannel.h"
+#include "Timer.h"
+class KvServer {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //分片固定在Start时的IO线程上，不开启IO线程的弹性伸缩（options里的设置会被忽略）
+  KvServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const ServerOptions& options = ServerOptions());
+  ~KvServer();
+  void Start();
+  TcpServer& GetServer() { return server_; }
+private:
+  friend class BasicTcpServer<KvServer>;
+  //一条命令的回复，等所有分片操作返回后编码完成
+  struct Reply {
+    enum { REPLY_PLAIN, REPLY_ARRAY, REPLY_COUNT };
+    int kind;
+    int pending;//还没返回的分片操作数
+    std::string data;//编码好的回复
+    std::vector<std::string> parts;//MGET每个键的回复
+    int64_t count;//DEL删除的键数
+  };
+  //连接上的会话，作为连接的上下文，只在连接所属的IO线程访问
+  struct Session {
+    std::deque<Reply> replies;//按命令顺序排队的回复
+    uint64_t base;//replies队首命令的序号
+    bool quit;//收到QUIT，回复发完后关闭
+    Session() : replies(), base(0), quit(false) {}
+  };
+  //发给分片的一个操作
+  struct Op {
+    enum { OP_GET, OP_SET, OP_DEL, OP_EXPIRE, OP_TTL };
+    int type;
+    uint64_t seq;//所属命令的序号
+    size_t part;//MGET中的位置
+    std::string key;
+    std::string value;
+    int64_t expireat;
+  };
+  //分片操作的结果
+  struct Result {
+    uint64_t seq;
+    size_t part;
+    std::string data;//GET/TTL/EXPIRE编码好的回复
+    int64_t count;//DEL删除的键数
+  };
+  //发给一个分片的一批操作，分片执行后把结果写进results，再送回连接所在的loop，在那里释放
+  struct Batch {
+    TcpConnectionPtr conn;
+    int origin;//连接所在loop的下标
+    size_t shard;
+    std::vector<Op> ops;
+    std::vector<Result> results;
+  };
+  //loop间通道上的消息，只带批次指针
+  struct ShardMessage {
+    enum { MSG_EXECUTE, MSG_COMPLETE };
+    int kind;
+    Batch* batch;
+  };
+  void HandleNewConnection(const TcpConnectionPtr& conn);
+  void HandleMessage(const TcpConnectionPtr& conn, std::string& message);
+  void HandleSendComplete(const TcpConnectionPtr& conn);
+  void HandleClose(const TcpConnectionPtr& conn);
+  void HandleError(const TcpConnectionPtr& conn);
+  //解析出的一条命令：本地分片的操作直接执行，其他分片的放进batches
+  void Dispatch(const TcpConnectionPtr& conn, Session* session, std::vector<std::string>& args, std::vector<Batch*>& batches);
+  //把一个操作交给key所在的分片，调用前回复的pending已计入该操作
+  void Route(Session* session, int local, Op& op, std::vector<Batch*>& batches);
+  //把消息发给loops[to]，from为当前loop的下标，通道满时进入通道的溢出队列，仍保持顺序；不在通道里的loop上时退回AddTask
+  void Post(int from, size_t to, int kind, Batch* batch);
+  //在接收方loop线程处理通道上的消息
+  void OnShardMessage(size_t from, ShardMessage& message);
+  //在分片所属的IO线程执行一批操作，结果成批送回连接所在的线程
+  void ExecuteBatch(Batch* batch);
+  void CompleteBatch(Batch* batch);
+  void Execute(KvShard* shard, Op& op, Result& result, int64_t now);
+  //把结果填进对应命令的回复
+  void ApplyResult(Session* session, Result& result);
+  //发送队首已经完成的回复
+  void FlushReplies(const TcpConnectionPtr& conn, Session* session);
+  //定时器线程：让各分片删除过期的键
+  void OnExpireTimer();
+  size_t ShardOf(const std::string& key) const;
+  static int64_t NowMs();
+  //第i个分片在通道的第i个loop上，Start之后只读；通道和分片都排在server_之前，IO线程都退出后再析构
+  std::unique_ptr<LoopChannels<ShardMessage> > channels_;
+  std::vector<std::unique_ptr<KvShard> > shards_;
+  BasicTcpServer<KvServer> server_;
+  std::unique_ptr<Timer> expiretimer_;
+};
+#endif // !_KVSERVER_H_
@@ -0,0 +1,164 @@
+#include "KvShard.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include "RespCodec.h"
+#define KV_ARENA_MIN 16 //最小的块
+#define KV_ARENA_BLOCK (256 * 1024) //每次向系统申请的大块
+KvArena::KvArena() : blocks_(), current_(nullptr), left_(0), memory_(0) {
+  for (int i = 0; i < KV_ARENA_CLASSES; ++i) {
+    freelists_[i] = nullptr;
+  }
+}
+KvArena::~KvArena() {
+  for (auto &block : blocks_) {
+    free(block);
+  }
+}
+int KvArena::ClassOf(size_t size) {
+  int cls = 0;
+  size_t capacity = KV_ARENA_MIN;
+  while (capacity < size) {
+    capacity <<= 1;
+    ++cls;
+  }
+  return cls;
+}
+char* KvArena::Allocate(size_t size, size_t& capacity) {
+  int cls = ClassOf(size);
+  if (cls >= KV_ARENA_CLASSES) {
+    capacity = size;
+    memory_ += size;
+    return static_cast<char*>(malloc(size));
+  }
+  capacity = static_cast<size_t>(KV_ARENA_MIN) << cls;
+  char* data = freelists_[cls];
+  if (data) {
+    memcpy(&freelists_[cls], data, sizeof(char*));
+    return data;
+  }
+  if (left_ < capacity) {
+    //当前大块剩下的部分不够，丢弃不用，块都是2的幂，浪费不超过最大级别
+    current_ = static_cast<char*>(malloc(KV_ARENA_BLOCK));
+    blocks_.push_back(current_);
+    left_ = KV_ARENA_BLOCK;
+    memory_ += KV_ARENA_BLOCK;
+  }
+  data = current_;
+  current_ += capacity;
+  left_ -= capacity;
+  return data;
+}
+void KvArena::Free(char* data, size_t capacity) {
+  int cls = ClassOf(capacity);
+  if (cls >= KV_ARENA_CLASSES) {
+    memory_ -= capacity;
+    free(data);
+    return;
+  }
+  memcpy(data, &freelists_[cls], sizeof(char*));
+  freelists_[cls] = data;
+}
+KvShard::KvShard() : table_(), arena_(), expires_() {
+}
+KvShard::~KvShard() {
+  for (auto it = table_.begin(); it != table_.end(); ++it) {
+    arena_.Free(it->second.data, it->second.capacity);
+  }
+}
+KvShard::Table::iterator KvShard::Find(const std::string& key, int64_t now) {
+  auto it = table_.find(key);
+  if (it != table_.end() && it->second.expireat != 0 && it->second.expireat <= now) {
+    Erase(it);
+    return table_.end();
+  }
+  return it;
+}
+void KvShard::Erase(Table::iterator it) {
+  arena_.Free(it->second.data, it->second.capacity);
+  table_.erase(it);
+}
+bool KvShard::Get(const std::string& key, int64_t now, std::string& value) {
+  auto it = Find(key, now);
+  if (it == table_.end()) {
+    return false;
+  }
+  value.assign(it->second.data, it->second.len);
+  return true;
+}
+void KvShard::GetEncoded(const std::string& key, int64_t now, std::string& out) {
+  auto it = Find(key, now);
+  if (it == table_.end()) {
+    RespCodec::AppendNull(out);
+  } else {
+    RespCodec::AppendBulk(out, it->second.data, it->second.len);
+  }
+}
+void KvShard::Set(const std::string& key, const std::string& value, int64_t expireat) {
+  auto result = table_.insert(std::make_pair(key, Value()));
+  Value& entry = result.first->second;
+  if (result.second) {
+    entry.data = nullptr;
+    entry.capacity = 0;
+  }
+  if (entry.data == nullptr || entry.capacity < value.size() ||
+      (entry.capacity > KV_ARENA_MIN && entry.capacity / 2 >= value.size())) {
+    //原来的块放不下或者大了一倍以上，换一个合适的
+    if (entry.data) {
+      arena_.Free(entry.data, entry.capacity);
+    }
+    size_t capacity = 0;
+    entry.data = arena_.Allocate(value.size() > 0 ? value.size() : 1, capacity);
+    entry.capacity = capacity;
+  }
+  memcpy(entry.data, value.data(), value.size());
+  entry.len = value.size();
+  entry.expireat = expireat;
+  if (expireat != 0) {
+    expires_.push(std::make_pair(expireat, key));
+  }
+}
+int KvShard::Del(const std::string& key, int64_t now) {
+  auto it = Find(key, now);
+  if (it == table_.end()) {
+    return 0;
+  }
+  Erase(it);
+  return 1;
+}
+bool KvShard::Expire(const std::string& key, int64_t expireat, int64_t now) {
+  auto it = Find(key, now);
+  if (it == table_.end()) {
+    return false;
+  }
+  if (expireat <= now) {
+    Erase(it);
+    return true;
+  }
+  it->second.expireat = expireat;
+  expires_.push(std::make_pair(expireat, key));
+  return true;
+}
+int64_t KvShard::Ttl(const std::string& key, int64_t now) {
+  auto it = Find(key, now);
+  if (it == table_.end()) {
+    return -2;
+  }
+  if (it->second.expireat == 0) {
+    return -1;
+  }
+  return it->second.expireat - now;
+}
+size_t KvShard::ExpireKeys(int64_t now, size_t limit) {
+  size_t expired = 0;
+  while (!expires_.empty() && expires_.top().first <= now && expired < limit) {
+    auto it = table_.find(expires_.top().second);
+    //键被覆盖、删除或改了过期时间的旧项直接丢弃
+    if (it != table_.end() && it->second.expireat == expires_.top().first) {
+      Erase(it);
+      ++expired;
+    }
+    expires_.pop();
+  }
+  return expired;
+}
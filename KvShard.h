@@ -0,0 +1,64 @@
+#ifndef _KVSHARD_H_
+#define _KVSHARD_H_
+//KV服务的一个分片：哈希表和过期索引，只在所属loop线程访问，不加锁
+//值从分片自己的arena分配：小块按2的幂分级，从大块内存里切出，释放后挂到本级空闲链表复用；超过最大级别的直接malloc
+#include <string>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <cstdint>
+#define KV_ARENA_CLASSES 9 //arena的级别数，16字节到4KB
+class KvArena {
+public:
+  KvArena();
+  ~KvArena();
+  //分配至少size字节，capacity返回实际容量，释放时原样传回
+  char* Allocate(size_t size, size_t& capacity);
+  void Free(char* data, size_t capacity);
+  //向系统申请的内存，包括空闲链表上的块
+  size_t MemoryUsage() const { return memory_; }
+private:
+  static int ClassOf(size_t size);
+  char* freelists_[KV_ARENA_CLASSES];//各级空闲链表，块的前8字节存下一块的地址
+  std::vector<char*> blocks_;//切分小块用的大块内存
+  char* current_;//当前大块中未切分部分的起点
+  size_t left_;//当前大块剩余的字节数
+  size_t memory_;
+};
+class KvShard {
+public:
+  KvShard();
+  ~KvShard();
+  //now和expireat都是单调时钟毫秒数，expireat为0表示不过期；已过期的键按不存在处理并顺手删除
+  bool Get(const std::string& key, int64_t now, std::string& value);
+  //查到时把值按RESP批量字符串编码追加到out，避免中间拷贝；不存在时追加空回复
+  void GetEncoded(const std::string& key, int64_t now, std::string& out);
+  void Set(const std::string& key, const std::string& value, int64_t expireat);
+  //返回删除的键数
+  int Del(const std::string& key, int64_t now);
+  //设置过期时间，键不存在返回false
+  bool Expire(const std::string& key, int64_t expireat, int64_t now);
+  //剩余生存时间，单位ms；键不存在返回-2，没有过期时间返回-1
+  int64_t Ttl(const std::string& key, int64_t now);
+  //主动删除最多limit个已过期的键，返回删除数，由定时任务调用
+  size_t ExpireKeys(int64_t now, size_t limit);
+  size_t Size() const { return table_.size(); }
+  size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+private:
+  struct Value {
+    char* data;
+    uint32_t len;
+    uint32_t capacity;
+    int64_t expireat;
+  };
+  typedef std::unordered_map<std::string, Value> Table;
+  //找到未过期的键，过期的删除后返回end
+  Table::iterator Find(const std::string& key, int64_t now);
+  void Erase(Table::iterator it);
+  Table table_;
+  KvArena arena_;
+  //过期索引：按过期时间排序的(时间,键)，键被覆盖或删除后旧项不删，弹出时和表里的过期时间比对
+  typedef std::pair<int64_t, std::string> ExpireItem;
+  std::priority_queue<ExpireItem, std::vector<ExpireItem>, std::greater<ExpireItem> > expires_;
+};
+#endif // !_KVSHARD_H_
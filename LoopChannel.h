@@ -0,0 +1,217 @@
+#ifndef _LOOPCHANNEL_H_
+#define _LOOPCHANNEL_H_
+//loop之间的消息通道：每对loop之间一个有界的单生产者单消费者环形队列，消息为定长、可平凡拷贝的类型，收发都不分配内存、不加锁
+//接收方loop每轮迭代执行完任务后把发给自己的所有队列取空一次；只有队列从空变为非空时才写eventfd唤醒接收方，
+//接收方忙着的时候连续发来的消息不再产生系统调用。队列满时Send返回false，由调用者稍后重试（背压）；
+//Post不会失败：队列满时消息进入这对loop的溢出队列（加锁、分配内存），接收方取空环形队列后接着取溢出队列，
+//溢出队列非空期间新消息也排在它后面，同一对loop之间的消息始终按发送顺序处理
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <type_traits>
+#include <cstddef>
+#include "EventLoop.h"
+#define LOOPCHANNEL_CACHELINE 64 //生产者和消费者各自改写的下标分开放，避免伪共享
+//EventLoop每轮迭代执行完任务后调用一次Drain，只在所属loop线程登记和调用
+class LoopInbox {
+public:
+  virtual ~LoopInbox() {}
+  virtual void Drain() = 0;
+};
+//单生产者单消费者环形队列，容量向上取整为2的幂
+template <typename T>
+class SpscRing {
+  static_assert(std::is_trivially_copyable<T>::value, "SpscRing messages must be trivially copyable");
+public:
+  explicit SpscRing(size_t capacity) : mask_(RoundUp(capacity) - 1), slots_(new T[mask_ + 1]), head_(0), cachedtail_(0), tail_(0), cachedhead_(0) {}
+  //生产者线程：放入一条消息，满时返回false；wake为true表示消费者此前已经取空了队列，可能在epoll_wait里，需要唤醒
+  bool Push(const T& message, bool& wake) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cachedhead_ > mask_) {
+      cachedhead_ = head_.load(std::memory_order_acquire);
+      if (tail - cachedhead_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = message;
+    tail_.store(tail + 1, std::memory_order_release);
+    //与Drain里取空后的再确认配对：两边都是先写自己的下标再读对方的，至少有一边能看到对方的写入，
+    //要么消费者看到这条消息接着取，要么这里看到队列已被取空去唤醒，消息不会滞留到下一次超时
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cachedhead_ = head_.load(std::memory_order_relaxed);
+    wake = cachedhead_ == tail;
+    return true;
+  }
+  //消费者线程：取出所有消息依次交给fn，返回取出的条数
+  template <typename Fn>
+  size_t Drain(Fn fn) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t count = 0;
+    for (;;) {
+      if (head == cachedtail_) {
+        cachedtail_ = tail_.load(std::memory_order_acquire);
+        if (head == cachedtail_) {
+          head_.store(head, std::memory_order_release);
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          cachedtail_ = tail_.load(std::memory_order_acquire);
+          if (head == cachedtail_) {
+            return count;
+          }
+        }
+      }
+      for (; head != cachedtail_; ++head, ++count) {
+        fn(slots_[head & mask_]);
+      }
+      head_.store(head, std::memory_order_release); //处理完才归还槽位
+    }
+  }
+  size_t Capacity() const { return mask_ + 1; }
+private:
+  static size_t RoundUp(size_t n) {
+    size_t capacity = 1;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+  //消费者改写
+  char pad0_[LOOPCHANNEL_CACHELINE];
+  std::atomic<size_t> head_;
+  size_t cachedtail_;//消费者上次读到的tail，读空之前不再读生产者的缓存行
+  //生产者改写
+  char pad1_[LOOPCHANNEL_CACHELINE];
+  std::atomic<size_t> tail_;
+  size_t cachedhead_;//生产者上次读到的head，快满之前不再读消费者的缓存行
+  char pad2_[LOOPCHANNEL_CACHELINE];
+};
+//一组loop之间两两的消息通道，loops[i]到loops[j]的消息只能在loops[i]的线程里发送，在loops[j]的线程里交给handler
+//须在各loop退出之后析构
+template <typename T>
+class LoopChannels {
+public:
+  //在接收方loop线程调用，from为发送方下标
+  typedef std::function<void(size_t from, T& message)> Handler;
+  LoopChannels(const std::vector<EventLoop*>& loops, size_t capacity, const Handler& handler)
+      : loops_(loops), rings_(), overflows_(), inboxes_(), handler_(handler) {
+    for (size_t i = 0; i < loops_.size() * loops_.size(); ++i) {
+      rings_.push_back(std::unique_ptr<SpscRing<T> >(new SpscRing<T>(capacity)));
+      overflows_.push_back(std::unique_ptr<Overflow>(new Overflow()));
+    }
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      inboxes_.push_back(std::unique_ptr<Inbox>(new Inbox(this, i)));
+    }
+  }
+  //把收件箱登记到各loop，登记任务执行之前发出的消息在登记后第一轮迭代收到
+  void Start() {
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      loops_[i]->AddTask(std::bind(&EventLoop::AddInbox, loops_[i], inboxes_[i].get()));
+    }
+  }
+  size_t Size() const { return loops_.size(); }
+  EventLoop* GetLoop(size_t index) const { return loops_[index]; }
+  //loop的下标，不在这组loop里时返回-1
+  int IndexOf(EventLoop* loop) const {
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      if (loops_[i] == loop) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+  //在loops[from]的线程调用，队列满或溢出队列里还有消息时返回false
+  bool Send(size_t from, size_t to, const T& message) {
+    if (overflows_[from * loops_.size() + to]->pending.load(std::memory_order_acquire)) {
+      return false;
+    }
+    return Push(from, to, message);
+  }
+  //在loops[from]的线程调用，队列满时放进溢出队列，不会失败
+  void Post(size_t from, size_t to, const T& message) {
+    Overflow* overflow = overflows_[from * loops_.size() + to].get();
+    if (overflow->pending.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(overflow->mutex);
+      //接收方取空溢出队列后在锁内清除标记，这里看到标记仍在，消息排在溢出队列末尾
+      if (overflow->pending.load(std::memory_order_relaxed)) {
+        overflow->messages.push_back(message);
+        loops_[to]->wakeup();
+        return;
+      }
+    }
+    if (Push(from, to, message)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(overflow->mutex);
+      overflow->messages.push_back(message);
+      overflow->pending.store(true, std::memory_order_release);
+    }
+    loops_[to]->wakeup();
+  }
+private:
+  //一对loop之间的溢出队列，pending为true期间发送方不再使用环形队列
+  struct Overflow {
+    std::mutex mutex;
+    std::deque<T> messages;
+    std::atomic<bool> pending;
+    Overflow() : mutex(), messages(), pending(false) {}
+  };
+  bool Push(size_t from, size_t to, const T& message) {
+    bool wake = false;
+    if (!rings_[from * loops_.size() + to]->Push(message, wake)) {
+      return false;
+    }
+    if (wake && from != to) {
+      loops_[to]->wakeup();
+    }
+    return true;
+  }
+  class Inbox : public LoopInbox {
+  public:
+    Inbox(LoopChannels* owner, size_t index) : owner_(owner), index_(index) {}
+    void Drain() { owner_->DrainInbox(index_); }
+  private:
+    LoopChannels* owner_;
+    size_t index_;
+  };
+  void DrainInbox(size_t to) {
+    size_t n = loops_.size();
+    for (size_t from = 0; from < n; ++from) {
+      rings_[from * n + to]->Drain([this, from](T& message) {
+        handler_(from, message);
+      });
+      DrainOverflow(from, overflows_[from * n + to].get());
+    }
+  }
+  //溢出队列里的消息都晚于环形队列里的，环形队列取空后再取；处理时不持锁，handler里可以再发消息
+  void DrainOverflow(size_t from, Overflow* overflow) {
+    if (!overflow->pending.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::deque<T> messages;
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> lock(overflow->mutex);
+        if (overflow->messages.empty()) {
+          overflow->pending.store(false, std::memory_order_release);
+          return;
+        }
+        messages.swap(overflow->messages);
+      }
+      for (auto &message : messages) {
+        handler_(from, message);
+      }
+      messages.clear();
+    }
+  }
+  std::vector<EventLoop*> loops_;
+  std::vector<std::unique_ptr<SpscRing<T> > > rings_;//rings_[from * n + to]
+  std::vector<std::unique_ptr<Overflow> > overflows_;//与rings_一一对应
+  std::vector<std::unique_ptr<Inbox> > inboxes_;
+  Handler handler_;
+};
+#endif // !_LOOPCHANNEL_H_
@@ -0,0 +1,112 @@
+#include "LoopWatchdog.h"
+#include "EventLoop.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#define STALL_SAMPLE_SIGNAL (SIGRTMIN + 4) //采调用栈用的信号
+#define STALL_SAMPLE_DEPTH 64 //调用栈最大深度
+#define STALL_SAMPLE_WAIT 100 //等待被采样线程响应的最长时间，单位ms
+//同一时刻只有看门狗线程在采样，采样结果放在全局缓冲里
+static void* samplestack[STALL_SAMPLE_DEPTH];
+static std::atomic<int> sampledepth(-1);
+LoopWatchdog* LoopWatchdog::GetInstance() {
+  //看门狗线程分离运行，实例不析构，避免退出时与仍在运行的loop线程竞争
+  static LoopWatchdog* instance = new LoopWatchdog();
+  return instance;
+}
+LoopWatchdog::LoopWatchdog() : mutex_(), cond_(), entries_(), interval_(0), running_(false) {
+  //backtrace第一次调用时会加载libgcc，在信号处理函数里调用前先预热
+  void* frame[1];
+  backtrace(frame, 1);
+  struct sigaction sa;
+  sa.sa_handler = &LoopWatchdog::SampleHandler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(STALL_SAMPLE_SIGNAL, &sa, NULL) < 0) {
+    perror("sigaction");
+  }
+}
+int64_t LoopWatchdog::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+std::string LoopWatchdog::Demangle(const char* name) {
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+  std::string result(status == 0 ? demangled : name);
+  free(demangled);
+  return result;
+}
+void LoopWatchdog::SampleHandler(int signo) {
+  sampledepth.store(backtrace(samplestack, STALL_SAMPLE_DEPTH));
+}
+void LoopWatchdog::Register(EventLoop* loop, int stallms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry entry;
+  entry.loop = loop;
+  entry.stallns = static_cast<int64_t>(stallms) * 1000000;
+  entry.reported = 0;
+  entries_.push_back(entry);
+  int64_t interval = std::max<int64_t>(entry.stallns / 2, 1000000);
+  if (interval_ == 0 || interval < interval_) {
+    interval_ = interval;
+  }
+  if (!running_) {
+    running_ = true;
+    std::thread(&LoopWatchdog::Run, this).detach();
+  }
+  cond_.notify_one();
+}
+void LoopWatchdog::Unregister(EventLoop* loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+      [loop](const Entry& entry) { return entry.loop == loop; }), entries_.end());
+}
+void LoopWatchdog::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait_for(lock, std::chrono::nanoseconds(interval_));
+    int64_t now = Now();
+    //持锁检查，loop注销时会等这里检查完，不会访问已析构的loop
+    for (auto &entry : entries_) {
+      int64_t since = entry.loop->BusySince();
+      if (since == 0 || since == entry.reported || now - since < entry.stallns) {
+        continue;
+      }
+      entry.reported = since;
+      Report(entry, now - since);
+    }
+  }
+}
+void LoopWatchdog::Report(Entry& entry, int64_t busyns) {
+  EventLoop* loop = entry.loop;
+  loop->CountStall();
+  //先记下正在执行的回调，再去采栈，采到的栈可能已经往前走了一点
+  int fd = loop->CurrentFd();
+  const char* task = loop->CurrentTask();
+  std::cerr << "EventLoop stall: thread " << loop->GetThreadId() << " busy for " << busyns / 1000000 << " ms";
+  if (fd >= 0) {
+    std::cerr << ", handling fd " << fd;
+  } else if (task != nullptr) {
+    std::cerr << ", running task " << Demangle(task);
+  }
+  std::cerr << std::endl;
+  sampledepth.store(-1);
+  if (pthread_kill(loop->ThreadHandle(), STALL_SAMPLE_SIGNAL) != 0) {
+    return;
+  }
+  for (int waited = 0; waited < STALL_SAMPLE_WAIT && sampledepth.load() < 0; ++waited) {
+    usleep(1000);
+  }
+  int depth = sampledepth.load();
+  if (depth > 2) {
+    //前两帧是信号处理函数和内核信号帧，跳过
+    backtrace_symbols_fd(samplestack + 2, depth - 2, STDERR_FILENO);
+  }
+}
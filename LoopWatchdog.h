@@ -0,0 +1,41 @@
+#ifndef _LOOPWATCHDOG_H_
+#define _LOOPWATCHDOG_H_
+//loop卡顿看门狗：一个后台线程定期检查登记的EventLoop，某个loop离开epoll_wait超过阈值仍未返回时
+//记一次卡顿，并向该loop线程发信号采一份调用栈，连同正在执行的fd或任务类型一起打印到stderr
+//采栈信号会让被采样线程里不会自动重启的系统调用（如sleep、poll）提前返回EINTR
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+class EventLoop;
+class LoopWatchdog {
+public:
+  static LoopWatchdog* GetInstance();
+  //登记loop，stallms为卡顿阈值，单位ms，第一次登记时启动看门狗线程
+  void Register(EventLoop* loop, int stallms);
+  //注销loop，返回后看门狗不会再访问它
+  void Unregister(EventLoop* loop);
+  //单调时钟，单位ns，loop和看门狗用同一个时钟
+  static int64_t Now();
+  //把typeid名字还原成可读的类型名
+  static std::string Demangle(const char* name);
+private:
+  struct Entry {
+    EventLoop* loop;
+    int64_t stallns;//卡顿阈值
+    int64_t reported;//已报告过的那次忙碌的开始时间，同一次卡顿只报告一次
+  };
+  LoopWatchdog();
+  void Run();
+  void Report(Entry& entry, int64_t busyns);
+  static void SampleHandler(int signo);
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<Entry> entries_;
+  int64_t interval_;//检查间隔，取最小阈值的一半
+  bool running_;//看门狗线程已启动，线程分离运行到进程退出
+};
+#endif // !_LOOPWATCHDOG_H_
@@ -0,0 +1,272 @@
+#include "OutputQueue.h"
+#include <stdio.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#define MAX_IOVECS 64 //一次writev最多带的段数
+#define COALESCE_LIMIT 4096 //小于该长度的数据拷贝进队尾自有段，合并成一段发送
+OutputQueue::OutputQueue()
+    : segments_(), size_(0), memory_(0), zerocopymemory_(0), zerocopythreshold_(0), zerocopyid_(0), zerocopypending_(),
+      zerocopystats_(nullptr), zerocopycopied_(false), pool_(nullptr) {
+}
+OutputQueue::~OutputQueue() {
+}
+void OutputQueue::Append(const char* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  if (zerocopythreshold_ > 0 && len >= zerocopythreshold_) {
+    //大块数据拷贝一次放进共享缓冲，发送时内核不再拷贝
+    Append(SharedBuffer(new std::string(data, len)));
+    return;
+  }
+  if (pool_ && pool_->InOwnerThread() && AppendToChunks(data, len)) {
+    return;
+  }
+  if (segments_.empty() || segments_.back().shared || segments_.back().chunk || segments_.back().owned.size() >= COALESCE_LIMIT) {
+    segments_.push_back(Segment());
+  }
+  std::string& owned = segments_.back().owned;
+  size_t memory = StringMemory(owned);
+  owned.append(data, len);
+  memory_ += StringMemory(owned) - memory;
+  size_ += len;
+}
+bool OutputQueue::AppendToChunks(const char*& data, size_t& len) {
+  while (len > 0) {
+    if (segments_.empty() || !segments_.back().chunk || segments_.back().used == segments_.back().chunk->capacity) {
+      BufferPool::ChunkPtr chunk = pool_->Allocate(len);
+      if (!chunk) {
+        return false;
+      }
+      memory_ += chunk->Size();
+      segments_.push_back(Segment());
+      segments_.back().chunk = std::move(chunk);
+    }
+    Segment& tail = segments_.back();
+    size_t n = std::min(len, static_cast<size_t>(tail.chunk->capacity) - tail.used);
+    memcpy(tail.chunk->Data() + tail.used, data, n);
+    tail.used += n;
+    size_ += n;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+void OutputQueue::Append(std::string&& data) {
+  if (zerocopythreshold_ > 0 && data.size() >= zerocopythreshold_) {
+    Append(SharedBuffer(new std::string(std::move(data))));
+  } else {
+    Append(data.data(), data.size());
+  }
+}
+void OutputQueue::Append(const SharedBuffer& buffer) {
+  if (!buffer || buffer->empty()) {
+    return;
+  }
+  Segment segment;
+  segment.shared = buffer;
+  segments_.push_back(std::move(segment));
+  size_ += buffer->size();
+  memory_ += buffer->size();
+}
+void OutputQueue::Shrink() {
+  if (segments_.empty()) {
+    std::deque<Segment>().swap(segments_);
+    return;
+  }
+  for (auto &segment : segments_) {
+    if (!segment.shared && !segment.chunk && segment.owned.capacity() > segment.owned.size()) {
+      memory_ -= StringMemory(segment.owned);
+      segment.owned.shrink_to_fit();
+      memory_ += StringMemory(segment.owned);
+    }
+  }
+}
+void OutputQueue::Clear() {
+  segments_.clear();
+  size_ = 0;
+  memory_ = 0;
+}
+void OutputQueue::Swap(OutputQueue& other) {
+  segments_.swap(other.segments_);
+  std::swap(size_, other.size_);
+  std::swap(memory_, other.memory_);
+  std::swap(zerocopymemory_, other.zerocopymemory_);
+  std::swap(zerocopythreshold_, other.zerocopythreshold_);
+  std::swap(zerocopyid_, other.zerocopyid_);
+  zerocopypending_.swap(other.zerocopypending_);
+  std::swap(zerocopystats_, other.zerocopystats_);
+  std::swap(zerocopycopied_, other.zerocopycopied_);
+  std::swap(pool_, other.pool_);
+}
+const char* OutputQueue::Peek(size_t& len) const {
+  if (segments_.empty()) {
+    len = 0;
+    return NULL;
+  }
+  const Segment& front = segments_.front();
+  len = front.Length() - front.offset;
+  return front.Data() + front.offset;
+}
+void OutputQueue::Consume(size_t n) {
+  size_ -= n;
+  while (n > 0) {
+    Segment& front = segments_.front();
+    size_t left = front.Length() - front.offset;
+    if (n < left) {
+      front.offset += n;
+      return;
+    }
+    n -= left;
+    memory_ -= front.Memory();
+    segments_.pop_front();
+  }
+}
+bool OutputQueue::ZeroCopyEligible(const Segment& segment) const {
+  return zerocopythreshold_ > 0 && segment.shared && segment.Length() - segment.offset >= zerocopythreshold_;
+}
+void OutputQueue::EnableZeroCopy(size_t threshold, ZeroCopyStats* stats) {
+  zerocopythreshold_ = threshold;
+  zerocopystats_ = stats;
+}
+ssize_t OutputQueue::WriteZeroCopy(int fd) {
+  Segment& front = segments_.front();
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(front.Data() + front.offset);
+  iov.iov_len = front.Length() - front.offset;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  for (;;) {
+    ssize_t nbyte = sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_DONTWAIT);
+    if (nbyte > 0) {
+      //内核只在发送成功时消耗一个序号，缓冲要保留到该序号的完成通知到达
+      zerocopypending_.push_back(std::make_pair(zerocopyid_++, front.shared));
+      zerocopymemory_ += front.shared->size();
+      if (zerocopystats_) {
+        ++zerocopystats_->sends;
+      }
+      return nbyte;
+    }
+    if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN) {
+      return 0;
+    } else if (errno == ENOBUFS) {
+      //超过了可锁定内存的限制，这一次退回普通发送
+      nbyte = write(fd, iov.iov_base, iov.iov_len);
+      if (nbyte < 0 && errno == EAGAIN) {
+        return 0;
+      }
+      if (nbyte < 0) {
+        perror("write error");
+      }
+      return nbyte;
+    }
+    perror("sendmsg MSG_ZEROCOPY error");
+    return -1;
+  }
+}
+ssize_t OutputQueue::WriteTo(int fd) {
+  ssize_t sendsum = 0;
+  struct iovec iov[MAX_IOVECS];
+  while (!segments_.empty()) {
+    size_t expected = 0;
+    ssize_t nbyte;
+    if (ZeroCopyEligible(segments_.front())) {
+      expected = segments_.front().Length() - segments_.front().offset;
+      nbyte = WriteZeroCopy(fd);
+      if (nbyte < 0) {
+        return -1;
+      }
+    } else {
+      int iovcnt = 0;
+      //零拷贝的段单独发送，普通段合并到它之前为止
+      for (auto it = segments_.begin(); it != segments_.end() && iovcnt < MAX_IOVECS; ++it, ++iovcnt) {
+        if (iovcnt > 0 && ZeroCopyEligible(*it)) {
+          break;
+        }
+        iov[iovcnt].iov_base = const_cast<char*>(it->Data() + it->offset);
+        iov[iovcnt].iov_len = it->Length() - it->offset;
+        expected += iov[iovcnt].iov_len;
+      }
+      nbyte = writev(fd, iov, iovcnt);
+      if (nbyte < 0) {
+        if (errno == EAGAIN) {
+          return sendsum; // 非阻塞返回，缓冲区满
+        } else if (errno == EINTR) {
+          continue; // 被信号打断，继续发送
+        }
+        perror("writev error");
+        return -1;
+      }
+    }
+    Consume(nbyte);
+    sendsum += nbyte;
+    if ((size_t)nbyte < expected) {
+      return sendsum; // 内核发送缓冲区已满，不必再试一次拿EAGAIN
+    }
+  }
+  return sendsum;
+}
+bool OutputQueue::ReapZeroCopy(int fd) {
+  bool reaped = false;
+  char control[128];
+  for (;;) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break; //EAGAIN，错误队列已读空
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      struct sock_extended_err serr;
+      memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+      if (serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      //通知给出一段连续的完成序号[lo, hi]
+      uint32_t lo = serr.ee_info;
+      uint32_t hi = serr.ee_data;
+      uint32_t count = hi - lo + 1;
+      bool copied = (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+      if (copied) {
+        zerocopycopied_ = true;
+      }
+      if (zerocopystats_) {
+        zerocopystats_->completions += count;
+        if (copied) {
+          zerocopystats_->copied += count;
+        }
+      }
+      for (auto it = zerocopypending_.begin(); it != zerocopypending_.end();) {
+        if (it->first - lo < count) {
+          zerocopymemory_ -= it->second->size();
+          it = zerocopypending_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      reaped = true;
+    }
+  }
+  return reaped;
+}
@@ -0,0 +1,97 @@
+#ifndef _OUTPUTQUEUE_H_
+#define _OUTPUTQUEUE_H_
+//连接的发送队列：由若干段组成，一次writev发出多段
+//共享段引用只读的引用计数缓冲（如广播消息），入队不拷贝；普通数据拷贝进队尾自有的段，相邻的小数据合并
+//设置了缓冲池后自有段是池里的定长块，写满再取下一块；不在池所属线程时（如迁移途中）退回堆上的string
+//开启零拷贝后，大的共享段用MSG_ZEROCOPY发送，缓冲在收到内核的完成通知前一直保留
+#include <string>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <sys/types.h>
+#include "BufferPool.h"
+class OutputQueue {
+public:
+  typedef std::shared_ptr<const std::string> SharedBuffer;
+  //零拷贝统计
+  struct ZeroCopyStats {
+    uint64_t sends;//MSG_ZEROCOPY发送次数
+    uint64_t completions;//收到完成通知的发送次数
+    uint64_t copied;//内核最终还是拷贝了数据的发送次数（如回环或网卡不支持）
+    ZeroCopyStats() : sends(0), completions(0), copied(0) {}
+  };
+  OutputQueue();
+  ~OutputQueue();
+  //拷贝数据追加到队尾
+  void Append(const char* data, size_t len);
+  void Append(const std::string& data) { Append(data.data(), data.size()); }
+  //开启零拷贝且数据够大时直接接管数据，不再拷贝
+  void Append(std::string&& data);
+  //共享缓冲追加到队尾，只增加引用计数
+  void Append(const SharedBuffer& buffer);
+  //待发送字节数
+  size_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+  //队列占用的缓冲内存：自有段按容量计，共享段和等待零拷贝完成通知的缓冲按长度计
+  //部分发出的零拷贝段在出队前会和它的完成通知各算一次
+  size_t MemoryUsage() const { return memory_ + zerocopymemory_; }
+  //释放自有段多余的容量，队列为空时连同deque的块一起释放
+  void Shrink();
+  //string在堆上占用的内存，短字符串存在对象内部时为0
+  static size_t StringMemory(const std::string& data) {
+    return data.capacity() > std::string().capacity() ? data.capacity() + 1 : 0;
+  }
+  void Clear();
+  //队首段中未发送的数据，队列为空时返回NULL；和Retrieve一起给不能直接写fd的发送方（如用户态TLS）使用
+  const char* Peek(size_t& len) const;
+  //从队首移除n个已发送的字节
+  void Retrieve(size_t n) { Consume(n); }
+  //尽量把队列写入fd，返回写出的字节数，发送缓冲区满时返回已写出的部分（可能为0），出错返回-1
+  ssize_t WriteTo(int fd);
+  //开启零拷贝：剩余长度不小于threshold的段用MSG_ZEROCOPY发送，fd须已设置SO_ZEROCOPY，stats可以为空
+  void EnableZeroCopy(size_t threshold, ZeroCopyStats* stats);
+  void DisableZeroCopy() { zerocopythreshold_ = 0; }
+  //统计改记到另一个loop，连接迁移时使用
+  void SetZeroCopyStats(ZeroCopyStats* stats) { zerocopystats_ = stats; }
+  bool ZeroCopyEnabled() const { return zerocopythreshold_ > 0; }
+  //读取fd错误队列里的零拷贝完成通知，释放对应的缓冲，读到通知返回true
+  bool ReapZeroCopy(int fd);
+  //还有零拷贝发送未收到完成通知
+  bool ZeroCopyPending() const { return !zerocopypending_.empty(); }
+  //完成通知里是否出现过内核拷贝，出现时零拷贝没有收益
+  bool ZeroCopyCopied() const { return zerocopycopied_; }
+  void Swap(OutputQueue& other);
+  //之后的自有段从pool分配，连接迁移后换成新loop的池，已有的块归还给原来的池
+  void SetBufferPool(BufferPool* pool) { pool_ = pool; }
+private:
+  struct Segment {
+    SharedBuffer shared;//共享段，为空时使用chunk或owned
+    BufferPool::ChunkPtr chunk;//池中的自有段
+    size_t used;//chunk中已写入的字节数
+    std::string owned;//堆上的自有段
+    size_t offset;//已发送的字节数
+    Segment() : shared(), chunk(), used(0), owned(), offset(0) {}
+    const char* Data() const { return shared ? shared->data() : (chunk ? chunk->Data() : owned.data()); }
+    size_t Length() const { return shared ? shared->size() : (chunk ? used : owned.size()); }
+    size_t Memory() const { return shared ? shared->size() : (chunk ? chunk->Size() : StringMemory(owned)); }
+  };
+  void Consume(size_t n);
+  //拷贝进池中的块，data和len前移到已拷贝的部分之后；返回false时池映射失败，剩下的由调用者放进string
+  bool AppendToChunks(const char*& data, size_t& len);
+  //队首段是否走零拷贝
+  bool ZeroCopyEligible(const Segment& segment) const;
+  //用MSG_ZEROCOPY发送队首段，返回写出的字节数，发送缓冲区满返回0，出错返回-1
+  ssize_t WriteZeroCopy(int fd);
+  std::deque<Segment> segments_;
+  size_t size_;
+  size_t memory_;//各段占用的内存
+  size_t zerocopymemory_;//等待完成通知的缓冲占用的内存
+  size_t zerocopythreshold_;//0为关闭零拷贝
+  uint32_t zerocopyid_;//下一次零拷贝发送的序号，与内核按socket递增的序号一致
+  std::deque<std::pair<uint32_t, SharedBuffer> > zerocopypending_;//等待完成通知的发送序号和缓冲
+  ZeroCopyStats* zerocopystats_;
+  bool zerocopycopied_;
+  BufferPool* pool_;//为空时自有段用string
+};
+#endif // !_OUTPUTQUEUE_H_
@@ -0,0 +1,48 @@
+#include "PipePool.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#define MAX_CACHED_PIPES 64 //每个IO线程最多缓存的空管道数
+#define PIPE_CAPACITY (256 * 1024) //管道容量，决定每次splice最多搬运的字节数
+PipePool* PipePool::GetLoopPool() {
+  //一个IO线程只运行一个EventLoop，线程局部即为每个loop一个
+  static thread_local PipePool pool;
+  return &pool;
+}
+PipePool::PipePool() : pipes_() {
+}
+PipePool::~PipePool() {
+  for (auto &pipe : pipes_) {
+    close(pipe.readfd);
+    close(pipe.writefd);
+  }
+}
+bool PipePool::Acquire(Pipe& pipe) {
+  if (!pipes_.empty()) {
+    pipe = pipes_.back();
+    pipes_.pop_back();
+    return true;
+  }
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+    perror("pipe2");
+    return false;
+  }
+  //扩大失败时保持默认容量即可
+  fcntl(fds[1], F_SETPIPE_SZ, PIPE_CAPACITY);
+  pipe.readfd = fds[0];
+  pipe.writefd = fds[1];
+  return true;
+}
+void PipePool::Release(Pipe& pipe, bool empty) {
+  if (pipe.readfd < 0) {
+    return;
+  }
+  if (empty && pipes_.size() < MAX_CACHED_PIPES) {
+    pipes_.push_back(pipe);
+  } else {
+    close(pipe.readfd);
+    close(pipe.writefd);
+  }
+  pipe.readfd = pipe.writefd = -1;
+}
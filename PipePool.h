@@ -0,0 +1,22 @@
+#ifndef _PIPEPOOL_H_
+#define _PIPEPOOL_H_
+//管道池：splice转发需要内核管道做中转，每个IO线程缓存一批空管道，避免每个连接都pipe2/close
+#include <vector>
+class PipePool {
+public:
+  struct Pipe {
+    int readfd;
+    int writefd;
+  };
+  //当前IO线程的管道池
+  static PipePool* GetLoopPool();
+  ~PipePool();
+  //取一个空管道，失败返回false
+  bool Acquire(Pipe& pipe);
+  //归还管道，管道中还有数据时直接关闭
+  void Release(Pipe& pipe, bool empty);
+private:
+  PipePool();
+  std::vector<Pipe> pipes_;
+};
+#endif // !_PIPEPOOL_H_
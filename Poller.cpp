@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include "Trace.h"
 #define MAXEVENTS 4096 //最大触发事件数量
 #define TIMEOUT 1000  //epoll_wait 超时时间设置
 Poller::Poller()
@@ -25,10 +26,13 @@ Poller::~Poller() {
     }
 }
 //等待I/O事件
-void Poller::poll(ChannelList &activeChannels) {
-  int timeout= TIMEOUT; // 设置超时时间
+void Poller::poll(ChannelList &activeChannels, int timeoutms) {
+  int timeout= timeoutms < 0 ? TIMEOUT : timeoutms; // 设置超时时间
+  TRACE2(poll_enter, epollfd_, timeout);
   int nfds = epoll_wait(epollfd_, &*events_.begin(),static_cast<int>(events_.capacity()), timeout);
-  if (nfds == -1) {
+  TRACE2(poll_return, epollfd_, nfds);
+  //被信号打断（如看门狗采栈）不算错误
+  if (nfds == -1 && errno != EINTR) {
     perror("epoll_wait");
   }
   //处理就绪事件
@@ -43,7 +47,7 @@ void Poller::poll(ChannelList &activeChannels) {
         iter = channels_.find(fd);// channels_ 是 Poller 维护的 fd→Channel 映射表
       }
       if(iter!=channels_.end()) {// 找到对应的 Channel
-          channel->SetEvents(events);// 将触发的事件类型存入 Channel
+          channel->SetRevents(events);// 将触发的事件类型存入 Channel
           activeChannels.push_back(channel);// 将 Channel 加入活跃列表
       } else {
           std::cerr << "Channel not found for fd: " << fd << std::endl;
@@ -53,6 +57,11 @@ void Poller::poll(ChannelList &activeChannels) {
       events_.resize(events_.capacity() * 2); // 扩展事件数组
   }
 }
+bool Poller::HasChannel(int fd, Channel *channel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<int,Channel*>::const_iterator iter = channels_.find(fd);
+    return iter != channels_.end() && iter->second == channel;
+}
 void Poller::addChannel(Channel *channel) {
     int fd=channel->GetFd();
     struct epoll_event ev;
@@ -69,6 +78,7 @@ void Poller::addChannel(Channel *channel) {
 }
 void Poller::removeChannel(Channel *channel) {
     int fd=channel->GetFd();
+    channel->TakeDeferred(); //移除后不再带着推迟的事件，重新注册时不会被当成上一轮推迟的channel
     struct epoll_event ev;
     ev.data.ptr = channel;
     ev.events = channel->GetEvents();
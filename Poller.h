@@ -19,8 +19,10 @@ public:
     std::mutex mutex_; //互斥锁，保护channels_和events_
     Poller();
     ~Poller();
-    //等待事件，epoll_wait封装
-    void poll(ChannelList &activeChannels);
+    //等待事件，epoll_wait封装；timeoutms为负时用默认超时，loop还有推迟的事件或任务时传0
+    void poll(ChannelList &activeChannels, int timeoutms = -1);
+    //fd上登记的是否仍是channel，推迟分发的channel可能在这期间被移除甚至析构
+    bool HasChannel(int fd, Channel *channel);
     void addChannel(Channel *channel);
     void removeChannel(Channel *channel);
     void updateChannel(Channel *channel);
@@ -0,0 +1,77 @@
+#include "RelayServer.h"
+#include <iostream>
+#include <functional>
+#include <unistd.h>
+#include "TcpRelay.h"
+#define UPSTREAM_CONNECT_RETRIES 1 //连接上游失败时的重试次数
+RelayServer::RelayServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const struct sockaddr_in& upstreamaddr,
+                         const ServerOptions& options)
+    : server_(loop, listenaddr, threadnum, options), upstreamaddr_(upstreamaddr) {
+    server_.SetNewConnectionCallback(std::bind(&RelayServer::HandleNewConnection, this, std::placeholders::_1));
+    server_.SetMessageCallback(std::bind(&RelayServer::HandleMessage, this, std::placeholders::_1, std::placeholders::_2));
+}
+RelayServer::~RelayServer() {
+}
+void RelayServer::Start() {
+    server_.Start();
+}
+void RelayServer::HandleNewConnection(const TcpConnectionPtr& conn) {
+    //新连接回调在accept线程执行，上游连接要建在客户端所属的IO线程上
+    conn->GetLoop()->AddTask(std::bind(&RelayServer::ConnectUpstream, this, conn));
+}
+void RelayServer::HandleMessage(const TcpConnectionPtr& conn, std::string& message) {
+}
+void RelayServer::ConnectUpstream(const TcpConnectionPtr& client) {
+    if (!client->InLoopThread()) {
+        //投递之后客户端连接迁移到了其他loop，上游连接跟着建在那里
+        client->GetLoop()->AddTask(std::bind(&RelayServer::ConnectUpstream, this, client));
+        return;
+    }
+    if (client->Disconnected()) {
+        return;
+    }
+    Connector::spConnector connector(new Connector(client->GetLoop(), upstreamaddr_));
+    std::weak_ptr<TcpConnection> wpclient(client);
+    connector->SetMaxRetries(UPSTREAM_CONNECT_RETRIES);
+    connector->SetNewConnectionCallBack(std::bind(&RelayServer::OnUpstreamConnected, this, wpclient, std::placeholders::_1));
+    connector->SetErrorCallBack(std::bind(&RelayServer::OnUpstreamFailed, this, wpclient));
+    //连接建立前由客户端连接持有Connector
+    client->SetContext(connector);
+    connector->Start();
+}
+void RelayServer::OnUpstreamConnected(const std::weak_ptr<TcpConnection>& wpclient, int sockfd) {
+    TcpConnectionPtr client = wpclient.lock();
+    if (!client || client->Disconnected()) {
+        close(sockfd);
+        return;
+    }
+    //当前还在Connector自己的回调里，延后释放
+    std::shared_ptr<void> connector = client->GetContext();
+    client->GetLoop()->AddTask([connector]() {});
+    auto upstream = std::make_shared<TcpConnection>(client->GetLoop(), sockfd, upstreamaddr_);
+    //上游连接由TcpRelay持有，随relay一起释放
+    upstream->SetConnectionCleanup([](const TcpConnectionPtr&) {});
+    upstream->AddChannelToLoop();
+    //排在注册channel的任务之后执行
+    client->GetLoop()->AddTask(std::bind(&RelayServer::StartRelay, client, upstream));
+}
+void RelayServer::OnUpstreamFailed(const std::weak_ptr<TcpConnection>& wpclient) {
+    TcpConnectionPtr client = wpclient.lock();
+    if (!client) {
+        return;
+    }
+    std::cerr << "RelayServer upstream unreachable, closing client." << std::endl;
+    std::shared_ptr<void> connector = client->GetContext();
+    client->GetLoop()->AddTask([connector]() {});
+    client->SetContext(std::shared_ptr<void>());
+    client->Shutdown();
+}
+void RelayServer::StartRelay(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream) {
+    if (client->Disconnected()) {
+        upstream->Shutdown();
+        return;
+    }
+    if (!TcpRelay::Start(client, upstream)) {
+        std::cerr << "RelayServer failed to start relay." << std::endl;
+    }
+}
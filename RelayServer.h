@@ -0,0 +1,29 @@
+#ifndef _RELAYSERVER_H_
+#define _RELAYSERVER_H_
+//转发服务：每个接入的客户端连接在同一个IO线程上连一条上游连接，再用TcpRelay双向转发
+#include <string>
+#include <netinet/in.h>
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Connector.h"
+class RelayServer {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  RelayServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const struct sockaddr_in& upstreamaddr,
+              const ServerOptions& options = ServerOptions());
+  ~RelayServer();
+  void Start();
+private:
+  void HandleNewConnection(const TcpConnectionPtr& conn);
+  //上游连上之前客户端发来的数据留在读缓冲里，开始转发时一并带走
+  void HandleMessage(const TcpConnectionPtr& conn, std::string& message);
+  //在客户端连接所属的IO线程上连接上游
+  void ConnectUpstream(const TcpConnectionPtr& client);
+  void OnUpstreamConnected(const std::weak_ptr<TcpConnection>& wpclient, int sockfd);
+  void OnUpstreamFailed(const std::weak_ptr<TcpConnection>& wpclient);
+  static void StartRelay(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream);
+  TcpServer server_;
+  struct sockaddr_in upstreamaddr_;
+};
+#endif // !_RELAYSERVER_H_
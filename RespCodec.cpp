@@ -0,0 +1,122 @@
+#include "RespCodec.h"
+#include <cstdlib>
+#include <cstring>
+#define RESP_MAX_BULK (512 * 1024 * 1024) //单个批量字符串的最大长度
+#define RESP_MAX_ARGS (1024 * 1024) //一条命令的最多参数个数
+#define RESP_MAX_INLINE (64 * 1024) //内联命令的最大长度
+int RespCodec::ParseInteger(const std::string& data, size_t& pos, int64_t& value) {
+  size_t end = data.find("\r\n", pos);
+  if (end == std::string::npos) {
+    return data.size() - pos > 32 ? RESP_ERROR : RESP_INCOMPLETE;
+  }
+  if (end == pos) {
+    return RESP_ERROR;
+  }
+  char* stop = NULL;
+  value = strtoll(data.c_str() + pos, &stop, 10);
+  if (stop != data.c_str() + end) {
+    return RESP_ERROR;
+  }
+  pos = end + 2;
+  return RESP_OK;
+}
+int RespCodec::Parse(const std::string& data, size_t& pos, std::vector<std::string>& args) {
+  args.clear();
+  if (pos >= data.size()) {
+    return RESP_INCOMPLETE;
+  }
+  size_t p = pos;
+  if (data[p] != '*') {
+    //内联命令：一行，按空格分隔
+    size_t end = data.find('\n', p);
+    if (end == std::string::npos) {
+      return data.size() - p > RESP_MAX_INLINE ? RESP_ERROR : RESP_INCOMPLETE;
+    }
+    size_t lineend = (end > p && data[end - 1] == '\r') ? end - 1 : end;
+    size_t start = p;
+    while (start < lineend) {
+      while (start < lineend && data[start] == ' ') {
+        ++start;
+      }
+      size_t stop = start;
+      while (stop < lineend && data[stop] != ' ') {
+        ++stop;
+      }
+      if (stop > start) {
+        args.push_back(data.substr(start, stop - start));
+      }
+      start = stop;
+    }
+    pos = end + 1;
+    return RESP_OK;
+  }
+  ++p;
+  int64_t count = 0;
+  int ret = ParseInteger(data, p, count);
+  if (ret != RESP_OK) {
+    return ret;
+  }
+  if (count > RESP_MAX_ARGS) {
+    return RESP_ERROR;
+  }
+  if (count > 0) {
+    args.reserve(count);
+  }
+  for (int64_t i = 0; i < count; ++i) {
+    if (p >= data.size()) {
+      return RESP_INCOMPLETE;
+    }
+    if (data[p] != '$') {
+      return RESP_ERROR;
+    }
+    ++p;
+    int64_t len = 0;
+    ret = ParseInteger(data, p, len);
+    if (ret != RESP_OK) {
+      return ret;
+    }
+    if (len < 0 || len > RESP_MAX_BULK) {
+      return RESP_ERROR;
+    }
+    if (data.size() - p < static_cast<size_t>(len) + 2) {
+      return RESP_INCOMPLETE;
+    }
+    if (data[p + len] != '\r' || data[p + len + 1] != '\n') {
+      return RESP_ERROR;
+    }
+    args.push_back(data.substr(p, len));
+    p += len + 2;
+  }
+  pos = p;
+  return RESP_OK;
+}
+void RespCodec::AppendStatus(std::string& out, const char* status) {
+  out += '+';
+  out += status;
+  out += "\r\n";
+}
+void RespCodec::AppendError(std::string& out, const std::string& message) {
+  out += "-ERR ";
+  out += message;
+  out += "\r\n";
+}
+void RespCodec::AppendInteger(std::string& out, int64_t value) {
+  out += ':';
+  out += std::to_string(value);
+  out += "\r\n";
+}
+void RespCodec::AppendBulk(std::string& out, const char* data, size_t len) {
+  out += '$';
+  out += std::to_string(len);
+  out += "\r\n";
+  out.append(data, len);
+  out += "\r\n";
+}
+void RespCodec::AppendNull(std::string& out) {
+  out += "$-1\r\n";
+}
+void RespCodec::AppendArrayHeader(std::string& out, size_t count) {
+  out += '*';
+  out += std::to_string(count);
+  out += "\r\n";
+}
@@ -0,0 +1,27 @@
+#ifndef _RESPCODEC_H_
+#define _RESPCODEC_H_
+//Redis协议（RESP2）的请求解析和回复编码
+//请求为批量字符串数组（*N\r\n$len\r\n...\r\n），也接受按空格分隔的内联命令（如redis-benchmark的PING_INLINE）
+#include <string>
+#include <vector>
+#include <cstdint>
+class RespCodec {
+public:
+  enum {
+    RESP_OK = 0,//解析出一条命令
+    RESP_INCOMPLETE,//数据不完整，等待更多数据
+    RESP_ERROR//协议错误，应回复错误并关闭连接
+  };
+  //从data的pos处解析一条命令，成功时args为命令名和参数，pos移到该命令之后；空命令解析成功但args为空
+  static int Parse(const std::string& data, size_t& pos, std::vector<std::string>& args);
+  static void AppendStatus(std::string& out, const char* status);//+OK
+  static void AppendError(std::string& out, const std::string& message);//-ERR ...
+  static void AppendInteger(std::string& out, int64_t value);//:n
+  static void AppendBulk(std::string& out, const char* data, size_t len);//$len data
+  static void AppendNull(std::string& out);//$-1
+  static void AppendArrayHeader(std::string& out, size_t count);//*n
+private:
+  //解析pos处以\r\n结尾的整数，成功时pos移到\r\n之后
+  static int ParseInteger(const std::string& data, size_t& pos, int64_t& value);
+};
+#endif // !_RESPCODEC_H_
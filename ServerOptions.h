@@ -0,0 +1,52 @@
+#ifndef _SERVEROPTIONS_H_
+#define _SERVEROPTIONS_H_
+//服务器socket调优选项，分为监听socket选项和连接socket选项
+//Linux上accept出来的连接会继承监听socket的大部分选项，inheritoptions为true时连接选项只在监听socket上设置一次
+#include <cstddef>
+struct ServerOptions {
+  //监听socket选项
+  int backlog;//listen的全连接队列长度
+  bool reuseport;//SO_REUSEPORT，允许多个进程/socket监听同一端口
+  int deferaccept;//TCP_DEFER_ACCEPT，客户端发来数据后才唤醒accept，单位s，0为关闭
+  int fastopenqueue;//TCP_FASTOPEN，TFO请求队列长度，0为关闭
+  //连接socket选项
+  bool nodelay;//TCP_NODELAY，关闭Nagle算法，避免小包回复被延迟确认拖慢
+  int sndbuf;//SO_SNDBUF，0为内核默认
+  int rcvbuf;//SO_RCVBUF，0为内核默认
+  bool keepalive;//SO_KEEPALIVE
+  int keepidle;//TCP_KEEPIDLE，单位s，0为内核默认
+  int keepintvl;//TCP_KEEPINTVL，单位s，0为内核默认
+  int keepcnt;//TCP_KEEPCNT，0为内核默认
+  int usertimeout;//TCP_USER_TIMEOUT，已发送数据未被确认的最长时间，单位ms，0为关闭
+  int notsentlowat;//TCP_NOTSENT_LOWAT，发送缓冲区中未发送数据低于该值才报告可写，单位字节，0为关闭
+  bool inheritoptions;//连接选项设置在监听socket上由连接继承，为false时每次accept后单独设置
+  //连接行为选项
+  bool autocork;//自动合并写，一轮事件处理中的多次Send在迭代末尾合并成一次写
+  size_t zerocopythreshold;//不小于该长度的发送走MSG_ZEROCOPY，0为关闭
+  //loop卡顿检测选项
+  int stallms;//IO线程离开epoll_wait超过该时间由看门狗报告并采栈，单位ms，0为关闭卡顿检测
+  int callbackbudgetus;//单个事件回调或任务的耗时预算，超出记为慢回调，单位us
+  size_t taskqueuelimit;//一次取出的任务数超过该值记为任务积压，0为不检查
+  //内存选项
+  size_t memorylimit;//所有连接缓冲占用内存的上限，超过后拒绝新连接并关闭占用最多的连接，单位字节，0为不限制
+  int idleshrinkms;//连接空闲超过该时间后释放缓冲多余的容量，单位ms，0为不释放；池中的块归还后留在池里，不还给系统
+  //IO线程弹性伸缩选项，maxloops大于0时开启，按IO线程的平均利用率在[minloops, maxloops]之间增删
+  int minloops;//最少IO线程数，不小于1
+  int maxloops;//最多IO线程数，0为不伸缩
+  int rebalancems;//按loop利用率把热点loop上的连接迁移到空闲loop的检查间隔，排空中的loop上的连接也一并迁走，单位ms，0为不迁移
+  bool hugepages;//各loop的IO缓冲池用大页映射，系统没有预留大页时退回透明大页
+  //loop调度选项，见EventLoop::EnableScheduling
+  bool scheduling;//开启后就绪事件按channel优先级分发，监听socket为高优先级，并统计事件和任务的排队时延
+  int iosliceus;//每轮迭代分发事件的时间片，用完后其余非高优先级事件推迟到下一轮，单位us，0为不限制
+  int tasksliceus;//每轮迭代执行任务的时间片，用完后其余任务推迟到下一轮，单位us，0为不限制
+  ServerOptions()
+      : backlog(1024), reuseport(false), deferaccept(0), fastopenqueue(0),
+        nodelay(true), sndbuf(0), rcvbuf(0), keepalive(false), keepidle(0), keepintvl(0), keepcnt(0),
+        usertimeout(0), notsentlowat(0), inheritoptions(true),
+        autocork(false), zerocopythreshold(0),
+        stallms(0), callbackbudgetus(1000), taskqueuelimit(0),
+        memorylimit(0), idleshrinkms(0),
+        minloops(1), maxloops(0), rebalancems(0), hugepages(false),
+        scheduling(false), iosliceus(0), tasksliceus(0) {}
+};
+#endif // !_SERVEROPTIONS_H_
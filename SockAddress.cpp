@@ -0,0 +1,131 @@
+#include "SockAddress.h"
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <stddef.h>
+#include <arpa/inet.h>
+SockAddress::SockAddress() : len_(sizeof(addr_)) {
+  memset(&addr_, 0, sizeof(addr_));
+}
+SockAddress::SockAddress(const struct sockaddr_in& addr) : len_(sizeof(addr)) {
+  memset(&addr_, 0, sizeof(addr_));
+  memcpy(&addr_, &addr, sizeof(addr));
+}
+SockAddress::SockAddress(const struct sockaddr* addr, socklen_t len) : len_(len) {
+  memset(&addr_, 0, sizeof(addr_));
+  if (len_ > sizeof(addr_)) {
+    len_ = sizeof(addr_);
+  }
+  memcpy(&addr_, addr, len_);
+}
+SockAddress SockAddress::Inet(uint16_t port, const std::string& ip) {
+  SockAddress address;
+  struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(&address.addr_);
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  if (ip.empty() || inet_pton(AF_INET, ip.c_str(), &addr->sin_addr) != 1) {
+    addr->sin_addr.s_addr = htonl(INADDR_ANY);
+  }
+  address.len_ = sizeof(struct sockaddr_in);
+  return address;
+}
+SockAddress SockAddress::Inet6(uint16_t port, const std::string& ip) {
+  SockAddress address;
+  struct sockaddr_in6* addr = reinterpret_cast<struct sockaddr_in6*>(&address.addr_);
+  addr->sin6_family = AF_INET6;
+  addr->sin6_port = htons(port);
+  if (ip.empty() || inet_pton(AF_INET6, ip.c_str(), &addr->sin6_addr) != 1) {
+    addr->sin6_addr = in6addr_any;
+  }
+  address.len_ = sizeof(struct sockaddr_in6);
+  return address;
+}
+SockAddress SockAddress::Unix(const std::string& path) {
+  SockAddress address;
+  struct sockaddr_un* addr = reinterpret_cast<struct sockaddr_un*>(&address.addr_);
+  addr->sun_family = AF_UNIX;
+  size_t len = std::min(path.size(), sizeof(addr->sun_path) - 1);
+  memcpy(addr->sun_path, path.data(), len);
+  address.len_ = offsetof(struct sockaddr_un, sun_path) + len + 1;
+  return address;
+}
+SockAddress SockAddress::Abstract(const std::string& name) {
+  SockAddress address;
+  struct sockaddr_un* addr = reinterpret_cast<struct sockaddr_un*>(&address.addr_);
+  addr->sun_family = AF_UNIX;
+  //抽象地址的长度就是名字的长度，不以'\0'结尾
+  size_t len = std::min(name.size(), sizeof(addr->sun_path) - 1);
+  memcpy(addr->sun_path + 1, name.data(), len);
+  address.len_ = offsetof(struct sockaddr_un, sun_path) + 1 + len;
+  return address;
+}
+bool SockAddress::Parse(const std::string& text, SockAddress& addr) {
+  if (text.compare(0, 5, "unix:") == 0 && text.size() > 5) {
+    addr = Unix(text.substr(5));
+    return true;
+  }
+  if (!text.empty() && text[0] == '@' && text.size() > 1) {
+    addr = Abstract(text.substr(1));
+    return true;
+  }
+  size_t colon = text.rfind(':');
+  if (colon == std::string::npos || colon + 1 == text.size()) {
+    return false;
+  }
+  int port = atoi(text.c_str() + colon + 1);
+  if (port <= 0 || port > 65535) {
+    return false;
+  }
+  std::string host = text.substr(0, colon);
+  if (host.size() >= 2 && host[0] == '[' && host[host.size() - 1] == ']') {
+    host = host.substr(1, host.size() - 2);
+    struct in6_addr in6;
+    if (!host.empty() && inet_pton(AF_INET6, host.c_str(), &in6) != 1) {
+      return false;
+    }
+    addr = Inet6(port, host);
+    return true;
+  }
+  struct in_addr in4;
+  if (!host.empty() && inet_pton(AF_INET, host.c_str(), &in4) != 1) {
+    return false;
+  }
+  addr = Inet(port, host);
+  return true;
+}
+bool SockAddress::IsAbstract() const {
+  const struct sockaddr_un* addr = reinterpret_cast<const struct sockaddr_un*>(&addr_);
+  return IsUnix() && len_ > offsetof(struct sockaddr_un, sun_path) && addr->sun_path[0] == '\0';
+}
+std::string SockAddress::GetPath() const {
+  if (!IsUnix() || len_ <= offsetof(struct sockaddr_un, sun_path)) {
+    return std::string(); //未绑定地址的Unix域socket（如accept得到的客户端）
+  }
+  const struct sockaddr_un* addr = reinterpret_cast<const struct sockaddr_un*>(&addr_);
+  size_t len = len_ - offsetof(struct sockaddr_un, sun_path);
+  if (addr->sun_path[0] == '\0') {
+    return std::string(addr->sun_path + 1, len - 1);
+  }
+  return std::string(addr->sun_path, strnlen(addr->sun_path, len));
+}
+std::string SockAddress::ToString() const {
+  char buf[INET6_ADDRSTRLEN] = {0};
+  switch (addr_.ss_family) {
+    case AF_INET: {
+      const struct sockaddr_in* addr = reinterpret_cast<const struct sockaddr_in*>(&addr_);
+      inet_ntop(AF_INET, &addr->sin_addr, buf, sizeof(buf));
+      return std::string(buf) + ":" + std::to_string(ntohs(addr->sin_port));
+    }
+    case AF_INET6: {
+      const struct sockaddr_in6* addr = reinterpret_cast<const struct sockaddr_in6*>(&addr_);
+      inet_ntop(AF_INET6, &addr->sin6_addr, buf, sizeof(buf));
+      std::string result("[");
+      result.append(buf).append("]:").append(std::to_string(ntohs(addr->sin6_port)));
+      return result;
+    }
+    case AF_UNIX:
+      return (IsAbstract() ? "@" : "unix:") + GetPath();
+    default:
+      return "unknown";
+  }
+}
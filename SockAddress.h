@@ -0,0 +1,41 @@
+#ifndef _SOCKADDRESS_H_
+#define _SOCKADDRESS_H_
+//socket地址：统一表示IPv4、IPv6、Unix域路径和Linux抽象命名空间地址
+//字符串格式：ip:port、[ipv6]:port、unix:/path/to/sock、@name（抽象命名空间）
+#include <string>
+#include <cstdint>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+class SockAddress {
+public:
+  SockAddress();
+  //兼容原来只用IPv4地址的接口
+  SockAddress(const struct sockaddr_in& addr);
+  SockAddress(const struct sockaddr* addr, socklen_t len);
+  //ip为空时监听所有地址
+  static SockAddress Inet(uint16_t port, const std::string& ip = std::string());
+  static SockAddress Inet6(uint16_t port, const std::string& ip = std::string());
+  static SockAddress Unix(const std::string& path);
+  //抽象命名空间地址不在文件系统里创建文件，进程退出后自动消失
+  static SockAddress Abstract(const std::string& name);
+  //按上面的字符串格式解析，格式不对返回false
+  static bool Parse(const std::string& text, SockAddress& addr);
+  int Family() const { return addr_.ss_family; }
+  bool IsUnix() const { return addr_.ss_family == AF_UNIX; }
+  //抽象命名空间地址sun_path以'\0'开头
+  bool IsAbstract() const;
+  const struct sockaddr* GetSockAddr() const { return reinterpret_cast<const struct sockaddr*>(&addr_); }
+  struct sockaddr* GetSockAddr() { return reinterpret_cast<struct sockaddr*>(&addr_); }
+  socklen_t Length() const { return len_; }
+  void SetLength(socklen_t len) { len_ = len; }
+  //IPv4地址，Family()为AF_INET时有效
+  const struct sockaddr_in& GetInet() const { return *reinterpret_cast<const struct sockaddr_in*>(&addr_); }
+  //Unix域地址的路径，抽象命名空间地址不含开头的'\0'
+  std::string GetPath() const;
+  std::string ToString() const;
+private:
+  struct sockaddr_storage addr_;
+  socklen_t len_;
+};
+#endif // !_SOCKADDRESS_H_
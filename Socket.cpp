@@ -8,8 +8,10 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <cstring>
-Socket::Socket() {
-    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+Socket::Socket(int type, int family) : family_(family) {
+    fd_ = socket(family, type | SOCK_CLOEXEC, 0);
     if (fd_ ==-1) {
         perror("socket error");
         exit(EXIT_FAILURE);
@@ -17,16 +19,92 @@ Socket::Socket() {
     std::cout << "Socket created with fd: " << fd_ << std::endl;
 }
 Socket::~Socket() {
-    close(fd_);
+    if (fd_ >= 0) {
+        close(fd_);
+    }
     std::cout << "Socket with fd: " << fd_ << " destroyed." << std::endl;
 }
-void Socket::setSocketOption() {
-    ;
+void Socket::Attach(int fd) {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = fd;
+    int family = 0;
+    socklen_t len = sizeof(family);
+    if (getsockopt(fd_, SOL_SOCKET, SO_DOMAIN, &family, &len) == 0) {
+        family_ = family;
+    }
+    std::cout << "Socket attached to inherited fd: " << fd_ << std::endl;
+}
+static void SetIntOption(int fd, int level, int name, int value, const char* desc) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+        perror(desc);
+    }
+}
+void Socket::setSocketOption(const ServerOptions& options) {
+    if (options.reuseport) {
+        SetReusePort();
+    }
+    if (family_ == AF_UNIX) {
+        //Unix域socket不走TCP协议栈，只有收发缓冲区选项有意义
+        if (options.inheritoptions) {
+            SetConnectionOption(fd_, options, family_);
+        }
+        return;
+    }
+    if (options.deferaccept > 0) {
+        SetIntOption(fd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, options.deferaccept, "setsockopt TCP_DEFER_ACCEPT");
+    }
+    if (options.fastopenqueue > 0) {
+        SetIntOption(fd_, IPPROTO_TCP, TCP_FASTOPEN, options.fastopenqueue, "setsockopt TCP_FASTOPEN");
+    }
+    //缓冲区大小要在listen之前设置，握手时才能协商出合适的窗口扩大因子
+    if (options.inheritoptions) {
+        SetConnectionOption(fd_, options, family_);
+    }
+}
+void Socket::SetConnectionOption(int fd, const ServerOptions& options, int family) {
+    if (options.sndbuf > 0) {
+        SetIntOption(fd, SOL_SOCKET, SO_SNDBUF, options.sndbuf, "setsockopt SO_SNDBUF");
+    }
+    if (options.rcvbuf > 0) {
+        SetIntOption(fd, SOL_SOCKET, SO_RCVBUF, options.rcvbuf, "setsockopt SO_RCVBUF");
+    }
+    if (family == AF_UNIX) {
+        return;
+    }
+    if (options.nodelay) {
+        SetIntOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "setsockopt TCP_NODELAY");
+    }
+    if (options.keepalive) {
+        SetIntOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "setsockopt SO_KEEPALIVE");
+        if (options.keepidle > 0) {
+            SetIntOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options.keepidle, "setsockopt TCP_KEEPIDLE");
+        }
+        if (options.keepintvl > 0) {
+            SetIntOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, options.keepintvl, "setsockopt TCP_KEEPINTVL");
+        }
+        if (options.keepcnt > 0) {
+            SetIntOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options.keepcnt, "setsockopt TCP_KEEPCNT");
+        }
+    }
+    if (options.usertimeout > 0) {
+        SetIntOption(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, options.usertimeout, "setsockopt TCP_USER_TIMEOUT");
+    }
+    if (options.notsentlowat > 0) {
+        SetIntOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.notsentlowat, "setsockopt TCP_NOTSENT_LOWAT");
+    }
 }
 void Socket::SetReuseAddr() {
     int on=1;
     setsockopt(fd_,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
 }
+void Socket::SetReusePort() {
+    int on=1;
+    if (setsockopt(fd_,SOL_SOCKET,SO_REUSEPORT,&on,sizeof(on)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+    }
+}
 void Socket::Setnonblocking() {
     int flags = fcntl(fd_, F_GETFL);
     if (flags <0) {
@@ -53,8 +131,25 @@ bool Socket::BindAddress(int serverport) {
     std::cout << "Socket bound to port: " << serverport << std::endl;
     return true;
 }
-bool Socket::Listen() {
-    if (listen(fd_, 5) <0) {
+bool Socket::Bind(const SockAddress& addr) {
+    if (addr.IsUnix() && !addr.IsAbstract()) {
+        //上次运行留下的socket文件会让bind失败，只删除socket类型的文件
+        struct stat st;
+        std::string path = addr.GetPath();
+        if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(path.c_str());
+        }
+    }
+    if (bind(fd_, addr.GetSockAddr(), addr.Length()) == -1) {
+      close(fd_);
+      perror("bind error");
+      exit(-1);
+    }
+    std::cout << "Socket bound to " << addr.ToString() << std::endl;
+    return true;
+}
+bool Socket::Listen(int backlog) {
+    if (listen(fd_, backlog) <0) {
         perror("listen error");
         close(fd_);
         exit(EXIT_FAILURE);
@@ -62,9 +157,11 @@ bool Socket::Listen() {
     std::cout << "Socket is now listening." << std::endl;
     return true;
 }
-int Socket::Accept(struct sockaddr_in& peeraddr) {
-    socklen_t addrlen = sizeof(peeraddr);
-    int connfd = accept(fd_, (struct sockaddr*)&peeraddr, &addrlen);
+int Socket::Accept(SockAddress& peeraddr) {
+    socklen_t addrlen = sizeof(struct sockaddr_storage);
+    //直接拿到非阻塞的连接，省去每次accept后的两次fcntl
+    int connfd = accept4(fd_, peeraddr.GetSockAddr(), &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    peeraddr.SetLength(addrlen);
     if (connfd < 0) {
       if(errno==EAGAIN)
         return 0;
@@ -75,6 +172,7 @@ int Socket::Accept(struct sockaddr_in& peeraddr) {
 }
 bool Socket::Close() {
     close(fd_);
+    fd_ = -1; //析构时不再重复关闭
     std::cout << "Socket closed." << std::endl;
     return true;
 }
\ No newline at end of file
@@ -4,21 +4,29 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include "ServerOptions.h"
+#include "SockAddress.h"
 class Socket {
 public:
-  Socket();
+  explicit Socket(int type = SOCK_STREAM, int family = AF_INET);//type为SOCK_STREAM或SOCK_DGRAM，family为AF_INET、AF_INET6或AF_UNIX
   ~Socket();
 
   int fd()const{return fd_;}
-  void setSocketOption();//socket设置
+  int Family()const{return family_;}
+  void Attach(int fd);//接管已有的socket描述符（热升级时从旧进程继承）
+  void setSocketOption(const ServerOptions& options);//监听socket设置，须在Listen之前调用
+  static void SetConnectionOption(int fd, const ServerOptions& options, int family = AF_INET);//连接socket设置，Unix域socket跳过TCP选项
   void SetReuseAddr();//设置地址复用
+  void SetReusePort();//设置端口复用，多个socket绑定同一端口由内核分流
   void Setnonblocking();//设置非阻塞
   bool BindAddress(int serverport);//绑定地址
-  bool Listen();//监听端口
-  int Accept(struct sockaddr_in& peeraddr);//接受连接
+  bool Bind(const SockAddress& addr);//绑定任意类型的地址，Unix域路径上残留的旧socket文件会先删除
+  bool Listen(int backlog = SOMAXCONN);//监听端口
+  int Accept(SockAddress& peeraddr);//接受连接
   bool Close();//关闭socket
 private:
     int fd_;//服务器socket文件描述符
+    int family_;//地址族
 };
 
 #endif // !_SOCKET_H_
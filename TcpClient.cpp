@@ -0,0 +1,57 @@
+#include "TcpClient.h"
+#include <iostream>
+#include <arpa/inet.h>
+TcpClient::TcpClient(EventLoop* loop, const struct sockaddr_in& serveraddr)
+    : loop_(loop), connector_(new Connector(loop, serveraddr)), connection_(),
+      retry_(false), connect_(false) {
+  connector_->SetNewConnectionCallBack(std::bind(&TcpClient::OnNewConnection, this, std::placeholders::_1));
+  connector_->SetErrorCallBack(std::bind(&TcpClient::OnConnectFailed, this));
+}
+TcpClient::~TcpClient() {
+  connector_->Stop();
+  if (connection_) {
+    //连接可能比TcpClient活得久，清理回调不能再引用this
+    connection_->SetConnectionCleanup([](const TcpConnectionPtr&) {});
+    connection_->Shutdown();
+  }
+}
+void TcpClient::Connect() {
+  const struct sockaddr_in& addr = connector_->GetServerAddr();
+  std::cout << "TcpClient connecting to " << inet_ntoa(addr.sin_addr) << ":" << ntohs(addr.sin_port) << std::endl;
+  connect_ = true;
+  connector_->Start();
+}
+void TcpClient::Disconnect() {
+  connect_ = false;
+  connector_->Stop();
+  if (connection_) {
+    connection_->Shutdown();
+  }
+}
+void TcpClient::OnNewConnection(int sockfd) {
+  auto conn = std::make_shared<TcpConnection>(loop_, sockfd, connector_->GetServerAddr());
+  conn->SetMessageCallBack(TcpConnection::MessageCallBack(messagecallback_));
+  conn->SetSendCompleteCallBack(TcpConnection::CallBack(sendcompletecallback_));
+  conn->SetCloseCallBack(TcpConnection::CallBack(closecallback_));
+  conn->SetErrorCallBack(TcpConnection::CallBack(errorcallback_));
+  conn->SetConnectionCleanup(std::bind(&TcpClient::RemoveConnection, this, std::placeholders::_1));
+  connection_ = conn;
+  if (newconnectioncallback_) {
+    newconnectioncallback_(conn);
+  }
+  conn->AddChannelToLoop();
+}
+void TcpClient::OnConnectFailed() {
+  if (connectfailedcallback_) {
+    connectfailedcallback_();
+  }
+}
+void TcpClient::RemoveConnection(const TcpConnectionPtr& conn) {
+  if (connection_ == conn) {
+    connection_.reset();
+  }
+  if (retry_ && connect_) {
+    std::cout << "TcpClient reconnecting." << std::endl;
+    connector_->Restart();
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef _TCPCLIENT_H_
+#define _TCPCLIENT_H_
+//TCP客户端：通过Connector在指定loop上建立连接，连接建立后与服务端连接一样由TcpConnection处理
+#include <functional>
+#include <string>
+#include <memory>
+#include <netinet/in.h>
+#include "EventLoop.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+class TcpClient {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  typedef std::function<void(const TcpConnectionPtr&)> ConnectionCallback;
+  typedef std::function<void(const TcpConnectionPtr&,std::string&)> MessageCallback;
+  TcpClient(EventLoop* loop, const struct sockaddr_in& serveraddr);
+  //须在loop线程析构
+  ~TcpClient();
+  //开始连接
+  void Connect();
+  //断开当前连接，不再重连
+  void Disconnect();
+  //连接断开后是否自动重连
+  void EnableRetry(bool retry) { retry_ = retry; }
+  //连接失败的最大重试次数，-1为无限重试
+  void SetMaxRetries(int maxretries) { connector_->SetMaxRetries(maxretries); }
+  //单次connect的超时，见Connector::SetConnectTimeout
+  void SetConnectTimeout(int timeoutms) { connector_->SetConnectTimeout(timeoutms); }
+  EventLoop* GetLoop() const { return loop_; }
+  //当前连接，未连接时为空，须在loop线程调用
+  TcpConnectionPtr GetConnection() const { return connection_; }
+  //设置连接建立回调函数
+  void SetNewConnectionCallback(ConnectionCallback cb){
+    newconnectioncallback_=cb;
+  }
+  //设置消息处理回调函数
+  void SetMessageCallback(MessageCallback cb){
+    messagecallback_=cb;
+  }
+  //设置发送完成回调函数
+  void SetSendCompleteCallback(ConnectionCallback cb){
+    sendcompletecallback_=cb;
+  }
+  //设置连接关闭回调函数
+  void SetCloseCallback(ConnectionCallback cb){
+    closecallback_=cb;
+  }
+  //设置连接异常回调函数
+  void SetErrorCallback(ConnectionCallback cb){
+    errorcallback_=cb;
+  }
+  //设置重试次数用完仍未连上的回调函数
+  void SetConnectFailedCallback(Connector::ErrorCallBack cb){
+    connectfailedcallback_=cb;
+  }
+private:
+  void OnNewConnection(int sockfd);//Connector连接成功
+  void OnConnectFailed();//Connector放弃重试
+  void RemoveConnection(const TcpConnectionPtr& conn);//连接清理
+  EventLoop* loop_;
+  Connector::spConnector connector_;
+  TcpConnectionPtr connection_;
+  bool retry_;//断开后是否重连
+  bool connect_;//Disconnect后为false
+  ConnectionCallback newconnectioncallback_;
+  MessageCallback messagecallback_;
+  ConnectionCallback sendcompletecallback_;
+  ConnectionCallback closecallback_;
+  ConnectionCallback errorcallback_;
+  Connector::ErrorCallBack connectfailedcallback_;
+};
+#endif // !_TCPCLIENT_H_
@@ -5,144 +5,594 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include "Timer.h"
+#include "TimerManager.h"
+#include "Trace.h"
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
 #define BUFSIZE 4096
+#define ZEROCOPY_LINGER_INTERVAL 100 //连接关闭后检查零拷贝完成通知的间隔，ms
+#define ZEROCOPY_LINGER_ROUNDS 100 //最多检查的次数，超过后不再等待
 int recvn(int fd,std::string &bufferin);
-int sendn(int fd, std::string &bufferout);
-TcpConnection::TcpConnection(EventLoop* loop, int sockfd, const struct sockaddr_in& peeraddr)
+//连接析构时还有零拷贝发送没收到完成通知，内核仍引用着这些缓冲
+//保留socket和缓冲，定时读取错误队列，通知到齐后再关闭socket、释放缓冲
+struct ZeroCopyLinger {
+  EventLoop* loop;
+  int fd;
+  OutputQueue queue;
+  Timer timer;
+  int rounds;
+  ZeroCopyLinger(EventLoop* l, int f) : loop(l), fd(f), queue(), timer(0, Timer::TIMER_ONCE, Timer::CallBack_()), rounds(0) {}
+  ~ZeroCopyLinger() {
+    timer.Stop();
+    close(fd);
+  }
+};
+static void CheckZeroCopyLinger(const std::weak_ptr<ZeroCopyLinger>& wplinger);
+static void OnZeroCopyLingerTimer(EventLoop* loop, const std::weak_ptr<ZeroCopyLinger>& wplinger) {
+  //定时器线程里不持有linger，否则可能在持有时间轮锁时析构
+  loop->AddTask(std::bind(&CheckZeroCopyLinger, wplinger));
+}
+static void ArmZeroCopyLinger(const std::shared_ptr<ZeroCopyLinger>& linger) {
+  std::weak_ptr<ZeroCopyLinger> wplinger(linger);
+  linger->timer.Adjust(ZEROCOPY_LINGER_INTERVAL, Timer::TIMER_ONCE, std::bind(&OnZeroCopyLingerTimer, linger->loop, wplinger));
+}
+static void CheckZeroCopyLinger(const std::weak_ptr<ZeroCopyLinger>& wplinger) {
+  std::shared_ptr<ZeroCopyLinger> linger = wplinger.lock();
+  if (!linger) {
+    return;
+  }
+  linger->queue.ReapZeroCopy(linger->fd);
+  if (!linger->queue.ZeroCopyPending() || ++linger->rounds >= ZEROCOPY_LINGER_ROUNDS) {
+    linger->loop->RemoveZeroCopyLinger(linger);
+    return;
+  }
+  ArmZeroCopyLinger(linger);
+}
+//在linger所属loop的线程登记并开始定时检查，由该loop持有直到通知到齐
+static void StartZeroCopyLinger(const std::shared_ptr<ZeroCopyLinger>& linger) {
+  linger->loop->AddZeroCopyLinger(linger);
+  ArmZeroCopyLinger(linger);
+}
+TcpConnection::TcpConnection(EventLoop* loop, int sockfd, const SockAddress& peeraddr)
     : loop_(loop), sockfd_(sockfd), peeraddr_(peeraddr), channel_(new Channel()),
-      halfclose_(false), disconnected_(false), asyncprocessing_(false) ,readbuffer_(), writebuffer_() {
+      halfclose_(false), disconnected_(false), detached_(false), detachable_(true), migrating_(false), asyncprocessing_(false), autocork_(false), corked_(false),
+      active_(true), memory_(0), traffic_(0), readbuffer_(), outputqueue_(), handlers_(nullptr),
+      compress_(), compressin_(), compresspending_(), compressbusy_(false), capture_(nullptr), captureid_(0) {
   channel_->SetFd(sockfd_);
   channel_->SetEvents(EPOLLIN |EPOLLET);
-  channel_->setReadHandler(std::bind(&TcpConnection::HandleRead, this));
-  channel_->setWriteHandler(std::bind(&TcpConnection::HandleWrite, this));
-  channel_->setErrorHandler(std::bind(&TcpConnection::HandleError, this));
-  channel_->setCloseHandler(std::bind(&TcpConnection::HandleClose, this));
+  channel_->SetEventHandler(&TcpConnection::DispatchEvent, this);
+  outputqueue_.SetBufferPool(loop->GetBufferPool());
+}
+void TcpConnection::DispatchEvent(void* owner, uint32_t revents) {
+  TcpConnection* conn = static_cast<TcpConnection*>(owner);
+  //读事件，对端有数据或者正常关闭
+  if (revents & (EPOLLIN | EPOLLPRI)) {
+    conn->HandleRead();
+  }
+  if (revents & EPOLLOUT) {
+    conn->HandleWrite();
+  }
+  if (revents & EPOLLERR) {
+    conn->HandleError();
+  }
+  //对方异常关闭事件，或者半关闭事件
+  if (revents & EPOLLHUP) {
+    conn->HandleClose();
+  }
 }
 TcpConnection::~TcpConnection() {
-  loop_->RemoveChannelFromPoller(channel_.get());
+  if (capture_) {
+    capture_->Record(captureid_, TrafficCapture::CAPTURE_CLOSE, NULL, 0);
+  }
+  GetLoop()->AddBufferMemory(-static_cast<int64_t>(memory_));
+  if (!detached_ && !migrating_) {
+    GetLoop()->RemoveChannelFromPoller(channel_.get());
+  }
+  if (sockfd_ >= 0 && !detached_ && outputqueue_.ZeroCopyPending()) {
+    outputqueue_.ReapZeroCopy(sockfd_);
+  }
+  if (sockfd_ >= 0 && !detached_ && outputqueue_.ZeroCopyPending()) {
+    //socket交给linger关闭
+    std::shared_ptr<ZeroCopyLinger> linger(new ZeroCopyLinger(GetLoop(), sockfd_));
+    linger->queue.Swap(outputqueue_);
+    //连接可能在其他线程析构（迁移、广播的快照、服务器退出），交给所属loop登记，错误队列在那里读取
+    if (GetLoop()->GetThreadId() == std::this_thread::get_id()) {
+      StartZeroCopyLinger(linger);
+    } else {
+      GetLoop()->AddTask(std::bind(&StartZeroCopyLinger, linger));
+    }
+    sockfd_ = -1;
+  }
   if (sockfd_ >= 0) {
     close(sockfd_); // 关闭socket
   }
 }
 void TcpConnection::AddChannelToLoop() {
-  loop_->AddTask(std::bind(&EventLoop::AddChannelToPoller, loop_, channel_.get()));
+  GetLoop()->AddTask(std::bind(&EventLoop::AddChannelToPoller, GetLoop(), channel_.get()));
 }
 void TcpConnection::Send(const std::string& message) {
-  writebuffer_ += message;
-  if (loop_->GetThreadId() == std::this_thread::get_id()) {
+  if (GetLoop()->GetThreadId() == std::this_thread::get_id()) {
+    CaptureOutput(message.data(), message.size());
+    if (compress_) {
+      CompressOutput(message.data(), message.size());
+    } else {
+      outputqueue_.Append(message);
+    }
+    SendInLoop();
+  } else {
+    asyncprocessing_ = false; // 设置异步处理标志
+    //发送队列只在IO线程里访问，数据拷贝一份带过去
+    SharedBuffer buffer(new std::string(message));
+    GetLoop()->AddTask(std::bind(&TcpConnection::SendBufferInLoop, shared_from_this(), buffer));//跨线程调用,加入IO线程的任务队列，唤醒
+  }
+}
+void TcpConnection::Send(const SharedBuffer& buffer) {
+  if (GetLoop()->GetThreadId() == std::this_thread::get_id()) {
+    SendBufferInLoop(buffer);
+  } else {
+    asyncprocessing_ = false; // 设置异步处理标志
+    GetLoop()->AddTask(std::bind(&TcpConnection::SendBufferInLoop, shared_from_this(), buffer));
+  }
+}
+void TcpConnection::Send(std::string&& message) {
+  if (GetLoop()->GetThreadId() == std::this_thread::get_id()) {
+    CaptureOutput(message.data(), message.size());
+    if (compress_) {
+      CompressOutput(message.data(), message.size());
+    } else {
+      outputqueue_.Append(std::move(message));
+    }
     SendInLoop();
   } else {
     asyncprocessing_ = false; // 设置异步处理标志
-    loop_->AddTask(std::bind(&TcpConnection::SendInLoop, shared_from_this()));//跨线程调用,加入IO线程的任务队列，唤醒
+    SharedBuffer buffer(new std::string(std::move(message)));
+    GetLoop()->AddTask(std::bind(&TcpConnection::SendBufferInLoop, shared_from_this(), buffer));
+  }
+}
+bool TcpConnection::EnableZeroCopy(size_t threshold) {
+  int on = 1;
+  if (setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+    perror("setsockopt SO_ZEROCOPY");
+    return false;
   }
+  TimerManager::GetInstance()->Start(); //关闭时可能要等待完成通知
+  outputqueue_.EnableZeroCopy(threshold, &GetLoop()->GetStats().zerocopy);
+  return true;
+}
+void TcpConnection::SendBufferInLoop(const SharedBuffer& buffer) {
+  if (!InLoopThread()) {
+    //投递之后连接迁移到了其他loop，转投过去
+    GetLoop()->AddTask(std::bind(&TcpConnection::SendBufferInLoop, shared_from_this(), buffer));
+    return;
+  }
+  if (disconnected_) {
+    return; // 已经断开连接
+  }
+  if (buffer) {
+    CaptureOutput(buffer->data(), buffer->size());
+  }
+  if (compress_ && buffer) {
+    CompressOutput(buffer->data(), buffer->size()); //压缩流有状态，共享缓冲也要按连接各压一份
+  } else {
+    outputqueue_.Append(buffer);
+  }
+  SendInLoop();
+}
+bool TcpConnection::EnableCompression(CompressContext* context) {
+  compress_.reset(new CompressStream(context));
+  if (!compress_->Init()) {
+    compress_.reset();
+    return false;
+  }
+  return true;
+}
+void TcpConnection::CompressOutput(const char* data, size_t len) {
+  CompressContext* context = compress_->GetContext();
+  //没有压缩线程，或者不需要压缩且前面没有排队的数据时直接在IO线程分帧
+  if (!context->HasWorkers() || (!compressbusy_ && len < context->Threshold())) {
+    std::string framed;
+    if (!compress_->Compress(data, len, framed)) {
+      HandleError();
+      return;
+    }
+    outputqueue_.Append(std::move(framed));
+    return;
+  }
+  compresspending_.append(data, len);
+  if (!compressbusy_) {
+    SubmitCompression();
+  }
+  UpdateMemory(); //发送队列可能还是空的，SendInLoop不会更新
+}
+void TcpConnection::SubmitCompression() {
+  compressbusy_ = true;
+  std::string plain;
+  plain.swap(compresspending_);
+  CompressContext* context = compress_->GetContext();
+  ++context->GetStats().offloaded;
+  context->NextWorker()->AddTask(std::bind(&TcpConnection::CompressInWorker, shared_from_this(), std::move(plain)));
+}
+void TcpConnection::CompressInWorker(const std::string& plain) {
+  std::string framed;
+  bool ok = compress_->Compress(plain.data(), plain.size(), framed);
+  //压缩中的连接不迁移，所属loop不会变
+  GetLoop()->AddTask(std::bind(&TcpConnection::CompressDone, shared_from_this(), std::move(framed), ok));
+}
+void TcpConnection::CompressDone(std::string& framed, bool ok) {
+  compressbusy_ = false;
+  if (disconnected_) {
+    return;
+  }
+  if (!ok) {
+    HandleError();
+    return;
+  }
+  outputqueue_.Append(std::move(framed));
+  if (!compresspending_.empty()) {
+    SubmitCompression();
+  }
+  SendInLoop();
+}
+bool TcpConnection::DecompressInput(size_t offset) {
+  compressin_.append(readbuffer_, offset, std::string::npos);
+  readbuffer_.resize(offset);
+  return compress_->Decompress(compressin_, readbuffer_);
 }
 void TcpConnection::SendInLoop() {
-  if (writebuffer_.empty()) {
+  if (outputqueue_.Empty()) {
     return; // 没有数据需要发送
   }
-  int n = sendn(sockfd_, writebuffer_);
+  active_ = true;
+  if (migrating_) {
+    UpdateMemory();
+    return; // 迁移中channel还没注册到新loop，数据先排队，迁移完成后发送
+  }
+  if (autocork_ && GetLoop()->Dispatching()) {
+    ++GetLoop()->GetStats().corkedsends;
+    if (!corked_) {
+      corked_ = true;
+      GetLoop()->AddDirtyConnection(shared_from_this());
+    }
+  } else {
+    WriteOutputQueue();
+  }
+  UpdateMemory();
+}
+void TcpConnection::UpdateMemory() {
+  //压缩连接排队等压缩的明文和收到的半个帧也计入，受内存上限约束
+  size_t memory = OutputQueue::StringMemory(readbuffer_) + outputqueue_.MemoryUsage() +
+                  OutputQueue::StringMemory(compressin_) + OutputQueue::StringMemory(compresspending_);
+  if (memory != memory_) {
+    GetLoop()->AddBufferMemory(static_cast<int64_t>(memory) - static_cast<int64_t>(memory_));
+    memory_ = memory;
+  }
+}
+void TcpConnection::ShrinkBuffers() {
+  if (readbuffer_.empty()) {
+    std::string().swap(readbuffer_);
+  } else {
+    readbuffer_.shrink_to_fit();
+  }
+  outputqueue_.Shrink();
+  if (compressin_.empty()) {
+    std::string().swap(compressin_);
+  }
+  if (compresspending_.empty()) {
+    std::string().swap(compresspending_);
+  }
+  UpdateMemory();
+}
+void TcpConnection::FlushCorked() {
+  corked_ = false;
+  if (outputqueue_.Empty()) {
+    return;
+  }
+  ++GetLoop()->GetStats().corkflushes;
+  WriteOutputQueue();
+  UpdateMemory();
+}
+void TcpConnection::WriteOutputQueue() {
+  if (channel_->GetEvents() & EPOLLOUT) {
+    return; // 发送缓冲区满，等可写事件
+  }
+  if (tls_ && !tls_->Established()) {
+    return; // 握手完成后再发
+  }
+  HandleWriteResult(WriteSocket());
+}
+ssize_t TcpConnection::WriteSocket() {
+  if (tls_ && !tls_->KernelSend()) {
+    return tls_->Write(outputqueue_);
+  }
+  return outputqueue_.WriteTo(sockfd_);
+}
+bool TcpConnection::EnableTls(TlsContext* context) {
+  if (!TlsContext::Available() || !context || !context->Get()) {
+    return false;
+  }
+  tls_.reset(new TlsStream(context, sockfd_));
+  outputqueue_.DisableZeroCopy(); //内核TLS不接受MSG_ZEROCOPY，用户态TLS也用不上
+  return true;
+}
+void TcpConnection::HandleHandshake() {
+  int ret = tls_->Handshake();
+  if (ret == TlsStream::TLS_FAILED) {
+    HandleError();
+    return;
+  }
+  EnableWriting(ret == TlsStream::TLS_WANT_WRITE);
+  if (ret == TlsStream::TLS_DONE) {
+    //握手时可能已经收到了客户端的第一批数据，边缘触发不会再通知
+    HandleTlsRead();
+    SendInLoop();
+  }
+}
+void TcpConnection::HandleTlsRead() {
+  bool eof = false;
+  size_t before = readbuffer_.size();
+  ssize_t n = tls_->Read(readbuffer_, eof);
+  TRACE2(conn_recv, sockfd_, n);
   if (n < 0) {
-    perror("send error");
     HandleError();
-  } else if(n>0){
-    uint32_t events = channel_->GetEvents();
-    if (writebuffer_.size()>0)
-    {
-      //缓冲区满了，数据没发完，就设置EPOLLOUT事件触发	
+    return;
+  }
+  if (n > 0) {
+    traffic_ += n;
+    if (compress_ && !DecompressInput(before)) {
+      HandleError();
+      return;
+    }
+    //开启压缩时可能只收到半个帧，还没有新的明文
+    if (readbuffer_.size() > before) {
+      if (capture_) {
+        capture_->Record(captureid_, TrafficCapture::CAPTURE_IN, readbuffer_.data() + before, readbuffer_.size() - before);
+      }
+      CallMessage(); // 调用消息回调
+    }
+  }
+  if (eof) {
+    HandleClose(); // 对端关闭连接
+  }
+  UpdateMemory();
+}
+void TcpConnection::HandleWriteResult(ssize_t n) {
+  TRACE2(conn_send, sockfd_, n);
+  if (n < 0) {
+    HandleError();
+    return;
+  }
+  traffic_ += n;
+  //n为0说明发送缓冲区已满，一个字节都没写出去，和写了一部分一样等待EPOLLOUT
+  uint32_t events = channel_->GetEvents();
+  if (!outputqueue_.Empty()) {
+    //缓冲区满了，数据没发完，就设置EPOLLOUT事件触发
+    if (!(events & EPOLLOUT)) {
       channel_->SetEvents(events | EPOLLOUT); // 设置可写事件
-      loop_->UpdateChannelInPoller(channel_.get());
+      GetLoop()->UpdateChannelInPoller(channel_.get());
     }
-    else
-    {
-      //缓冲区空了，数据发完了，就设置EPOLLIN事件触发
+  } else {
+    //缓冲区空了，数据发完了，就设置EPOLLIN事件触发
+    if (events & EPOLLOUT) {
       channel_->SetEvents(events & (~EPOLLOUT)); // 清除可写事件
-      sendcompletecallback_(shared_from_this()); // 发送完成回调
-      if(halfclose_){
-        HandleClose(); // 半关闭状态，处理连接关闭
-      }
+      GetLoop()->UpdateChannelInPoller(channel_.get());
+    }
+    Notify(&HandlerTable::sendcomplete, sendcompletecallback_); // 发送完成回调
+    if (halfclose_) {
+      HandleClose(); // 半关闭状态，处理连接关闭
     }
-  }else{
-    HandleClose(); // 连接关闭
   }
 }
 void TcpConnection::Shutdown() {
-  if (loop_->GetThreadId() == std::this_thread::get_id()) {
+  if (GetLoop()->GetThreadId() == std::this_thread::get_id()) {
     ShutdownInLoop();
   } else {
     //不是IO线程，则是跨线程调用,加入IO线程的任务队列，唤醒
     
-    loop_->AddTask(std::bind(&TcpConnection::ShutdownInLoop, shared_from_this()));
+    GetLoop()->AddTask(std::bind(&TcpConnection::ShutdownInLoop, shared_from_this()));
   }
 }
 void TcpConnection::ShutdownInLoop() {
+  if (!InLoopThread() || migrating_) {
+    //投递之后连接迁移到了其他loop，或者迁移还没完成，排到新loop的迁移任务之后再关闭
+    GetLoop()->AddTask(std::bind(&TcpConnection::ShutdownInLoop, shared_from_this()));
+    return;
+  }
   if (disconnected_) {
     return; // 已经断开连接
   }
   std::cout << "TcpConnection::ShutdownInLoop" << std::endl;
-  closecallback_(shared_from_this()); //应用层清理连接回调
-  loop_->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
+  if (tls_) {
+    tls_->Shutdown();
+  }
+  Notify(&HandlerTable::close, closecallback_); //应用层清理连接回调
+  GetLoop()->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
   disconnected_ = true; // 设置为断开连接状态
 }
+bool TcpConnection::Migratable() const {
+  //迁移只搬channel注册和缓冲：正在关闭、等待迁移前loop的合并写、零拷贝通知或压缩线程、由业务线程或上下文（协程、转发）持有状态、
+  //还有推迟到下一轮分发的事件（边缘触发不会在新loop上再报告）的连接不迁移
+  return !disconnected_ && !detached_ && !migrating_ && !halfclose_ && !asyncprocessing_ && !corked_ &&
+         !outputqueue_.ZeroCopyPending() && !rawreadable_ && !context_ && !compressbusy_ &&
+         channel_->GetDeferred() == 0;
+}
+void TcpConnection::DetachFromLoop(EventLoop* target) {
+  EventLoop* loop = GetLoop();
+  loop->RemoveChannelFromPoller(channel_.get());
+  loop->AddBufferMemory(-static_cast<int64_t>(memory_));
+  memory_ = 0;
+  migrating_ = true;
+  //之后其他线程的Send都投递到新loop
+  loop_.store(target, std::memory_order_release);
+}
+void TcpConnection::AttachToLoop() {
+  EventLoop* loop = GetLoop();
+  migrating_ = false;
+  outputqueue_.SetBufferPool(loop->GetBufferPool()); //已有的块在这里释放时经远程链表还给原来的loop
+  if (outputqueue_.ZeroCopyEnabled()) {
+    outputqueue_.SetZeroCopyStats(&loop->GetStats().zerocopy);
+  }
+  //边缘触发：注册时已经就绪的读写事件会立即报告，迁移期间到达的数据不会丢
+  loop->AddChannelToPoller(channel_.get());
+  UpdateMemory();
+  SendInLoop(); //迁移期间排队的数据
+}
+int TcpConnection::Detach(std::string& unread) {
+  //还有数据待发送或者业务层还在处理的连接不交接，留在旧进程处理完；TLS连接的会话状态在本进程内，也不交接
+  if (!detachable_ || disconnected_ || halfclose_ || asyncprocessing_ || !outputqueue_.Empty() || outputqueue_.ZeroCopyPending() || tls_ || compress_) {
+    return -1;
+  }
+  int fd = dup(sockfd_);
+  if (fd < 0) {
+    perror("dup");
+    return -1;
+  }
+  GetLoop()->RemoveChannelFromPoller(channel_.get());
+  detached_ = true;
+  unread.swap(readbuffer_);
+  GetLoop()->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
+  disconnected_ = true;
+  return fd;
+}
+void TcpConnection::AdoptReadBuffer(std::string& unread) {
+  if (unread.empty()) {
+    return;
+  }
+  readbuffer_.swap(unread);
+  GetLoop()->AddTask(std::bind(&TcpConnection::HandleAdoptedData, shared_from_this()));
+}
+void TcpConnection::HandleAdoptedData() {
+  if (!InLoopThread()) {
+    GetLoop()->AddTask(std::bind(&TcpConnection::HandleAdoptedData, shared_from_this()));
+    return;
+  }
+  //期间如果HandleRead已经把数据交给了业务层，这里就不用再处理
+  if (disconnected_ || readbuffer_.empty()) {
+    return;
+  }
+  CallMessage();
+}
+void TcpConnection::SetRawEventCallBack(EventCallBack &&readable, EventCallBack &&writable) {
+  rawreadable_ = std::move(readable);
+  rawwritable_ = std::move(writable);
+}
+void TcpConnection::EnableWriting(bool enable) {
+  uint32_t events = channel_->GetEvents();
+  uint32_t newevents = enable ? (events | EPOLLOUT) : (events & (~EPOLLOUT));
+  if (newevents != events) {
+    channel_->SetEvents(newevents);
+    GetLoop()->UpdateChannelInPoller(channel_.get());
+  }
+}
+void TcpConnection::ShutdownWrite() {
+  if (shutdown(sockfd_, SHUT_WR) < 0) {
+    perror("shutdown");
+  }
+}
 void TcpConnection::HandleRead() {
   if (disconnected_) {
     return; // 已经断开连接
   }
-  
+  if (rawreadable_) {
+    rawreadable_();
+    return;
+  }
+  if (tls_ && !tls_->Established()) {
+    HandleHandshake();
+    return;
+  }
+  if (tls_ && !tls_->KernelRecv()) {
+    active_ = true;
+    HandleTlsRead();
+    UpdateMemory();
+    return;
+  }
+  active_ = true;
+  size_t before = readbuffer_.size();
   int n = recvn(sockfd_, readbuffer_);
+  TRACE2(conn_recv, sockfd_, n);
+  if (n > 0) {
+    traffic_ += n;
+    if (compress_ && !DecompressInput(before)) {
+      std::cerr << "TcpConnection: corrupt compressed frame from fd " << sockfd_ << std::endl;
+      HandleError();
+      UpdateMemory();
+      return;
+    }
+    if (capture_ && readbuffer_.size() > before) {
+      capture_->Record(captureid_, TrafficCapture::CAPTURE_IN, readbuffer_.data() + before, readbuffer_.size() - before);
+    }
+  }
   if (n < 0) {
     perror("recv error");
     HandleError();
   } else if (n == 0) {
     HandleClose(); // 对端关闭连接
-  } else {
-    messagecallback_(shared_from_this(), readbuffer_); // 调用消息回调
+  } else if (readbuffer_.size() > before) {
+    CallMessage(); // 调用消息回调，开启压缩时可能只收到半个帧
   }
+  UpdateMemory();
 }
 void TcpConnection::HandleWrite() {
-  int result=sendn(sockfd_, writebuffer_);
-  if(result>0)
-  {
-    uint32_t events = channel_->GetEvents();
-    if (writebuffer_.size() > 0) {
-      // 缓冲区还有数据未发送，继续设置EPOLLOUT事件
-      channel_->SetEvents(events | EPOLLOUT);
-      loop_->UpdateChannelInPoller(channel_.get());
-    } else {
-      // 缓冲区已空，清除EPOLLOUT事件
-      channel_->SetEvents(events & (~EPOLLOUT));
-      sendcompletecallback_(shared_from_this()); // 发送完成回调
-      if (halfclose_) {
-        HandleClose(); // 半关闭状态，处理连接关闭
-      }
+  if (rawwritable_) {
+    if (!disconnected_) {
+      rawwritable_();
     }
-  } else if(result < 0) {
-    HandleError(); 
-  }else{
-    HandleClose(); // 连接关闭
+    return;
+  }
+  if (disconnected_) {
+    return;
+  }
+  if (tls_ && !tls_->Established()) {
+    HandleHandshake();
+    return;
   }
+  active_ = true;
+  HandleWriteResult(WriteSocket());
+  UpdateMemory();
 }
 void TcpConnection::HandleError() {
   if(disconnected_) {
     return; // 已经断开连接
   }
-  errorcallback_(shared_from_this()); // 错误回调
-  loop_->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
+  if (rawreadable_) {
+    rawreadable_(); //接管模式下错误由读写时的返回值处理
+    return;
+  }
+  //EPOLLERR也可能只是错误队列里有零拷贝完成通知
+  if (outputqueue_.ZeroCopyPending() && outputqueue_.ReapZeroCopy(sockfd_)) {
+    if (outputqueue_.ZeroCopyCopied()) {
+      outputqueue_.DisableZeroCopy(); //内核还是拷贝了数据，零拷贝只剩额外开销，退回普通发送
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+      return;
+    }
+  }
+  Notify(&HandlerTable::error, errorcallback_); // 错误回调
+  GetLoop()->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
   disconnected_ = true; // 设置为断开连接状态
 }
 void TcpConnection::HandleClose() {
   if (disconnected_) {
     return; // 已经断开连接
   }
+  if (rawreadable_) {
+    rawreadable_(); //接管模式下对端关闭由读到EOF处理
+    return;
+  }
   std::cout << "TcpConnection::HandleClose" << std::endl;
-  if(writebuffer_.size() > 0||readbuffer_.size() > 0||asyncprocessing_) {
-    halfclose_ = true; //如果还有数据待发送，则先发完,设置半关闭标志位
+  if(!outputqueue_.Empty()||readbuffer_.size() > 0||asyncprocessing_||compressbusy_) {
+    halfclose_ = true; //如果还有数据待发送（包括压缩线程里的），则先发完,设置半关闭标志位
     //还有数据刚刚才收到，但同时又收到FIN
     if(readbuffer_.size() > 0) {
-      messagecallback_(shared_from_this(), readbuffer_); // 调用消息回调
+      CallMessage(); // 调用消息回调
     }
   }else{
-    loop_->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
-    closecallback_(shared_from_this()); // 应用层清理连接回调
+    GetLoop()->AddTask(std::bind(connectioncleanup_, shared_from_this()));//自己不能清理自己，交给loop执行，Tcpserver清理TcpConnection
+    Notify(&HandlerTable::close, closecallback_); // 应用层清理连接回调
     disconnected_ = true; // 设置为断开连接状态
   }
 }
@@ -178,41 +628,3 @@ int recvn(int fd, std::string &bufferin) {
   }
 }
 }
-int sendn(int fd, std::string &bufferout) {
-  ssize_t nbyte=0;
-  int sendsum=0;
-  size_t length = bufferout.size();
-  if(length>= BUFSIZE) {
-    length = BUFSIZE; // 限制发送缓冲区大小
-  }
-  for(;;)
-  {
-    nbyte=write(fd,bufferout.c_str(),length);
-    if(nbyte>0)
-    {
-      sendsum += nbyte;
-      bufferout.erase(0, nbyte); // 移除已发送的数据
-      length=bufferout.size();
-      if(length>=BUFSIZE) {
-        length = BUFSIZE; // 限制发送缓冲区大小
-      }
-      if(length==0) {
-        return sendsum; // 发送完毕
-      }
-    }else if(nbyte<0) {
-      if(errno==EAGAIN) {
-        return sendsum; // 非阻塞返回，缓冲区满
-      } else if(errno==EINTR) {
-        continue; // 被信号打断，继续发送
-      } else if(errno==EPIPE) {
-        perror("send error");
-        return -1; // 发送错误
-      }else {
-        perror("send error");
-        return -1; // 发送错误
-      }
-    } else { // nbyte == 0，连接关闭
-      return 0;
-    }
-  }
-}
\ No newline at end of file
@@ -8,30 +8,127 @@
 #include <arpa/inet.h>
 #include <thread>
 #include <memory>
+#include <atomic>
 #include "Channel.h"
 #include "EventLoop.h"
+#include "OutputQueue.h"
+#include "SockAddress.h"
+#include "TlsStream.h"
+#include "CompressStream.h"
+#include "TrafficCapture.h"
 class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 public:
   typedef std::shared_ptr<TcpConnection> spTcpConnection;
   //回调函数类型
   typedef std::function<void(const spTcpConnection&)> CallBack;
   typedef std::function<void(const spTcpConnection&, std::string&)> MessageCallBack;
-  TcpConnection(EventLoop* loop, int sockfd, const struct sockaddr_in& peeraddr);
+  //接管模式下的可读/可写事件回调
+  typedef std::function<void()> EventCallBack;
+  //编译期确定的回调表，由BasicTcpServer按业务类型生成，设置后代替下面的各个std::function回调
+  //表里是普通函数指针，跳板函数里直接调用（可内联）业务代码，每个连接只保存一个指针
+  struct HandlerTable {
+    void* owner;//业务对象，作为第一个参数传给各个函数
+    void (*message)(void* owner, const spTcpConnection&, std::string&);
+    void (*sendcomplete)(void* owner, const spTcpConnection&);
+    void (*close)(void* owner, const spTcpConnection&);
+    void (*error)(void* owner, const spTcpConnection&);
+  };
+  //只读的引用计数缓冲，同一份数据发给多个连接时共享
+  typedef OutputQueue::SharedBuffer SharedBuffer;
+  TcpConnection(EventLoop* loop, int sockfd, const SockAddress& peeraddr);
   ~TcpConnection();
   //获取当前连接的fd
   int fd() const { return sockfd_; }
   //获取当前连接所属的loop
-  EventLoop* GetLoop() const { return loop_; }
+  EventLoop* GetLoop() const { return loop_.load(std::memory_order_acquire); }
+  //当前线程是否为连接所属loop的线程
+  bool InLoopThread() const { return GetLoop()->GetThreadId() == std::this_thread::get_id(); }
+  //连接是否已经断开
+  bool Disconnected() const { return disconnected_; }
+  //对端是否已经关闭写端
+  bool HalfClosed() const { return halfclose_; }
+  //发送队列中还未写入socket的字节数，须在IO线程调用
+  size_t OutputBytes() const { return outputqueue_.Size(); }
+  //读缓冲和发送队列占用的内存，即已计入所属loop的部分，每次读写后更新
+  size_t MemoryUsage() const { return memory_; }
+  //自上次调用以来是否有过读写，调用后清除标记，用于空闲检测，须在IO线程调用
+  bool TakeActive() {
+    bool active = active_;
+    active_ = false;
+    return active;
+  }
+  //释放读缓冲和发送队列多余的容量，须在IO线程调用
+  void ShrinkBuffers();
+  //自上次调用以来读写的字节数，调用后清零，用于挑选负载重的连接，须在IO线程调用
+  uint64_t TakeTraffic() {
+    uint64_t traffic = traffic_;
+    traffic_ = 0;
+    return traffic;
+  }
+  //连接迁移，由TcpServer::MigrateConnection在连接原来的loop线程依次调用Migratable、DetachFromLoop，
+  //再在新loop线程调用AttachToLoop；期间的Send只入队，关闭推迟到迁移完成后
+  //是否处于可以迁移的静止点
+  bool Migratable() const;
+  //从当前loop摘下channel并扣减内存，所属loop改为target
+  void DetachFromLoop(EventLoop* target);
+  //在新loop线程注册channel、计入内存，发送迁移期间排队的数据
+  void AttachToLoop();
+  //获取对端地址
+  const SockAddress& GetPeerAddr() const { return peeraddr_; }
   //添加本连接对应的事件到loop
   void AddChannelToLoop();
   //发送数据的函数
   void Send(const std::string& message);
+  //发送共享缓冲，只增加引用计数，不拷贝数据
+  void Send(const SharedBuffer& buffer);
+  //接管message的数据，开启零拷贝时大块数据不再拷贝
+  void Send(std::string&& message);
+  //开启零拷贝发送：不小于threshold的数据用MSG_ZEROCOPY发送，缓冲保留到内核完成通知，小数据照常拷贝
+  //完成通知从socket错误队列读取，经EPOLLERR触发；内核报告仍做了拷贝时自动退回普通发送，须在AddChannelToLoop之前调用
+  bool EnableZeroCopy(size_t threshold);
+  //开启TLS：在IO线程里非阻塞握手，握手前Send的数据先排队；握手后能切到内核TLS时收发仍走普通的read/write
+  //与零拷贝互斥，须在AddChannelToLoop之前调用
+  bool EnableTls(TlsContext* context);
+  //开启压缩：之后收发的字节流按CompressStream的帧格式传输，对端也须开启；业务层收发的仍是明文
+  //上下文开启了压缩线程时，不小于阈值的发送数据交给压缩线程压缩，压完按发送顺序入队，须在AddChannelToLoop之前调用
+  bool EnableCompression(CompressContext* context);
+  //开启流量录制：之后读到的数据和业务层发送的数据都写进capture，连接销毁时写入关闭记录，capture须比连接存活更久
+  //TLS和压缩连接录制的是明文，须在AddChannelToLoop之前调用
+  void EnableCapture(TrafficCapture* capture) {
+    capture_ = capture;
+    captureid_ = capture->OpenConnection();
+  }
+  //是否为TLS连接
+  bool IsTls() const { return tls_ != nullptr; }
   //在当前IO线程发送数据函数
   void SendInLoop();
+  //自动合并写：loop分发事件期间的Send只追加到发送队列，本轮迭代末尾统一写一次socket，须在AddChannelToLoop之前设置
+  void SetAutoCork(bool autocork) { autocork_ = autocork; }
+  //开启loop调度后事件的分发优先级，对延迟敏感的连接设为Channel::PRIORITY_HIGH，须在新连接回调或IO线程里调用
+  void SetPriority(int priority) { channel_->SetPriority(priority); }
+  //由EventLoop在迭代末尾调用，写出推迟的数据
+  void FlushCorked();
   //主动清理连接
   void Shutdown();
   //在当前IO线程清理连接函数
   void ShutdownInLoop();
+  //热升级：把空闲连接从本进程摘下，返回dup出的fd，未处理的读缓冲交换到unread；连接不空闲时返回-1，须在IO线程调用
+  int Detach(std::string& unread);
+  //热升级时不交接这条连接（如附加监听上的连接，新进程不知道它的回调），须在新连接回调或IO线程里调用
+  void SetDetachable(bool detachable) { detachable_ = detachable; }
+  //热升级：接管从旧进程继承的读缓冲，须在AddChannelToLoop之前调用
+  void AdoptReadBuffer(std::string& unread);
+  //接管模式：读写事件直接交给回调，由调用者自己读写socket（如TcpRelay用splice转发），须在IO线程调用
+  void SetRawEventCallBack(EventCallBack &&readable, EventCallBack &&writable);
+  //接管模式下开关可写事件
+  void EnableWriting(bool enable);
+  //关闭写端，对端读到EOF，用于半关闭的传递
+  void ShutdownWrite();
+  //取走读缓冲中尚未被业务层处理的数据
+  void TakeReadBuffer(std::string& data) { data.swap(readbuffer_); }
+  //绑定到连接上的任意上下文，连接关闭前一直持有
+  void SetContext(const std::shared_ptr<void>& context) { context_ = context; }
+  const std::shared_ptr<void>& GetContext() const { return context_; }
   //可读事件回调
   void HandleRead(); 
   //可写事件回调
@@ -55,6 +152,10 @@ public:
   void SetErrorCallBack(CallBack &&cb) {
     errorcallback_ = std::move(cb);
   }
+  //设置回调表，表须比连接存活更久，须在AddChannelToLoop之前调用
+  void SetHandlerTable(const HandlerTable* table) {
+    handlers_ = table;
+  }
   //设置连接清理函数
   void SetConnectionCleanup(CallBack &&cb) {
     connectioncleanup_ = std::move(cb);
@@ -64,23 +165,94 @@ public:
     asyncprocessing_ = async;
   }
 private:
-  EventLoop* loop_;//当前连接所在的loop
+  //channel的事件分发函数，按就绪事件依次调用读、写、错误、关闭处理
+  static void DispatchEvent(void* owner, uint32_t revents);
+  //调用业务回调，有回调表时走回调表
+  void CallMessage() {
+    if (handlers_) {
+      handlers_->message(handlers_->owner, shared_from_this(), readbuffer_);
+    } else {
+      messagecallback_(shared_from_this(), readbuffer_);
+    }
+  }
+  //entry为回调表中对应的函数，cb为对应的std::function回调，都可以为空
+  void Notify(void (*HandlerTable::*entry)(void*, const spTcpConnection&), const CallBack& cb) {
+    if (handlers_) {
+      if (handlers_->*entry) {
+        (handlers_->*entry)(handlers_->owner, shared_from_this());
+      }
+    } else if (cb) {
+      cb(shared_from_this());
+    }
+  }
+  //把继承来的读缓冲交给业务层
+  void HandleAdoptedData();
+  //跨线程发送的数据在IO线程里入队
+  void SendBufferInLoop(const SharedBuffer& buffer);
+  //写socket之后根据发送队列是否清空开关EPOLLOUT
+  void HandleWriteResult(ssize_t n);
+  //把发送队列写入socket
+  void WriteOutputQueue();
+  //按是否用户态TLS选择写socket的方式
+  ssize_t WriteSocket();
+  //重新计算缓冲占用的内存，把变化量计入所属loop
+  void UpdateMemory();
+  //推进TLS握手
+  void HandleHandshake();
+  //用户态TLS解密读
+  void HandleTlsRead();
+  //把要发送的明文分帧压缩后入队，或者交给压缩线程
+  void CompressOutput(const char* data, size_t len);
+  //把排队等压缩的明文整批交给一个压缩线程，须在没有批次在压缩时调用
+  void SubmitCompression();
+  //压缩线程里压缩一批明文，结果投递回IO线程
+  void CompressInWorker(const std::string& plain);
+  //IO线程里把压好的一批入队发送，再提交排队的下一批
+  void CompressDone(std::string& framed, bool ok);
+  //把读缓冲offset之后新收到的帧移到压缩输入缓冲，解出的明文追加回读缓冲，数据损坏返回false
+  bool DecompressInput(size_t offset);
+  //录制发给连接的数据
+  void CaptureOutput(const char* data, size_t len) {
+    if (capture_) {
+      capture_->Record(captureid_, TrafficCapture::CAPTURE_OUT, data, len);
+    }
+  }
+  std::atomic<EventLoop*> loop_;//当前连接所在的loop，迁移时由原loop线程修改，其他线程通过GetLoop读取
   std::unique_ptr<Channel> channel_;//当前连接的事件
   int sockfd_;
-  struct sockaddr_in peeraddr_;//对端地址
+  SockAddress peeraddr_;//对端地址，IPv4、IPv6或Unix域
   bool halfclose_;//是否半关闭
   bool disconnected_;//是否断开连接
+  bool detached_;//是否已经交给新进程，此时channel已从poller移除
+  bool detachable_;//热升级时能否交给新进程
+  bool migrating_;//正在迁移到新loop，channel已从原loop移除、还没注册到新loop
   //异步调用标志位,当工作任务交给线程池时，置为true，任务完成回调时置为false
   bool asyncprocessing_;
-  //读写缓冲
+  bool autocork_;//是否开启自动合并写
+  bool corked_;//已登记到loop等待迭代末尾发送
+  bool active_;//自上次空闲检测以来有过读写
+  size_t memory_;//已计入loop的缓冲内存
+  uint64_t traffic_;//自上次TakeTraffic以来读写的字节数
+  //读缓冲和发送队列
   std::string readbuffer_;
-  std::string writebuffer_;
+  OutputQueue outputqueue_;
   //各种回调函数
   MessageCallBack messagecallback_;//消息回调
   CallBack sendcompletecallback_;//发送完成回调
   CallBack closecallback_;//关闭回调
   CallBack errorcallback_;//错误回调
   CallBack connectioncleanup_;//连接清理回调
+  const HandlerTable* handlers_;//回调表，为空时使用上面的std::function回调
+  EventCallBack rawreadable_;//接管模式的可读回调，为空时正常读数据
+  EventCallBack rawwritable_;//接管模式的可写回调
+  std::shared_ptr<void> context_;
+  std::unique_ptr<TlsStream> tls_;//TLS状态，非TLS连接为空
+  std::unique_ptr<CompressStream> compress_;//压缩状态，未开启时为空
+  std::string compressin_;//收到的还不完整的帧
+  std::string compresspending_;//等压缩线程压缩的明文
+  bool compressbusy_;//有一批明文正在压缩线程里压缩，之后的数据排队，保证发送顺序
+  TrafficCapture* capture_;//流量录制，未开启时为空
+  uint64_t captureid_;//录制中的连接编号
 };
 
 #endif // !_TCPCONNECTION_H_
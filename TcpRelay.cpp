@@ -0,0 +1,154 @@
+#include "TcpRelay.h"
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#define SPLICE_CHUNK (256 * 1024) //每次从socket搬进管道的最大字节数
+TcpRelay::TcpRelay(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream)
+    : closed_(false) {
+  directions_[0].from = client;
+  directions_[0].to = upstream;
+  directions_[1].from = upstream;
+  directions_[1].to = client;
+  for (int i = 0; i < 2; ++i) {
+    directions_[i].pipe.readfd = directions_[i].pipe.writefd = -1;
+    directions_[i].inpipe = 0;
+    directions_[i].eof = false;
+    directions_[i].shutdown = false;
+    directions_[i].bytes = 0;
+  }
+}
+TcpRelay::~TcpRelay() {
+  for (int i = 0; i < 2; ++i) {
+    PipePool::GetLoopPool()->Release(directions_[i].pipe, directions_[i].inpipe == 0);
+  }
+}
+std::shared_ptr<TcpRelay> TcpRelay::Start(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream) {
+  std::shared_ptr<TcpRelay> relay(new TcpRelay(client, upstream));
+  for (int i = 0; i < 2; ++i) {
+    Direction& direction = relay->directions_[i];
+    if (!PipePool::GetLoopPool()->Acquire(direction.pipe)) {
+      relay->Close();
+      return std::shared_ptr<TcpRelay>();
+    }
+    //配对之前收到的数据已经在用户态，作为开头先转发
+    direction.from->TakeReadBuffer(direction.head);
+    direction.eof = direction.from->HalfClosed();
+  }
+  std::weak_ptr<TcpRelay> wprelay(relay);
+  client->SetRawEventCallBack(std::bind(&TcpRelay::OnReadable, wprelay, 0), std::bind(&TcpRelay::OnWritable, wprelay, 0));
+  upstream->SetRawEventCallBack(std::bind(&TcpRelay::OnReadable, wprelay, 1), std::bind(&TcpRelay::OnWritable, wprelay, 1));
+  client->SetContext(relay);
+  upstream->SetContext(relay);
+  //边缘触发，配对之前socket里可能已经有数据，先主动搬一次
+  if (!relay->Pump(relay->directions_[0]) || !relay->Pump(relay->directions_[1])) {
+    relay->Close();
+    return std::shared_ptr<TcpRelay>();
+  }
+  relay->CheckDone();
+  return relay;
+}
+void TcpRelay::OnReadable(const std::weak_ptr<TcpRelay>& wprelay, int side) {
+  std::shared_ptr<TcpRelay> relay = wprelay.lock();
+  if (!relay || relay->closed_) {
+    return;
+  }
+  //side端可读，驱动从side出发的方向
+  if (!relay->Pump(relay->directions_[side])) {
+    relay->Close();
+    return;
+  }
+  relay->CheckDone();
+}
+void TcpRelay::OnWritable(const std::weak_ptr<TcpRelay>& wprelay, int side) {
+  std::shared_ptr<TcpRelay> relay = wprelay.lock();
+  if (!relay || relay->closed_) {
+    return;
+  }
+  //side端可写，驱动写往side的方向，写完后继续读取被背压停下的另一端
+  if (!relay->Pump(relay->directions_[1 - side])) {
+    relay->Close();
+    return;
+  }
+  relay->CheckDone();
+}
+bool TcpRelay::Flush(Direction& direction) {
+  int tofd = direction.to->fd();
+  while (!direction.head.empty()) {
+    ssize_t n = write(tofd, direction.head.data(), direction.head.size());
+    if (n > 0) {
+      direction.head.erase(0, n);
+      direction.bytes += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+  while (direction.inpipe > 0) {
+    ssize_t n = splice(direction.pipe.readfd, NULL, tofd, NULL, direction.inpipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      direction.inpipe -= n;
+      direction.bytes += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+bool TcpRelay::Pump(Direction& direction) {
+  for (;;) {
+    if (!Flush(direction)) {
+      return false;
+    }
+    if (direction.inpipe > 0 || !direction.head.empty()) {
+      //对端写满，等待可写事件，期间不再读取from，让TCP窗口把压力传回发送方
+      direction.to->EnableWriting(true);
+      return true;
+    }
+    direction.to->EnableWriting(false);
+    if (direction.eof) {
+      //数据全部写出后再传递半关闭
+      if (!direction.shutdown) {
+        direction.to->ShutdownWrite();
+        direction.shutdown = true;
+      }
+      return true;
+    }
+    ssize_t n = splice(direction.from->fd(), NULL, direction.pipe.writefd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      direction.inpipe += n;
+    } else if (n == 0) {
+      direction.eof = true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN) {
+      return true;
+    } else {
+      return false;
+    }
+  }
+}
+void TcpRelay::CheckDone() {
+  if (directions_[0].shutdown && directions_[1].shutdown) {
+    Close();
+  }
+}
+void TcpRelay::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  //断开两端对relay的引用，调用方持有的shared_ptr保证本函数返回前relay不会析构
+  for (int i = 0; i < 2; ++i) {
+    directions_[i].from->SetContext(std::shared_ptr<void>());
+    directions_[i].from->Shutdown();
+  }
+}
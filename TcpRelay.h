@@ -0,0 +1,43 @@
+#ifndef _TCPRELAY_H_
+#define _TCPRELAY_H_
+//四层转发：把两个TcpConnection配对，用splice经内核管道双向搬运数据，数据不经过用户态
+//支持半关闭传递，任一方向对端写满时停止读取另一端（背压）
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "TcpConnection.h"
+#include "PipePool.h"
+class TcpRelay : public std::enable_shared_from_this<TcpRelay> {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //开始转发，两个连接须属于同一个loop、已注册到poller，并在该loop线程调用；relay挂在两个连接的上下文上，任一端关闭时两端一起关闭
+  static std::shared_ptr<TcpRelay> Start(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream);
+  ~TcpRelay();
+  //已转发的字节数，0为client到upstream，1为upstream到client
+  uint64_t BytesForwarded(int direction) const { return directions_[direction].bytes; }
+private:
+  //单个方向的转发状态
+  struct Direction {
+    TcpConnectionPtr from;
+    TcpConnectionPtr to;
+    PipePool::Pipe pipe;
+    size_t inpipe;//管道中还没写出去的字节数
+    std::string head;//开始转发前已经读到用户态的数据，先于管道数据写出
+    bool eof;//from已读到EOF
+    bool shutdown;//已经对to关闭写端
+    uint64_t bytes;
+  };
+  TcpRelay(const TcpConnectionPtr& client, const TcpConnectionPtr& upstream);
+  static void OnReadable(const std::weak_ptr<TcpRelay>& wprelay, int side);
+  static void OnWritable(const std::weak_ptr<TcpRelay>& wprelay, int side);
+  //把head和管道中的数据写给to，to写满时返回true并保留剩余数据，出错返回false
+  bool Flush(Direction& direction);
+  //一个方向上尽可能多地搬运数据，出错返回false
+  bool Pump(Direction& direction);
+  //两个方向都已结束时关闭
+  void CheckDone();
+  void Close();
+  Direction directions_[2];
+  bool closed_;
+};
+#endif // !_TCPRELAY_H_
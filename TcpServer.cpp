@@ -2,80 +2,844 @@
 #include <iostream>
 #include <stdio.h>
 #include <unistd.h>
-#include <fcntl.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <memory>
+#include <algorithm>
+#include "TimerManager.h"
+#include "LoopWatchdog.h"
+#define MEMORY_SWEEP_INTERVAL 100 //开启内存上限时检查的最长间隔，单位ms，未超限时每次检查只读各loop的计数
+#define AUTOSCALE_INTERVAL 2000 //弹性伸缩的检查间隔，单位ms
+#define AUTOSCALE_HIGH 0.75 //平均利用率高于该值时增加一个IO线程
+#define AUTOSCALE_LOW 0.2 //平均利用率低于该值时排空一个IO线程
+#define REBALANCE_HIGH 0.6 //loop利用率高于该值才迁出连接
+#define REBALANCE_GAP 0.3 //最忙和最闲的loop利用率相差超过该值才迁移
+#define REBALANCE_MAX_MOVES 8 //热点loop每轮最多迁出的连接数
+#define CAPTURE_FLUSH_INTERVAL 100 //流量录制刷新线程缓冲的间隔，单位ms
 
-void SetNonBlocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        perror("fcntl get flags");
-        exit(EXIT_FAILURE);
-    }
-    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror("fcntl set non-blocking");
-        exit(EXIT_FAILURE);
-    }
-}
-TcpServer::TcpServer(EventLoop* loop, const int port, const int threadnum)
-    : loop_(loop), socket_(), acceptchannel_(), conncount_(0), threadpool_(loop, threadnum) {
-    // 设置服务器套接字选项
-    socket_.SetReuseAddr();
-    // 绑定地址
-    socket_.BindAddress(port);
-    socket_.Setnonblocking();
-    socket_.Listen();
-    acceptchannel_.SetFd(socket_.fd());
+TcpServer::TcpServer(EventLoop* loop, const int port, const int threadnum, const ServerOptions& options)
+    : TcpServer(loop, SockAddress::Inet(port), threadnum, options) {
+}
+TcpServer::TcpServer(EventLoop* loop, const SockAddress& listenaddr, const int threadnum, const ServerOptions& options)
+    : socket_(SOCK_STREAM, listenaddr.Family()), listenaddr_(listenaddr), options_(options), loop_(loop), acceptchannel_(),
+      listeners_(), started_(false), conncount_(0), capture_(), threadpool_(loop, threadnum),
+      handlers_(nullptr), upgrade_(), handoverconns_(false), draining_(false), refused_(0), sweeptimer_(), sweeps_(0),
+      scaletimer_(), lastbusy_(), lastscale_(0), rebalancetimer_(), rebalancebusy_(), lastrebalance_(0),
+      capturetimer_() {
     acceptchannel_.setReadHandler(std::bind(&TcpServer::OnNewConnection, this));
     acceptchannel_.setErrorHandler(std::bind(&TcpServer::OnConnectionError, this));
 }
 TcpServer::~TcpServer() {
     
+}
+TcpServer::Listener::Listener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options)
+    : name_(name), listenaddr_(listenaddr), options_(options), socket_(SOCK_STREAM, listenaddr.Family()), acceptchannel_(),
+      listening_(false), maxconnections_(0), priority_(Channel::PRIORITY_NORMAL) {
+}
+TcpServer::Listener* TcpServer::AddListener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options) {
+    listeners_.push_back(std::unique_ptr<Listener>(new Listener(name, listenaddr, options)));
+    Listener* listener = listeners_.back().get();
+    if (started_) {
+        StartListener(listener);
+    }
+    return listener;
+}
+std::vector<TcpServer::Listener*> TcpServer::GetListeners() {
+    std::vector<Listener*> listeners;
+    for (auto &listener : listeners_) {
+        listeners.push_back(listener.get());
+    }
+    return listeners;
+}
+void TcpServer::StartListener(Listener* listener) {
+    listener->socket_.SetReuseAddr();
+    listener->socket_.setSocketOption(listener->options_);
+    listener->socket_.Bind(listener->listenaddr_);
+    listener->socket_.Setnonblocking();
+    listener->socket_.Listen(listener->options_.backlog);
+    listener->listening_ = true;
+    listener->acceptchannel_.SetFd(listener->socket_.fd());
+    listener->acceptchannel_.SetEvents(EPOLLIN | EPOLLET);
+    listener->acceptchannel_.SetPriority(Channel::PRIORITY_HIGH);
+    listener->acceptchannel_.setReadHandler(std::bind(&TcpServer::OnListenerConnection, this, listener));
+    listener->acceptchannel_.setErrorHandler([listener]() {
+        std::cout << "Listener " << listener->name_ << " error occurred." << std::endl;
+        listener->socket_.Close();
+        listener->listening_ = false;
+    });
+    loop_->AddChannelToPoller(&listener->acceptchannel_);
+    std::cout << "TcpServer listener " << listener->name_ << " started on " << listener->listenaddr_.ToString() << std::endl;
+}
+void TcpServer::EnableHotUpgrade(const std::string& path, bool handoverconns) {
+    upgrade_.reset(new HotUpgrade(loop_, path));
+    handoverconns_ = handoverconns;
+}
+bool TcpServer::EnableCapture(const std::string& path, size_t maxbytes) {
+    capture_.reset(new TrafficCapture(path, maxbytes));
+    if (!capture_->Open()) {
+        capture_.reset();
+        return false;
+    }
+    return true;
 }
 void TcpServer::Start() {
     // 启动线程池
     threadpool_.Start();
+    for (auto &loop : threadpool_.GetAllLoops()) {
+        OnLoopAdded(loop);
+    }
+    threadpool_.AddObserver(std::bind(&TcpServer::OnLoopAdded, this, std::placeholders::_1),
+                            std::bind(&TcpServer::OnLoopRemoved, this, std::placeholders::_1));
+    if (upgrade_ && upgrade_->Inherit()) {
+        // 热升级：直接沿用旧进程的监听socket，端口不会出现拒绝连接的窗口
+        socket_.Attach(upgrade_->GetListenFd());
+    } else {
+        // 设置服务器套接字选项
+        socket_.SetReuseAddr();
+        socket_.setSocketOption(options_);
+        // 绑定地址
+        socket_.Bind(listenaddr_);
+        socket_.Setnonblocking();
+        socket_.Listen(options_.backlog);
+    }
+    acceptchannel_.SetFd(socket_.fd());
     acceptchannel_.SetEvents(EPOLLIN | EPOLLET); // 设置为边缘触发模式
+    acceptchannel_.SetPriority(Channel::PRIORITY_HIGH); // 开启loop调度时先于连接上的事件处理
+    if (options_.scheduling) {
+        loop_->AddTask(std::bind(&EventLoop::EnableScheduling, loop_, options_.iosliceus, options_.tasksliceus));
+    }
     // 将acceptchannel添加到事件循环中
     loop_->AddChannelToPoller(&acceptchannel_);
-    std::cout << "TcpServer started on port " << socket_.fd() << std::endl;
+    started_ = true;
+    for (auto &listener : listeners_) {
+        StartListener(listener.get());
+    }
+    if (upgrade_) {
+        // 接管旧进程交过来的空闲连接
+        std::vector<HotUpgrade::InheritedConnection>& inherited = upgrade_->GetConnections();
+        for (auto &inheritedconn : inherited) {
+            ++conncount_;
+            NewConnection(inheritedconn.fd, inheritedconn.peeraddr)->AdoptReadBuffer(inheritedconn.unread);
+        }
+        inherited.clear();
+        upgrade_->Listen(std::bind(&TcpServer::HandOver, this, std::placeholders::_1));
+    }
+    if (options_.idleshrinkms > 0 || options_.memorylimit > 0) {
+        int interval = options_.idleshrinkms;
+        if (options_.memorylimit > 0 && (interval == 0 || interval > MEMORY_SWEEP_INTERVAL)) {
+            interval = MEMORY_SWEEP_INTERVAL;
+        }
+        sweeptimer_.reset(new Timer(interval, Timer::TIMER_PERIOD, std::bind(&TcpServer::OnSweepTimer, this)));
+        TimerManager::GetInstance()->Start();
+        sweeptimer_->Start();
+    }
+    if (options_.maxloops > 0) {
+        lastscale_ = LoopWatchdog::Now();
+        //定时器线程只投递任务，增删loop在主loop线程里做，与分发新连接串行
+        scaletimer_.reset(new Timer(AUTOSCALE_INTERVAL, Timer::TIMER_PERIOD, [this]() {
+            loop_->AddTask(std::bind(&TcpServer::AutoScale, this));
+        }));
+        TimerManager::GetInstance()->Start();
+        scaletimer_->Start();
+    }
+    if (options_.rebalancems > 0) {
+        lastrebalance_ = LoopWatchdog::Now();
+        rebalancetimer_.reset(new Timer(options_.rebalancems, Timer::TIMER_PERIOD, [this]() {
+            loop_->AddTask(std::bind(&TcpServer::Rebalance, this));
+        }));
+        TimerManager::GetInstance()->Start();
+        rebalancetimer_->Start();
+    }
+    if (capture_) {
+        capturetimer_.reset(new Timer(CAPTURE_FLUSH_INTERVAL, Timer::TIMER_PERIOD, std::bind(&TcpServer::OnCaptureTimer, this)));
+        TimerManager::GetInstance()->Start();
+        capturetimer_->Start();
+    }
+    std::cout << "TcpServer started on " << listenaddr_.ToString() << std::endl;
 }
 void TcpServer::OnNewConnection() {
   //循环调用accept，获取所有的建立好连接的客户端fd
-    struct sockaddr_in peeraddr;
-    int connfd = socket_.Accept(peeraddr);
-    while(connfd>0)
+    SockAddress peeraddr;
+    int connfd;
+    while((connfd = socket_.Accept(peeraddr)) > 0)
     {
-      std::cout<<"new connection from Ip:"<<inet_ntoa(peeraddr.sin_addr)<<":"<<ntohs(peeraddr.sin_port)<<std::endl;
-      if(++conncount_ > MAX_CONNECTIONS) {
+      std::cout<<"new connection from "<<peeraddr.ToString()<<std::endl;
+      if(conncount_ >= MAX_CONNECTIONS) {
         std::cerr << "Max connections reached, closing new connection." << std::endl;
         close(connfd);
         continue;
       }
-      SetNonBlocking(connfd); // 设置新连接为非阻塞
-      EventLoop* loop = threadpool_.GetNextLoop();
-      auto conn = std::make_shared<TcpConnection>(loop, connfd, peeraddr);
-      conn->SetMessageCallBack(std::move(messagecallback_));
-      conn->SetSendCompleteCallBack(std::move(sendcompletecallback_));
-      conn->SetCloseCallBack(std::move(closecallback_));
-      conn->SetErrorCallBack(std::move(errorcallback_));
-      conn->SetConnectionCleanup(std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1));
-      {
-        std::lock_guard<std::mutex> lock(connmap_mutex_);
-        connmap_[connfd] = conn; // 添加到连接映射表
+      if (options_.memorylimit > 0 && BufferMemory() > options_.memorylimit) {
+        std::cerr << "Memory limit reached, closing new connection." << std::endl;
+        close(connfd);
+        ++refused_;
+        continue;
       }
-      newconnectioncallback_(conn); // 调用新连接回调
-      conn->AddChannelToLoop(); // 将连接的事件添加到对应的事件循环中
-
+      ++conncount_;
+      if (!options_.inheritoptions) {
+        Socket::SetConnectionOption(connfd, options_, socket_.Family());
+      }
+      TRACE2(accept, socket_.fd(), connfd);
+      NewConnection(connfd, peeraddr);
+    }
+}
+void TcpServer::OnListenerConnection(Listener* listener) {
+    SockAddress peeraddr;
+    int connfd;
+    while ((connfd = listener->socket_.Accept(peeraddr)) > 0) {
+      if (conncount_ >= MAX_CONNECTIONS ||
+          (listener->maxconnections_ > 0 && listener->stats_.connections >= listener->maxconnections_)) {
+        close(connfd);
+        ++listener->stats_.rejected;
+        continue;
+      }
+      if (options_.memorylimit > 0 && BufferMemory() > options_.memorylimit) {
+        close(connfd);
+        ++refused_;
+        continue;
+      }
+      ++conncount_;
+      ++listener->stats_.connections;
+      ++listener->stats_.accepted;
+      if (!listener->options_.inheritoptions) {
+        Socket::SetConnectionOption(connfd, listener->options_, listener->socket_.Family());
+      }
+      TRACE2(accept, listener->socket_.fd(), connfd);
+      NewConnection(connfd, peeraddr, listener);
+    }
+}
+TcpServer::TcpConnectionPtr TcpServer::NewConnection(int connfd, const SockAddress& peeraddr, Listener* listener) {
+    EventLoop* loop = threadpool_.GetNextLoop();
+    auto conn = std::make_shared<TcpConnection>(loop, connfd, peeraddr);
+    const ServerOptions& options = listener ? listener->options_ : options_;
+    const std::shared_ptr<TlsContext>& tlscontext = listener ? listener->tlscontext_ : tlscontext_;
+    const std::shared_ptr<CompressContext>& compresscontext = listener ? listener->compresscontext_ : compresscontext_;
+    const ConnectionCallback& readycallback = listener ? listener->readycallback_ : readycallback_;
+    if (listener) {
+        conn->SetMessageCallBack(TcpConnection::MessageCallBack(listener->messagecallback_));
+        conn->SetSendCompleteCallBack(TcpConnection::CallBack(listener->sendcompletecallback_));
+        conn->SetCloseCallBack(TcpConnection::CallBack(listener->closecallback_));
+        conn->SetErrorCallBack(TcpConnection::CallBack(listener->errorcallback_));
+        conn->SetConnectionCleanup(std::bind(&TcpServer::RemoveListenerConnection, this, listener, std::placeholders::_1));
+        conn->SetPriority(listener->priority_);
+        conn->SetDetachable(false);
+    } else {
+        if (handlers_) {
+            conn->SetHandlerTable(&handlers_->connection);
+        } else {
+            //回调每个连接都要用，只能拷贝
+            conn->SetMessageCallBack(TcpConnection::MessageCallBack(messagecallback_));
+            conn->SetSendCompleteCallBack(TcpConnection::CallBack(sendcompletecallback_));
+            conn->SetCloseCallBack(TcpConnection::CallBack(closecallback_));
+            conn->SetErrorCallBack(TcpConnection::CallBack(errorcallback_));
+        }
+        conn->SetConnectionCleanup(std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1));
+    }
+    conn->SetAutoCork(options.autocork);
+    if (capture_) {
+        conn->EnableCapture(capture_.get());
+    }
+    if (compresscontext) {
+        conn->EnableCompression(compresscontext.get());
     }
+    if (tlscontext) {
+        conn->EnableTls(tlscontext.get());
+    } else if (options.zerocopythreshold > 0) {
+        conn->EnableZeroCopy(options.zerocopythreshold);
+    }
+    // 登记到所属loop的连接分片，排在注册channel之前，连接上的任何事件都晚于登记
+    loop->AddTask(std::bind(&EventLoop::AddConnection, loop, conn));
+    if (listener) {
+        if (listener->newconnectioncallback_) {
+            listener->newconnectioncallback_(conn);
+        }
+    } else if (handlers_) {
+        handlers_->newconnection(handlers_->connection.owner, conn);
+    } else {
+        newconnectioncallback_(conn); // 调用新连接回调
+    }
+    conn->AddChannelToLoop(); // 将连接的事件添加到对应的事件循环中
+    if (readycallback) {
+        // 排在注册channel的任务之后
+        loop->AddTask(std::bind(readycallback, conn));
+    }
+    return conn;
 }
 void TcpServer::RemoveConnection(const TcpConnectionPtr& conn) {
-    std::lock_guard<std::mutex> lock(connmap_mutex_);
-    --conncount_;
-    connmap_.erase(conn->fd()); // 从连接映射表中移除
+    //清理任务在连接所属的IO线程执行
+    EventLoop* loop = conn->GetLoop();
+    TRACE1(conn_close, conn->fd());
+    loop->RemoveConnection(conn);
+    LeaveGroups(loop, conn.get());
+    CheckDrained(loop);
+    if (--conncount_ == 0 && draining_) {
+        // 热升级后剩余连接都已处理完，旧进程退出
+        std::cout << "Hot upgrade: all connections drained, quitting." << std::endl;
+        loop_->quit();
+        loop_->wakeup();
+    }
+}
+void TcpServer::RemoveListenerConnection(Listener* listener, const TcpConnectionPtr& conn) {
+    --listener->stats_.connections;
+    RemoveConnection(conn);
+}
+void TcpServer::HandOver(int sock) {
+    std::cout << "Hot upgrade: handing over listening socket " << socket_.fd() << std::endl;
+    if (!HotUpgrade::SendFd(sock, HotUpgrade::UPGRADE_LISTENER, socket_.fd(), NULL, std::string())) {
+        OnListenerAck(sock, false);
+        return;
+    }
+    //确认在主loop上异步等待，等待期间照常accept和处理管理端口、定时任务
+    upgrade_->WaitAck(sock, std::bind(&TcpServer::OnListenerAck, this, sock, std::placeholders::_1));
+}
+void TcpServer::OnListenerAck(int sock, bool acked) {
+    if (!acked) {
+        //新进程没有确认接管，连接都还在本进程，继续提供服务，等待下一次升级
+        std::cerr << "Hot upgrade: successor did not acknowledge, keep serving." << std::endl;
+        close(sock);
+        upgrade_->Listen(std::bind(&TcpServer::HandOver, this, std::placeholders::_1));
+        return;
+    }
+    //新进程已经在同一个监听socket上accept，旧进程停止accept；socket先不关，交接失败时还能恢复
+    loop_->RemoveChannelFromPoller(&acceptchannel_);
+    std::vector<EventLoop*> loops = threadpool_.GetAllLoops();
+    std::shared_ptr<HandOverState> state(new HandOverState());
+    state->sock = sock;
+    state->pending = handoverconns_ ? loops.size() : 0;
+    state->failed = false;
+    state->restored = 0;
+    if (state->pending == 0) {
+        FinishHandOver(state);
+        return;
+    }
+    //连接只能在自己的IO线程里摘下，摘下的连接再回到主loop发给新进程，主loop不等待
+    for (auto &loop : loops) {
+        loop->AddTask(std::bind(&TcpServer::DetachInLoop, this, loop, state));
+    }
+}
+void TcpServer::DetachInLoop(EventLoop* loop, const std::shared_ptr<HandOverState>& state) {
+    std::vector<HotUpgrade::InheritedConnection> detached;
+    std::vector<TcpConnectionPtr> detachlist;
+    for (auto &item : loop->GetConnections()) {
+        detachlist.push_back(item.second);
+    }
+    for (auto &conn : detachlist) {
+        HotUpgrade::InheritedConnection inheritedconn;
+        inheritedconn.fd = conn->Detach(inheritedconn.unread);
+        if (inheritedconn.fd >= 0) {
+            inheritedconn.peeraddr = conn->GetPeerAddr();
+            detached.push_back(inheritedconn);
+        }
+    }
+    loop_->AddTask(std::bind(&TcpServer::SendConnections, this, state, detached));
+}
+void TcpServer::SendConnections(const std::shared_ptr<HandOverState>& state, std::vector<HotUpgrade::InheritedConnection>& conns) {
+    for (auto &conn : conns) {
+        if (!state->failed && HotUpgrade::SendFd(state->sock, HotUpgrade::UPGRADE_CONNECTION, conn.fd, &conn.peeraddr, conn.unread)) {
+            state->sent.push_back(conn);
+        } else {
+            //新进程已不可用，之后的连接都留在本进程
+            state->failed = true;
+            RestoreConnection(conn);
+            ++state->restored;
+        }
+    }
+    if (--state->pending == 0) {
+        FinishHandOver(state);
+    }
+}
+void TcpServer::RestoreConnection(HotUpgrade::InheritedConnection& conn) {
+    //与继承来的连接走同一条路径
+    ++conncount_;
+    NewConnection(conn.fd, conn.peeraddr)->AdoptReadBuffer(conn.unread);
+}
+void TcpServer::FinishHandOver(const std::shared_ptr<HandOverState>& state) {
+    if (state->failed || !HotUpgrade::SendFd(state->sock, HotUpgrade::UPGRADE_END, -1, NULL, std::string())) {
+        OnEndAck(state, false);
+        return;
+    }
+    upgrade_->WaitAck(state->sock, std::bind(&TcpServer::OnEndAck, this, state, std::placeholders::_1));
+}
+void TcpServer::OnEndAck(const std::shared_ptr<HandOverState>& state, bool acked) {
+    //新进程确认收到了所有连接才关闭本进程的副本，否则发出去的连接也接回来，本进程恢复accept
+    if (!acked) {
+        for (auto &conn : state->sent) {
+            RestoreConnection(conn);
+            ++state->restored;
+        }
+        close(state->sock);
+        std::cerr << "Hot upgrade: successor failed during handover, " << state->restored << " connections kept, keep serving." << std::endl;
+        loop_->AddChannelToPoller(&acceptchannel_);
+        upgrade_->Listen(std::bind(&TcpServer::HandOver, this, std::placeholders::_1));
+        return;
+    }
+    for (auto &conn : state->sent) {
+        close(conn.fd);
+    }
+    close(state->sock);
+    if (handoverconns_) {
+        std::cout << "Hot upgrade: handed over " << state->sent.size() << " idle connections" << std::endl;
+    }
+    //附加监听没有交接，关掉后新进程才能独占它们的端口
+    for (auto &listener : listeners_) {
+        if (listener->listening_) {
+            loop_->RemoveChannelFromPoller(&listener->acceptchannel_);
+            listener->socket_.Close();
+            listener->listening_ = false;
+        }
+    }
+    //摘下的连接都已交出，此后连接数归零即可退出
+    draining_ = true;
+    if (conncount_ == 0) {
+        loop_->quit();
+    }
+}
+EventLoop::LoopStats TcpServer::GetLoopStats() {
+    EventLoop::LoopStats total;
+    for (auto &loop : threadpool_.GetLoopRefs()) {
+        const EventLoop::LoopStats& stats = loop->GetStats();
+        total.iterations += stats.iterations;
+        total.corkedsends += stats.corkedsends;
+        total.corkflushes += stats.corkflushes;
+        total.zerocopy.sends += stats.zerocopy.sends;
+        total.zerocopy.completions += stats.zerocopy.completions;
+        total.zerocopy.copied += stats.zerocopy.copied;
+        total.slowevents += stats.slowevents;
+        total.slowtasks += stats.slowtasks;
+        total.maxcallbackus = std::max(total.maxcallbackus, stats.maxcallbackus);
+        total.longtaskqueues += stats.longtaskqueues;
+        total.maxtaskqueue = std::max(total.maxtaskqueue, stats.maxtaskqueue);
+        total.stalls += loop->StallCount();
+        total.buffershrinks += stats.buffershrinks;
+        total.shedconnections += stats.shedconnections;
+        total.migrations += stats.migrations;
+        total.iodelay.Merge(stats.iodelay);
+        total.taskdelay.Merge(stats.taskdelay);
+        total.deferredevents += stats.deferredevents;
+        total.deferredtasks += stats.deferredtasks;
+    }
+    return total;
+}
+size_t TcpServer::BufferMemory() {
+    size_t total = 0;
+    for (auto &loop : threadpool_.GetLoopRefs()) {
+        total += loop->BufferMemory();
+    }
+    return total;
+}
+BufferPool::Stats TcpServer::BufferPoolStats() {
+    BufferPool::Stats total;
+    for (auto &loop : threadpool_.GetLoopRefs()) {
+        BufferPool::Stats stats = loop->GetBufferPool()->GetStats();
+        total.mapped += stats.mapped;
+        total.hugemapped += stats.hugemapped;
+        total.inuse += stats.inuse;
+        total.remotefrees += stats.remotefrees;
+    }
+    return total;
+}
+TcpServer::SubscriberShard* TcpServer::FindShard(EventLoop* loop) {
+    std::lock_guard<std::mutex> lock(subscribersmutex_);
+    auto it = subscribers_.find(loop);
+    return it == subscribers_.end() ? nullptr : it->second.get();
+}
+std::vector<std::string> TcpServer::LeaveGroups(EventLoop* loop, TcpConnection* conn) {
+    std::vector<std::string> groups;
+    SubscriberShard* shard = FindShard(loop);
+    if (!shard) {
+        return groups;
+    }
+    auto membership = shard->memberships.find(conn);
+    if (membership == shard->memberships.end()) {
+        return groups;
+    }
+    for (auto &group : membership->second) {
+        auto members = shard->groups.find(group);
+        members->second.erase(conn);
+        if (members->second.empty()) {
+            shard->groups.erase(members);
+        }
+    }
+    groups.swap(membership->second);
+    shard->memberships.erase(membership);
+    return groups;
+}
+void TcpServer::CheckDrained(EventLoop* loop) {
+    if (loop->ConnectionCount() == 0 && loop->IncomingConnections() == 0 && threadpool_.IsDraining(loop)) {
+        // 正在排空的loop上最后一个连接关闭或迁走，移除该loop
+        threadpool_.RemoveLoop(loop);
+    }
+}
+void TcpServer::MigrateConnection(const TcpConnectionPtr& conn, EventLoop* target) {
+    EventLoop* loop = conn->GetLoop();
+    if (loop->GetThreadId() == std::this_thread::get_id()) {
+        MigrateInLoop(conn, target);
+    } else {
+        loop->AddTask(std::bind(&TcpServer::MigrateInLoop, this, conn, target));
+    }
+}
+void TcpServer::MigrateInLoop(const TcpConnectionPtr& conn, EventLoop* target) {
+    EventLoop* loop = conn->GetLoop();
+    if (!conn->InLoopThread()) {
+        //投递之后连接已经迁到了别处
+        loop->AddTask(std::bind(&TcpServer::MigrateInLoop, this, conn, target));
+        return;
+    }
+    if (target == loop) {
+        return;
+    }
+    //先登记迁入再检查target：检查通过后target即使开始排空，也要等这个连接登记后才会移除
+    target->AddIncoming(1);
+    if (!conn->Migratable() || !threadpool_.IsActive(target)) {
+        target->AddIncoming(-1);
+        CheckDrained(target);
+        return;
+    }
+    std::vector<std::string> groups = LeaveGroups(loop, conn.get());
+    loop->RemoveConnection(conn);
+    conn->DetachFromLoop(target);
+    ++loop->GetStats().migrations;
+    target->AddTask(std::bind(&TcpServer::AttachInLoop, this, conn, groups));
+    CheckDrained(loop);
+}
+void TcpServer::AttachInLoop(const TcpConnectionPtr& conn, const std::vector<std::string>& groups) {
+    EventLoop* loop = conn->GetLoop();
+    loop->AddConnection(conn);
+    conn->AttachToLoop();
+    for (auto &group : groups) {
+        SubscribeInLoop(group, conn);
+    }
+    loop->AddIncoming(-1);
+}
+void TcpServer::SampleUtilization(std::unordered_map<EventLoop*, int64_t>& lastbusy, int64_t& lasttime,
+                                  std::vector<std::pair<EventLoop*, double> >& utilization) {
+    int64_t now = LoopWatchdog::Now();
+    int64_t elapsed = now - lasttime;
+    lasttime = now;
+    std::unordered_map<EventLoop*, int64_t> busy;
+    for (auto &loop : threadpool_.GetAllLoops()) {
+        busy[loop] = loop->BusyTime();
+        auto last = lastbusy.find(loop);
+        if (last == lastbusy.end() || elapsed <= 0 || !threadpool_.IsActive(loop)) {
+            continue; //刚加入的loop没有完整周期的数据，排空中的loop不参与
+        }
+        utilization.push_back(std::make_pair(loop, static_cast<double>(busy[loop] - last->second) / elapsed));
+    }
+    lastbusy.swap(busy);
+}
+void TcpServer::Rebalance() {
+    std::vector<std::pair<EventLoop*, double> > utilization;
+    SampleUtilization(rebalancebusy_, lastrebalance_, utilization);
+    if (utilization.empty()) {
+        return;
+    }
+    std::sort(utilization.begin(), utilization.end(),
+        [](const std::pair<EventLoop*, double>& a, const std::pair<EventLoop*, double>& b) {
+            return a.second < b.second;
+        });
+    //排空中的loop：连接全部迁到较闲的一半loop上，不必等连接自己关闭
+    std::vector<EventLoop*> targets;
+    for (size_t i = 0; i < (utilization.size() + 1) / 2; ++i) {
+        targets.push_back(utilization[i].first);
+    }
+    for (auto &loop : threadpool_.GetAllLoops()) {
+        if (loop->ConnectionCount() > 0 && threadpool_.IsDraining(loop)) {
+            loop->AddTask(std::bind(&TcpServer::RebalanceLoop, this, loop, targets, 1.0));
+        }
+    }
+    //热点loop：迁走一部分流量，让它和最闲的loop利用率拉平
+    const std::pair<EventLoop*, double>& coolest = utilization.front();
+    const std::pair<EventLoop*, double>& hottest = utilization.back();
+    if (hottest.second > REBALANCE_HIGH && hottest.second - coolest.second > REBALANCE_GAP) {
+        double fraction = (hottest.second - coolest.second) / 2 / hottest.second;
+        hottest.first->AddTask(std::bind(&TcpServer::RebalanceLoop, this, hottest.first,
+            std::vector<EventLoop*>(1, coolest.first), fraction));
+    }
+}
+void TcpServer::RebalanceLoop(EventLoop* loop, std::vector<EventLoop*> targets, double fraction) {
+    std::vector<std::pair<uint64_t, TcpConnectionPtr> > conns;
+    uint64_t total = 0;
+    for (auto &item : loop->GetConnections()) {
+        uint64_t traffic = item.second->TakeTraffic();
+        total += traffic;
+        conns.push_back(std::make_pair(traffic, item.second));
+    }
+    std::sort(conns.begin(), conns.end(),
+        [](const std::pair<uint64_t, TcpConnectionPtr>& a, const std::pair<uint64_t, TcpConnectionPtr>& b) {
+            return a.first > b.first;
+        });
+    bool drain = fraction >= 1.0;
+    uint64_t budget = static_cast<uint64_t>(total * fraction);
+    uint64_t moved = 0;
+    size_t count = 0;
+    for (auto &item : conns) {
+        if (!drain && (count >= REBALANCE_MAX_MOVES || moved >= budget)) {
+            break;
+        }
+        //剩余份额是两边差距的一半，单个连接的流量超过差距时迁过去两边差得更多，只是换个loop变热，跳过
+        if (!drain && item.first >= 2 * (budget - moved)) {
+            continue;
+        }
+        if (!item.second->Migratable()) {
+            continue;
+        }
+        MigrateInLoop(item.second, targets[count % targets.size()]);
+        moved += item.first;
+        ++count;
+    }
+    if (count > 0) {
+        std::cout << "Rebalance: migrated " << count << " connections carrying " << moved << " of " << total
+                  << " bytes off a " << (drain ? "draining" : "hot") << " loop" << std::endl;
+    }
+}
+EventLoop* TcpServer::AddLoop() {
+    return threadpool_.AddLoop();
+}
+EventLoop* TcpServer::DrainLoop() {
+    EventLoop* loop = threadpool_.DrainLoop();
+    if (loop) {
+        // 没有连接时直接移除，否则等最后一个连接关闭
+        threadpool_.RemoveLoop(loop);
+    }
+    return loop;
+}
+void TcpServer::OnLoopAdded(EventLoop* loop) {
+    {
+        std::lock_guard<std::mutex> lock(subscribersmutex_);
+        subscribers_[loop].reset(new SubscriberShard());
+    }
+    if (options_.stallms > 0) {
+        loop->AddTask(std::bind(&EventLoop::EnableStallDetection, loop,
+            options_.callbackbudgetus, options_.stallms, options_.taskqueuelimit));
+    }
+    if (options_.maxloops > 0 || options_.rebalancems > 0) {
+        loop->AddTask(std::bind(&EventLoop::EnableBusyTime, loop));
+    }
+    if (options_.scheduling) {
+        loop->AddTask(std::bind(&EventLoop::EnableScheduling, loop, options_.iosliceus, options_.tasksliceus));
+    }
+    if (options_.hugepages) {
+        loop->AddTask(std::bind(&BufferPool::EnableHugePages, loop->GetBufferPool()));
+    }
+}
+void TcpServer::OnLoopRemoved(EventLoop* loop) {
+    std::lock_guard<std::mutex> lock(subscribersmutex_);
+    subscribers_.erase(loop);
+}
+void TcpServer::AutoScale() {
+    std::vector<std::pair<EventLoop*, double> > samples;
+    SampleUtilization(lastbusy_, lastscale_, samples);
+    int active = static_cast<int>(samples.size());
+    if (active == 0 || active != threadpool_.ActiveLoopCount()) {
+        return; //上次伸缩后的第一个周期只记录基线
+    }
+    double utilization = 0;
+    for (auto &sample : samples) {
+        utilization += sample.second;
+    }
+    utilization /= active;
+    if (utilization > AUTOSCALE_HIGH && active < options_.maxloops) {
+        EventLoop* loop = AddLoop();
+        if (loop) {
+            std::cout << "AutoScale: utilization " << utilization << ", added loop, " << active + 1 << " active" << std::endl;
+        }
+    } else if (utilization < AUTOSCALE_LOW && active > std::max(options_.minloops, 1)) {
+        EventLoop* loop = DrainLoop();
+        if (loop) {
+            std::cout << "AutoScale: utilization " << utilization << ", draining loop, " << active - 1 << " active" << std::endl;
+        }
+    }
+}
+void TcpServer::OnCaptureTimer() {
+    //连接在主loop建立，建立记录在主loop线程的缓冲里
+    TrafficCapture* capture = capture_.get();
+    loop_->AddTask(std::bind(&TrafficCapture::FlushLocal, capture));
+    for (auto &loop : threadpool_.GetLoopRefs()) {
+        loop->AddTask(std::bind(&TrafficCapture::FlushLocal, capture));
+    }
+}
+void TcpServer::OnSweepTimer() {
+    //检查间隔可能因内存上限缩短，按空闲时间折算成检查次数
+    bool shrinkidle = false;
+    if (options_.idleshrinkms > 0) {
+        uint64_t rounds = std::max(options_.idleshrinkms / sweeptimer_->timeout_, 1);
+        shrinkidle = ++sweeps_ % rounds == 0;
+    }
+    for (auto &loop : threadpool_.GetLoopRefs()) {
+        loop->AddTask(std::bind(&TcpServer::SweepLoop, this, loop.get(), shrinkidle));
+    }
+}
+void TcpServer::SweepLoop(EventLoop* loop, bool shrinkidle) {
+    EventLoop::LoopStats& stats = loop->GetStats();
+    if (shrinkidle) {
+        for (auto &item : loop->GetConnections()) {
+            TcpConnection* conn = item.second.get();
+            //上一轮检查以来没有读写的连接视为空闲
+            if (conn->TakeActive() || conn->MemoryUsage() == 0) {
+                continue;
+            }
+            size_t before = conn->MemoryUsage();
+            conn->ShrinkBuffers();
+            if (conn->MemoryUsage() < before) {
+                ++stats.buffershrinks;
+            }
+        }
+    }
+    if (options_.memorylimit == 0 || BufferMemory() <= options_.memorylimit) {
+        return;
+    }
+    //超过上限：每个loop把自己的用量降到上限的平均份额以内，从占用最多的连接开始关闭
+    size_t share = options_.memorylimit / threadpool_.GetAllLoops().size(); //只取数量，不访问loop
+    size_t memory = loop->BufferMemory();
+    if (memory <= share) {
+        return;
+    }
+    std::vector<TcpConnectionPtr> conns;
+    for (auto &item : loop->GetConnections()) {
+        if (item.second->MemoryUsage() > 0) {
+            conns.push_back(item.second);
+        }
+    }
+    std::sort(conns.begin(), conns.end(), [](const TcpConnectionPtr& a, const TcpConnectionPtr& b) {
+        return a->MemoryUsage() > b->MemoryUsage();
+    });
+    for (auto &conn : conns) {
+        if (memory <= share) {
+            break;
+        }
+        std::cerr << "Memory limit exceeded, closing connection from " << conn->GetPeerAddr().ToString()
+                  << " holding " << conn->MemoryUsage() << " bytes" << std::endl;
+        //缓冲在连接析构时才释放，先按连接的用量扣减
+        memory -= std::min(memory, conn->MemoryUsage());
+        conn->Shutdown();
+        ++stats.shedconnections;
+    }
+}
+void TcpServer::ForEachConnection(ConnectionCallback cb) {
+    for (auto &ref : threadpool_.GetLoopRefs()) {
+        EventLoop* loop = ref.get();
+        loop->AddTask([loop, cb]() {
+            //回调里可能关闭连接，先拷贝一份
+            std::vector<TcpConnectionPtr> conns;
+            conns.reserve(loop->GetConnections().size());
+            for (auto &item : loop->GetConnections()) {
+                conns.push_back(item.second);
+            }
+            for (auto &conn : conns) {
+                cb(conn);
+            }
+        });
+    }
+}
+void TcpServer::Broadcast(const std::string& message) {
+    Broadcast(SharedBuffer(new std::string(message)));
+}
+void TcpServer::Broadcast(const SharedBuffer& buffer) {
+    for (auto &ref : threadpool_.GetLoopRefs()) {
+        EventLoop* loop = ref.get();
+        loop->AddTask([loop, buffer]() {
+            std::vector<TcpConnectionPtr> conns;
+            conns.reserve(loop->GetConnections().size());
+            for (auto &item : loop->GetConnections()) {
+                conns.push_back(item.second);
+            }
+            for (auto &conn : conns) {
+                conn->Send(buffer);
+            }
+        });
+    }
+}
+void TcpServer::Subscribe(const std::string& group, const TcpConnectionPtr& conn) {
+    EventLoop* loop = conn->GetLoop();
+    if (loop->GetThreadId() == std::this_thread::get_id()) {
+        SubscribeInLoop(group, conn);
+    } else {
+        loop->AddTask(std::bind(&TcpServer::SubscribeInLoop, this, group, conn));
+    }
+}
+void TcpServer::Unsubscribe(const std::string& group, const TcpConnectionPtr& conn) {
+    EventLoop* loop = conn->GetLoop();
+    if (loop->GetThreadId() == std::this_thread::get_id()) {
+        UnsubscribeInLoop(group, conn);
+    } else {
+        loop->AddTask(std::bind(&TcpServer::UnsubscribeInLoop, this, group, conn));
+    }
+}
+void TcpServer::SubscribeInLoop(const std::string& group, const TcpConnectionPtr& conn) {
+    if (!conn->InLoopThread()) {
+        //投递之后连接迁移到了其他loop
+        conn->GetLoop()->AddTask(std::bind(&TcpServer::SubscribeInLoop, this, group, conn));
+        return;
+    }
+    if (conn->Disconnected()) {
+        return; //已经清理过的连接不能再加入，否则不会再被移除
+    }
+    SubscriberShard* shard = FindShard(conn->GetLoop());
+    if (!shard) {
+        return; //loop正在移除，分片已经删除
+    }
+    if (shard->groups[group].insert(std::make_pair(conn.get(), conn)).second) {
+        shard->memberships[conn.get()].push_back(group);
+    }
+}
+void TcpServer::UnsubscribeInLoop(const std::string& group, const TcpConnectionPtr& conn) {
+    if (!conn->InLoopThread()) {
+        conn->GetLoop()->AddTask(std::bind(&TcpServer::UnsubscribeInLoop, this, group, conn));
+        return;
+    }
+    SubscriberShard* shard = FindShard(conn->GetLoop());
+    if (!shard) {
+        return;
+    }
+    auto members = shard->groups.find(group);
+    if (members == shard->groups.end() || members->second.erase(conn.get()) == 0) {
+        return;
+    }
+    if (members->second.empty()) {
+        shard->groups.erase(members);
+    }
+    std::vector<std::string>& groups = shard->memberships[conn.get()];
+    for (auto it = groups.begin(); it != groups.end(); ++it) {
+        if (*it == group) {
+            groups.erase(it);
+            break;
+        }
+    }
+    if (groups.empty()) {
+        shard->memberships.erase(conn.get());
+    }
+}
+void TcpServer::Publish(const std::string& group, const std::string& message) {
+    Publish(group, SharedBuffer(new std::string(message)));
+}
+void TcpServer::Publish(const std::string& group, const SharedBuffer& buffer) {
+    //持锁投递：分片删除时loop还没有从线程池摘下，这里取到的loop都还活着
+    std::lock_guard<std::mutex> lock(subscribersmutex_);
+    for (auto &item : subscribers_) {
+        item.first->AddTask(std::bind(&TcpServer::PublishInLoop, this, item.first, group, buffer));
+    }
+}
+void TcpServer::PublishInLoop(EventLoop* loop, const std::string& group, const SharedBuffer& buffer) {
+    //投递之后分片可能已随loop移除而删除，在loop线程里重新查找
+    SubscriberShard* shard = FindShard(loop);
+    if (!shard) {
+        return;
+    }
+    auto members = shard->groups.find(group);
+    if (members == shard->groups.end()) {
+        return;
+    }
+    //发送失败会清理连接并修改组，先拷贝一份
+    std::vector<TcpConnectionPtr> conns;
+    conns.reserve(members->second.size());
+    for (auto &item : members->second) {
+        conns.push_back(item.second);
+    }
+    for (auto &conn : conns) {
+        conn->Send(buffer);
+    }
 }
 void TcpServer::OnConnectionError() {
     std::cout << "Connection error occurred." << std::endl;
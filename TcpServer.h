@@ -2,27 +2,146 @@
 #define _TCPSERVER_H_
 #include <functional>
 #include <string>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 #include <mutex>
 #include "Socket.h"
+#include "ServerOptions.h"
 #include "Channel.h"
 #include "EventLoop.h"
 #include "EventLoopThreadPool.h"
 #include "TcpConnection.h"
+#include "HotUpgrade.h"
+#include "SockAddress.h"
+#include "TlsContext.h"
+#include "CompressContext.h"
+#include "Timer.h"
+#include "TrafficCapture.h"
 #define MAX_CONNECTIONS 20000
 class TcpServer {
 public:
   typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
   typedef std::function<void(const TcpConnectionPtr&)> ConnectionCallback;
   typedef std::function<void(const TcpConnectionPtr&,std::string&)> MessageCallback;
-  TcpServer(EventLoop* loop,const int port,const int threadnum=0);
+  typedef TcpConnection::SharedBuffer SharedBuffer;
+  //编译期确定的回调表，见BasicTcpServer；connection表交给每个连接，newconnection在accept线程调用
+  struct HandlerTable {
+    TcpConnection::HandlerTable connection;
+    void (*newconnection)(void* owner, const TcpConnectionPtr&);
+  };
+  //附加监听：与主监听共用同一组IO线程，有自己的地址、socket选项、回调、TLS/压缩和连接数上限，由AddListener创建，随服务器析构
+  //socket选项和autocork、zerocopythreshold取自自己的options，loop相关的选项（卡顿检测、调度、伸缩、内存上限）以服务器的为准
+  //消息回调必须设置；热升级只交接主监听和它的空闲连接，附加监听要在新进程里再次绑定，需开启reuseport
+  class Listener {
+  public:
+    //统计，计数由主loop和各IO线程更新
+    struct Stats {
+      std::atomic<uint64_t> accepted;//接受的连接数
+      std::atomic<uint64_t> rejected;//超过连接数上限关闭的连接数
+      std::atomic<int> connections;//当前连接数
+      Stats() : accepted(0), rejected(0), connections(0) {}
+    };
+    const std::string& GetName() const { return name_; }
+    const SockAddress& GetAddress() const { return listenaddr_; }
+    Stats& GetStats() { return stats_; }
+    //连接数上限，0为只受服务器总上限限制
+    void SetMaxConnections(int maxconnections) { maxconnections_ = maxconnections; }
+    //新连接在loop调度里的优先级，见Channel::Priority
+    void SetConnectionPriority(int priority) { priority_ = priority; }
+    //开启TLS或压缩，只对之后接受的连接生效
+    void EnableTls(const std::shared_ptr<TlsContext>& context) { tlscontext_ = context; }
+    void EnableCompression(const std::shared_ptr<CompressContext>& context) { compresscontext_ = context; }
+    void SetNewConnectionCallback(ConnectionCallback cb) { newconnectioncallback_ = cb; }
+    void SetConnectionReadyCallback(ConnectionCallback cb) { readycallback_ = cb; }
+    void SetMessageCallback(MessageCallback cb) { messagecallback_ = cb; }
+    void SetSendCompleteCallback(ConnectionCallback cb) { sendcompletecallback_ = cb; }
+    void SetCloseCallback(ConnectionCallback cb) { closecallback_ = cb; }
+    void SetErrorCallback(ConnectionCallback cb) { errorcallback_ = cb; }
+  private:
+    friend class TcpServer;
+    Listener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options);
+    Listener(const Listener&) = delete;
+    Listener& operator=(const Listener&) = delete;
+    std::string name_;
+    SockAddress listenaddr_;
+    ServerOptions options_;
+    Socket socket_;
+    Channel acceptchannel_;
+    bool listening_;//socket已经开始监听
+    int maxconnections_;
+    int priority_;
+    std::shared_ptr<TlsContext> tlscontext_;
+    std::shared_ptr<CompressContext> compresscontext_;
+    ConnectionCallback newconnectioncallback_;
+    ConnectionCallback readycallback_;
+    MessageCallback messagecallback_;
+    ConnectionCallback sendcompletecallback_;
+    ConnectionCallback closecallback_;
+    ConnectionCallback errorcallback_;
+    Stats stats_;
+  };
+  TcpServer(EventLoop* loop,const int port,const int threadnum=0,const ServerOptions& options=ServerOptions());
+  //监听任意类型的地址：IPv4、IPv6、Unix域路径或抽象命名空间，连接都走同一套TcpConnection
+  TcpServer(EventLoop* loop,const SockAddress& listenaddr,const int threadnum=0,const ServerOptions& options=ServerOptions());
   ~TcpServer();
   //启动服务器
   void Start();
+  //增加一个附加监听，设置好回调后随Start开始监听；Start之后增加的立即开始监听，须在主loop线程调用
+  Listener* AddListener(const std::string& name, const SockAddress& listenaddr, const ServerOptions& options = ServerOptions());
+  //所有附加监听，按增加的顺序
+  std::vector<Listener*> GetListeners();
+  //服务器所在的主loop
+  EventLoop* GetLoop() const { return loop_; }
+  //开启热升级，path为新旧进程交接用的Unix域socket路径，handoverconns为true时空闲连接也一并交接，须在Start之前调用
+  void EnableHotUpgrade(const std::string& path, bool handoverconns = false);
+  //开启TLS，之后接受的连接都先做TLS握手，须在Start之前调用
+  void EnableTls(const std::shared_ptr<TlsContext>& context) { tlscontext_ = context; }
+  //开启压缩，之后接受的连接按CompressStream的帧格式收发，须在Start之前调用
+  void EnableCompression(const std::shared_ptr<CompressContext>& context) { compresscontext_ = context; }
+  //开启流量录制，之后接受的连接收发的数据都写进path，文件不超过maxbytes，须在Start之前调用，打不开文件时返回false
+  bool EnableCapture(const std::string& path, size_t maxbytes);
+  //IO线程池，其他服务（如UdpServer）可以共用同一组IO线程
+  EventLoopThreadPool* GetThreadPool() { return &threadpool_; }
+  //当前连接数
+  int ConnectionCount() const { return conncount_.load(); }
+  //所有IO线程的loop统计之和（最大值类统计取各线程的最大值），计数由各IO线程更新，这里读到的是近似值
+  EventLoop::LoopStats GetLoopStats();
+  //所有连接的读缓冲和发送队列占用的内存，各IO线程计数之和
+  size_t BufferMemory();
+  //所有IO线程的缓冲池统计之和
+  BufferPool::Stats BufferPoolStats();
+  //超过内存上限时拒绝的新连接数
+  uint64_t RefusedConnections() const { return refused_.load(); }
+  //运行中新增一个IO线程，新连接随即开始分到它上面，返回它的loop，只有主loop时返回空
+  EventLoop* AddLoop();
+  //排空一个IO线程：不再分到新连接，现有连接全部关闭后移除，返回它的loop，至少保留一个IO线程，不能排空时返回空
+  //须在主loop线程调用，与分发新连接串行，保证排空之前分到它上面的连接已经登记
+  EventLoop* DrainLoop();
+  //把连接迁移到target：在连接所属的IO线程里摘下channel和缓冲，再到target上注册，订阅组随之迁移，调用即返回
+  //连接不在静止点（见TcpConnection::Migratable）、target不是可分配的loop或就是当前loop时不迁移
+  void MigrateConnection(const TcpConnectionPtr& conn, EventLoop* target);
+  //遍历所有连接：每个IO线程在自己的loop里遍历自己的连接分片，不会停下其他线程
+  //cb在连接所属的IO线程执行，调用即返回，不等待遍历完成
+  void ForEachConnection(ConnectionCallback cb);
+  //广播：消息只构造一份共享缓冲，每个IO线程一个任务，把缓冲挂到本loop所有连接的发送队列上
+  void Broadcast(const std::string& message);
+  void Broadcast(const SharedBuffer& buffer);
+  //订阅组：组成员按loop分片保存，只在连接所属的IO线程里增删，连接关闭时自动退出所有组，须在Start之后调用
+  void Subscribe(const std::string& group, const TcpConnectionPtr& conn);
+  void Unsubscribe(const std::string& group, const TcpConnectionPtr& conn);
+  //向组内所有连接发送，每个IO线程一个任务
+  void Publish(const std::string& group, const std::string& message);
+  void Publish(const std::string& group, const SharedBuffer& buffer);
   //设置新连接回调函数
   void SetNewConnectionCallback(ConnectionCallback cb){
     newconnectioncallback_=cb;
   }
+  //设置连接就绪回调函数：连接注册到IO线程之后在该IO线程调用，回调里可以直接收发数据
+  void SetConnectionReadyCallback(ConnectionCallback cb){
+    readycallback_=cb;
+  }
   //设置消息处理回调函数
   void SetMessageCallback(MessageCallback cb){
     messagecallback_=cb;
@@ -39,21 +158,95 @@ public:
   void SetErrorCallback(ConnectionCallback cb){
     errorcallback_=cb;
   }
+protected:
+  //设置回调表后不再使用Set*Callback设置的回调（连接就绪回调除外），表须比服务器存活更久，须在Start之前调用
+  void SetHandlerTable(const HandlerTable* table) {
+    handlers_ = table;
+  }
 private:
+  //一个loop上的订阅组分片，只在该loop线程访问
+  struct SubscriberShard {
+    std::unordered_map<std::string, std::unordered_map<TcpConnection*, TcpConnectionPtr> > groups; //组名到组内连接
+    std::unordered_map<TcpConnection*, std::vector<std::string> > memberships; //连接加入的组，关闭时退出
+  };
+  //热升级交接中的状态，只在主loop线程访问
+  struct HandOverState {
+    int sock; //与新进程通信的socket
+    size_t pending; //还没交回摘下连接的loop数
+    bool failed; //向新进程发送失败，之后的连接留在本进程
+    std::vector<HotUpgrade::InheritedConnection> sent; //已发给新进程的连接，收到最后的确认前不关闭
+    size_t restored; //重新接回本进程的连接数
+  };
   Socket socket_; //服务器套接字
+  SockAddress listenaddr_; //监听地址
+  ServerOptions options_; //socket调优选项
   EventLoop* loop_; //服务器所在的事件循环
   Channel acceptchannel_; //接受连接的事件
-  int conncount_;//连接数量统计
-  std::unordered_map<int,TcpConnectionPtr> connmap_; //连接映射表
-  std::mutex connmap_mutex_; //连接映射表的互斥量保护
+  std::vector<std::unique_ptr<Listener> > listeners_; //附加监听，只在主loop线程增加
+  bool started_; //已经调用过Start
+  std::atomic<int> conncount_;//连接数量统计，连接表分片保存在各自的EventLoop里
+  std::unique_ptr<TrafficCapture> capture_; //流量录制，未开启时为空；排在线程池之前，IO线程都退出后再析构
   EventLoopThreadPool threadpool_; //IO线程池
   ConnectionCallback newconnectioncallback_; //连接建立回调
+  ConnectionCallback readycallback_; //连接就绪回调
   MessageCallback messagecallback_; //消息处理回调
   ConnectionCallback sendcompletecallback_; //发送完成回调
   ConnectionCallback closecallback_; //连接关闭回调
   ConnectionCallback errorcallback_; //连接异常回调
+  const HandlerTable* handlers_; //编译期确定的回调表，为空时使用上面的回调
+  std::unique_ptr<HotUpgrade> upgrade_; //热升级，未开启时为空
+  bool handoverconns_; //热升级时是否交接空闲连接
+  std::shared_ptr<TlsContext> tlscontext_; //TLS上下文，未开启时为空
+  std::shared_ptr<CompressContext> compresscontext_; //压缩上下文，未开启时为空
+  std::atomic<bool> draining_; //已交出监听socket，等待剩余连接处理完后退出
+  std::unordered_map<EventLoop*, std::unique_ptr<SubscriberShard> > subscribers_; //每个loop的订阅组分片，随loop增删
+  std::mutex subscribersmutex_; //保护subscribers_的增删和查找，分片内容只在所属loop线程访问
+  std::atomic<uint64_t> refused_; //超过内存上限时拒绝的新连接数
+  std::unique_ptr<Timer> sweeptimer_; //定期释放空闲连接缓冲、检查内存上限，未开启时为空
+  uint64_t sweeps_; //检查次数，只在定时器线程访问
+  std::unique_ptr<Timer> scaletimer_; //定期按loop利用率扩缩容，未开启时为空
+  std::unordered_map<EventLoop*, int64_t> lastbusy_; //上次扩缩容检查时各loop的累计忙碌时间，只在主loop线程访问
+  int64_t lastscale_; //上次扩缩容检查的时间，单位ns
+  std::unique_ptr<Timer> rebalancetimer_; //定期迁移热点loop上的连接，未开启时为空
+  std::unordered_map<EventLoop*, int64_t> rebalancebusy_; //上次迁移检查时各loop的累计忙碌时间，只在主loop线程访问
+  int64_t lastrebalance_; //上次迁移检查的时间，单位ns
+  std::unique_ptr<Timer> capturetimer_; //定期刷新各线程的录制缓冲，未开启时为空
   void OnNewConnection();//服务器对新连接连接处理的函数
+  void OnListenerConnection(Listener* listener);//附加监听上的新连接，按它的连接数上限接受
+  void StartListener(Listener* listener);//附加监听的socket开始监听并注册到主loop
+  //创建连接并分发到IO线程，listener为空时是主监听上的连接
+  TcpConnectionPtr NewConnection(int connfd, const SockAddress& peeraddr, Listener* listener = nullptr);
+  void HandOver(int sock);//热升级：把监听socket交给新进程，在主loop上等待确认
+  void OnListenerAck(int sock, bool acked);//热升级：新进程确认收到监听socket后停止accept，再交接空闲连接
+  void DetachInLoop(EventLoop* loop, const std::shared_ptr<HandOverState>& state);//热升级：在IO线程摘下空闲连接，交回主loop发送
+  //热升级：在主loop把摘下的连接发给新进程，发送失败后剩下的连接重新接回本进程
+  void SendConnections(const std::shared_ptr<HandOverState>& state, std::vector<HotUpgrade::InheritedConnection>& conns);
+  void RestoreConnection(HotUpgrade::InheritedConnection& conn);//热升级：把摘下的连接重新接回本进程
+  void FinishHandOver(const std::shared_ptr<HandOverState>& state);//热升级：各loop都交回后发送结束消息，在主loop上等待确认
+  void OnEndAck(const std::shared_ptr<HandOverState>& state, bool acked);//热升级：确认后开始排空，没有确认时接回所有连接
   void RemoveConnection(const TcpConnectionPtr& conn);//移除TCP连接函数
+  void RemoveListenerConnection(Listener* listener, const TcpConnectionPtr& conn);//附加监听的连接数减一后移除连接
   void OnConnectionError();//连接异常处理函数
+  //查找loop的订阅分片，loop已移除时返回空；分片只在所属loop线程删除，须在该loop线程调用
+  SubscriberShard* FindShard(EventLoop* loop);
+  void SubscribeInLoop(const std::string& group, const TcpConnectionPtr& conn);
+  void UnsubscribeInLoop(const std::string& group, const TcpConnectionPtr& conn);
+  void PublishInLoop(EventLoop* loop, const std::string& group, const SharedBuffer& buffer);
+  void OnCaptureTimer();//定时器线程：让主loop和各IO线程把录制缓冲写进文件
+  void OnSweepTimer();//定时器线程：把检查任务投递到每个IO线程
+  void SweepLoop(EventLoop* loop, bool shrinkidle);//在IO线程释放空闲连接的缓冲，超过内存上限时关闭占用最多的连接
+  void OnLoopAdded(EventLoop* loop);//新loop：建订阅分片，按选项开启卡顿检测、忙碌时间统计、loop调度和大页缓冲池
+  void OnLoopRemoved(EventLoop* loop);//在被移除的loop线程里删除它的订阅分片
+  void AutoScale();//在主loop线程按上一个周期的平均利用率增删IO线程
+  //各可分配loop自上次采样以来的利用率，还没有基线的loop不在结果里，在主loop线程调用
+  void SampleUtilization(std::unordered_map<EventLoop*, int64_t>& lastbusy, int64_t& lasttime,
+                         std::vector<std::pair<EventLoop*, double> >& utilization);
+  void Rebalance();//在主loop线程挑出热点loop和排空中的loop，把迁移任务投递过去
+  //在loop线程按流量从大到小迁出连接，fraction为要迁走的流量比例，为1时迁走所有能迁的连接
+  void RebalanceLoop(EventLoop* loop, std::vector<EventLoop*> targets, double fraction);
+  void MigrateInLoop(const TcpConnectionPtr& conn, EventLoop* target);//在连接原来的loop线程摘下连接
+  void AttachInLoop(const TcpConnectionPtr& conn, const std::vector<std::string>& groups);//在新loop线程登记连接
+  std::vector<std::string> LeaveGroups(EventLoop* loop, TcpConnection* conn);//在loop线程让连接退出所有订阅组，返回退出的组
+  void CheckDrained(EventLoop* loop);//排空中的loop没有连接后移除
 };
 #endif // !_TCPSERVER_H_
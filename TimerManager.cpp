@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include "TimerManager.h"
+#include "Trace.h"
 TimerManager *TimerManager::instance_ = nullptr;
 std::mutex TimerManager::mutex_;
 TimerManager::GC TimerManager::gc;
@@ -139,6 +140,7 @@ void TimerManager::CheckTimeout()//执行当前slot的任务
         else
         {
             //可执行定时器任务
+            TRACE1(timer_expire, ptimer->timeout_);
             ptimer->cb_(); //注意：任务里不能把定时器自身给清理掉！！！我认为应该先移除再执行任务
             if(ptimer->type_ == Timer::TimerType::TIMER_ONCE)
             {
@@ -195,6 +197,10 @@ void TimerManager::CheckTick()
 
 void TimerManager::Start()
 {
+    //可能被多个组件调用，只启动一次
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(running_)
+        return;
     running_ = true;
     th_ = std::thread(&TimerManager::CheckTick, this);
 }
@@ -0,0 +1,64 @@
+#include "TlsContext.h"
+#include <iostream>
+#ifdef ENABLE_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#define TLS_SESSION_CACHE_SIZE 20480 //服务端会话缓存的会话数
+#define TLS_SESSION_TIMEOUT 3600 //会话有效期，单位s
+#define TLS_SESSION_ID_CONTEXT "MyNetServer"
+TlsContext::TlsContext() : ctx_(nullptr), stats_() {
+}
+TlsContext::~TlsContext() {
+  if (ctx_) {
+    SSL_CTX_free(ctx_);
+  }
+}
+bool TlsContext::Available() {
+  return true;
+}
+bool TlsContext::Init(const std::string& certfile, const std::string& keyfile, bool ktls) {
+  ctx_ = SSL_CTX_new(TLS_server_method());
+  if (!ctx_) {
+    ERR_print_errors_fp(stderr);
+    return false;
+  }
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  if (SSL_CTX_use_certificate_chain_file(ctx_, certfile.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx_, keyfile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    std::cerr << "TlsContext: failed to load " << certfile << " / " << keyfile << std::endl;
+    ERR_print_errors_fp(stderr);
+    SSL_CTX_free(ctx_);
+    ctx_ = nullptr;
+    return false;
+  }
+  long options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+  if (ktls) {
+    //握手后由OpenSSL把密钥交给内核（TCP_ULP "tls"），内核或OpenSSL不支持时继续在用户态加解密
+    options |= SSL_OP_ENABLE_KTLS;
+  }
+  SSL_CTX_set_options(ctx_, options);
+  //发送队列分段，重试时队首段的位置可能变化
+  SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+  //会话复用：TLS1.2的session id走服务端缓存，session ticket和TLS1.3的PSK用上下文里自动生成的ticket密钥
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_sess_set_cache_size(ctx_, TLS_SESSION_CACHE_SIZE);
+  SSL_CTX_set_timeout(ctx_, TLS_SESSION_TIMEOUT);
+  SSL_CTX_set_session_id_context(ctx_, reinterpret_cast<const unsigned char*>(TLS_SESSION_ID_CONTEXT),
+                                 sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+  std::cout << "TlsContext loaded " << certfile << (ktls ? " (kTLS enabled)" : "") << std::endl;
+  return true;
+}
+#else
+TlsContext::TlsContext() : ctx_(nullptr), stats_() {
+}
+TlsContext::~TlsContext() {
+}
+bool TlsContext::Available() {
+  return false;
+}
+bool TlsContext::Init(const std::string& certfile, const std::string& keyfile, bool ktls) {
+  std::cerr << "TlsContext: built without TLS support, reconfigure with -DENABLE_TLS=ON" << std::endl;
+  return false;
+}
+#endif
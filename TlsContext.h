@@ -0,0 +1,31 @@
+#ifndef _TLSCONTEXT_H_
+#define _TLSCONTEXT_H_
+//TLS服务端上下文：证书、私钥和会话缓存，所有IO线程共用一个
+//编译时打开ENABLE_TLS才会链接OpenSSL，否则Init总是失败
+#include <string>
+#include <atomic>
+#include <cstdint>
+struct ssl_ctx_st;
+class TlsContext {
+public:
+  //统计，由各IO线程更新
+  struct Stats {
+    std::atomic<uint64_t> handshakes;//完成的握手次数
+    std::atomic<uint64_t> resumed;//其中会话复用（session id或ticket）的次数
+    std::atomic<uint64_t> failed;//握手失败次数
+    std::atomic<uint64_t> ktls;//握手后收发都切换到内核TLS的连接数
+    Stats() : handshakes(0), resumed(0), failed(0), ktls(0) {}
+  };
+  TlsContext();
+  ~TlsContext();
+  //加载PEM格式的证书链和私钥；ktls为true时握手后尝试切换到内核TLS，失败返回false
+  bool Init(const std::string& certfile, const std::string& keyfile, bool ktls = true);
+  //是否编译了TLS支持
+  static bool Available();
+  struct ssl_ctx_st* Get() const { return ctx_; }
+  Stats& GetStats() { return stats_; }
+private:
+  struct ssl_ctx_st* ctx_;
+  Stats stats_;
+};
+#endif // !_TLSCONTEXT_H_
@@ -0,0 +1,120 @@
+#include "TlsStream.h"
+#include <iostream>
+#include <errno.h>
+#ifdef ENABLE_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#define TLS_READ_BUFSIZE 16384 //一个TLS记录的最大明文长度
+TlsStream::TlsStream(TlsContext* context, int fd)
+    : context_(context), ssl_(SSL_new(context->Get())), established_(false), kernelsend_(false), kernelrecv_(false) {
+  SSL_set_fd(ssl_, fd);
+  SSL_set_accept_state(ssl_);
+}
+TlsStream::~TlsStream() {
+  SSL_free(ssl_);
+}
+int TlsStream::Handshake() {
+  int ret = SSL_do_handshake(ssl_);
+  if (ret == 1) {
+    established_ = true;
+#ifndef OPENSSL_NO_KTLS
+    kernelsend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    kernelrecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+    TlsContext::Stats& stats = context_->GetStats();
+    ++stats.handshakes;
+    if (SSL_session_reused(ssl_)) {
+      ++stats.resumed;
+    }
+    if (kernelsend_ && kernelrecv_) {
+      ++stats.ktls;
+    }
+    return TLS_DONE;
+  }
+  int err = SSL_get_error(ssl_, ret);
+  if (err == SSL_ERROR_WANT_READ) {
+    return TLS_WANT_READ;
+  } else if (err == SSL_ERROR_WANT_WRITE) {
+    return TLS_WANT_WRITE;
+  }
+  ++context_->GetStats().failed;
+  unsigned long code = ERR_get_error();
+  if (code != 0) {
+    char reason[256];
+    ERR_error_string_n(code, reason, sizeof(reason));
+    std::cerr << "TLS handshake failed: " << reason << std::endl;
+  }
+  ERR_clear_error();
+  return TLS_FAILED;
+}
+ssize_t TlsStream::Read(std::string& buffer, bool& eof) {
+  ssize_t readsum = 0;
+  char buf[TLS_READ_BUFSIZE];
+  eof = false;
+  for (;;) {
+    int n = SSL_read(ssl_, buf, sizeof(buf));
+    if (n > 0) {
+      buffer.append(buf, n);
+      readsum += n;
+      continue;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+      return readsum;
+    } else if (err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && errno == 0)) {
+      eof = true; //收到close_notify，或者对端直接关闭了连接
+      return readsum;
+    } else if (err == SSL_ERROR_SYSCALL && errno == EINTR) {
+      continue;
+    }
+    ERR_clear_error();
+    return -1;
+  }
+}
+ssize_t TlsStream::Write(OutputQueue& queue) {
+  ssize_t sendsum = 0;
+  size_t len = 0;
+  const char* data;
+  while ((data = queue.Peek(len)) != NULL) {
+    int n = SSL_write(ssl_, data, static_cast<int>(len));
+    if (n > 0) {
+      queue.Retrieve(n);
+      sendsum += n;
+      continue;
+    }
+    int err = SSL_get_error(ssl_, n);
+    if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+      return sendsum; // 非阻塞返回，缓冲区满
+    } else if (err == SSL_ERROR_SYSCALL && errno == EINTR) {
+      continue;
+    }
+    ERR_clear_error();
+    return -1;
+  }
+  return sendsum;
+}
+void TlsStream::Shutdown() {
+  if (established_) {
+    SSL_shutdown(ssl_);
+    ERR_clear_error();
+  }
+}
+#else
+TlsStream::TlsStream(TlsContext* context, int fd)
+    : context_(context), ssl_(nullptr), established_(false), kernelsend_(false), kernelrecv_(false) {
+}
+TlsStream::~TlsStream() {
+}
+int TlsStream::Handshake() {
+  return TLS_FAILED;
+}
+ssize_t TlsStream::Read(std::string& buffer, bool& eof) {
+  eof = true;
+  return -1;
+}
+ssize_t TlsStream::Write(OutputQueue& queue) {
+  return -1;
+}
+void TlsStream::Shutdown() {
+}
+#endif
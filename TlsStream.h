@@ -0,0 +1,41 @@
+#ifndef _TLSSTREAM_H_
+#define _TLSSTREAM_H_
+//一条连接上的TLS状态：在IO线程里非阻塞地握手，之后负责加解密
+//握手完成后如果内核TLS（TCP_ULP "tls"）可用，加解密交给内核，连接直接用普通的read/write
+#include <string>
+#include <sys/types.h>
+#include "OutputQueue.h"
+#include "TlsContext.h"
+struct ssl_st;
+class TlsStream {
+public:
+  //握手结果
+  enum {
+    TLS_DONE = 0,//握手完成
+    TLS_WANT_READ,//等待对端数据
+    TLS_WANT_WRITE,//等待socket可写
+    TLS_FAILED//握手失败
+  };
+  TlsStream(TlsContext* context, int fd);
+  ~TlsStream();
+  //推进握手，返回上面的结果
+  int Handshake();
+  bool Established() const { return established_; }
+  //握手后发送方向是否由内核加密
+  bool KernelSend() const { return kernelsend_; }
+  //握手后接收方向是否由内核解密
+  bool KernelRecv() const { return kernelrecv_; }
+  //读出解密后的数据追加到buffer，返回读到的字节数（可能为0），出错返回-1；对端关闭时eof置为true
+  ssize_t Read(std::string& buffer, bool& eof);
+  //加密发送队列中的数据，返回发送的明文字节数，发送缓冲区满时返回已发送部分，出错返回-1
+  ssize_t Write(OutputQueue& queue);
+  //发送close_notify，尽力而为
+  void Shutdown();
+private:
+  TlsContext* context_;
+  struct ssl_st* ssl_;
+  bool established_;
+  bool kernelsend_;
+  bool kernelrecv_;
+};
+#endif // !_TLSSTREAM_H_
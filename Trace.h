@@ -0,0 +1,29 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+//USDT静态探针，provider为netserver，可用bpftrace/perf/systemtap在运行中挂上，不用重新编译
+//有<sys/sdt.h>（systemtap-sdt-dev）时每个探针编译成一条nop，并在ELF的.note.stapsdt段登记位置和参数，没挂探针时只多一条nop；
+//没有该头文件或定义了DISABLE_USDT时探针为空
+//探针列表（参数依次为arg0、arg1……），bpftrace脚本见trace目录：
+//  poll_enter(epollfd, timeoutms)、poll_return(epollfd, nfds)  epoll_wait前后
+//  channel_event(fd, revents)  分发一个就绪事件
+//  accept(listenfd, connfd)  接受一个新连接
+//  conn_recv(fd, bytes)、conn_send(fd, bytes)  连接读到、写出的字节数，bytes为负表示出错
+//  conn_close(fd)  连接清理
+//  task_add(loop)、task_run(loop, count)  投递任务、一次执行count个任务
+//  timer_expire(timeoutms)  定时器到期
+#if !defined(DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_USDT 1
+#endif
+#endif
+#ifdef HAVE_USDT
+#define TRACE0(name) DTRACE_PROBE(netserver, name)
+#define TRACE1(name, a) DTRACE_PROBE1(netserver, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(netserver, name, a, b)
+#else
+#define TRACE0(name) do {} while (0)
+#define TRACE1(name, a) do {} while (0)
+#define TRACE2(name, a, b) do {} while (0)
+#endif
+#endif // !_TRACE_H_
@@ -0,0 +1,182 @@
+#include "TrafficCapture.h"
+#include <stdio.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define CAPTURE_MAGIC "NSCAP001"
+#define CAPTURE_FLUSH_BYTES 65536 //线程缓冲攒到该长度就写进文件
+static std::atomic<uint64_t> nextcaptureid(1);
+static int64_t MonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+TrafficCapture::TrafficCapture(const std::string& path, size_t maxbytes)
+    : path_(path), maxbytes_(std::max(maxbytes, sizeof(FileHeader))), fd_(-1), base_(NULL), tail_(0), written_(0), dropped_(0), nextconnid_(1),
+      starttime_(0), id_(nextcaptureid.fetch_add(1)), mutex_(), writers_() {
+}
+TrafficCapture::~TrafficCapture() {
+  if (!base_) {
+    return;
+  }
+  for (auto &writer : writers_) {
+    Flush(writer.second.get());
+  }
+  size_t length = Bytes();
+  munmap(base_, maxbytes_);
+  if (ftruncate(fd_, length) < 0) {
+    perror("ftruncate capture");
+  }
+  close(fd_);
+  std::cout << "TrafficCapture: " << length << " bytes written to " << path_ << ", " << Dropped() << " records dropped" << std::endl;
+}
+bool TrafficCapture::Open() {
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    perror("open capture");
+    return false;
+  }
+  //稀疏文件，实际写到哪里才占用到哪里
+  if (ftruncate(fd_, maxbytes_) < 0) {
+    perror("ftruncate capture");
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  void* base = mmap(NULL, maxbytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    perror("mmap capture");
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  base_ = static_cast<char*>(base);
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  header.starttime = static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  memcpy(base_, &header, sizeof(header));
+  tail_ = sizeof(header);
+  written_ = sizeof(header);
+  starttime_ = MonotonicNs();
+  return true;
+}
+TrafficCapture::Writer* TrafficCapture::LocalWriter() {
+  //一个线程通常只服务一次录制，缓存上次用到的Writer，只有换了录制才查表
+  static thread_local uint64_t cachedid = 0;
+  static thread_local Writer* cached = NULL;
+  if (cachedid == id_) {
+    return cached;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Writer>& writer = writers_[std::this_thread::get_id()];
+  if (!writer) {
+    writer.reset(new Writer());
+  }
+  cachedid = id_;
+  cached = writer.get();
+  return cached;
+}
+uint64_t TrafficCapture::OpenConnection() {
+  uint64_t connid = nextconnid_.fetch_add(1);
+  Record(connid, CAPTURE_OPEN, NULL, 0);
+  return connid;
+}
+void TrafficCapture::Record(uint64_t connid, int type, const char* data, size_t len) {
+  if (!base_) {
+    return;
+  }
+  Writer* writer = LocalWriter();
+  RecordHeader header;
+  header.time = static_cast<uint64_t>(MonotonicNs() - starttime_);
+  header.connid = connid;
+  header.len = static_cast<uint32_t>(len);
+  header.type = static_cast<uint16_t>(type);
+  header.reserved = 0;
+  writer->buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  writer->buffer.append(data, len);
+  if (writer->buffer.size() >= CAPTURE_FLUSH_BYTES) {
+    Flush(writer);
+  }
+}
+void TrafficCapture::FlushLocal() {
+  if (base_) {
+    Flush(LocalWriter());
+  }
+}
+void TrafficCapture::Flush(Writer* writer) {
+  std::string& buffer = writer->buffer;
+  if (buffer.empty()) {
+    return;
+  }
+  size_t offset = tail_.fetch_add(buffer.size());
+  if (offset + buffer.size() > maxbytes_) {
+    //放不下，整批丢弃，只按记录数计数
+    uint64_t records = 0;
+    for (size_t pos = 0; pos < buffer.size(); ++records) {
+      RecordHeader header;
+      memcpy(&header, buffer.data() + pos, sizeof(header));
+      pos += sizeof(header) + header.len;
+    }
+    dropped_ += records;
+  } else {
+    memcpy(base_ + offset, buffer.data(), buffer.size());
+    written_ += buffer.size();
+  }
+  buffer.clear();
+}
+bool TrafficCapture::Load(const std::string& path, std::vector<Event>& events) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror("open capture");
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    std::cerr << "capture file too short: " << path << std::endl;
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("mmap capture");
+    return false;
+  }
+  const char* data = static_cast<const char*>(base);
+  if (memcmp(data, CAPTURE_MAGIC, 8) != 0) {
+    std::cerr << "not a capture file: " << path << std::endl;
+    munmap(base, size);
+    return false;
+  }
+  size_t pos = sizeof(FileHeader);
+  while (pos + sizeof(RecordHeader) <= size) {
+    RecordHeader header;
+    memcpy(&header, data + pos, sizeof(header));
+    //进程异常退出时文件没有截断，未写入的部分全是0
+    if (header.type == CAPTURE_NONE || header.type > CAPTURE_CLOSE || pos + sizeof(header) + header.len > size) {
+      break;
+    }
+    pos += sizeof(header);
+    Event event;
+    event.time = header.time;
+    event.connid = header.connid;
+    event.type = header.type;
+    event.data.assign(data + pos, header.len);
+    events.push_back(std::move(event));
+    pos += header.len;
+  }
+  munmap(base, size);
+  std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+    return a.connid != b.connid ? a.connid < b.connid : a.time < b.time;
+  });
+  return true;
+}
@@ -0,0 +1,83 @@
+#ifndef _TRAFFICCAPTURE_H_
+#define _TRAFFICCAPTURE_H_
+//流量录制：把每个连接收到和发出的字节流连同时间戳追加写进一个内存映射的二进制文件，供bench/TrafficReplay回放
+//文件按上限预先映射（稀疏文件），每个线程先把记录攒在自己的缓冲里，攒满或定时刷新时原子地占一段文件空间再拷贝进去，
+//写记录不加锁、不进内核；文件写满后丢弃后续记录并计数，关闭时截断到实际长度
+//同一连接的记录可能来自不同线程的缓冲（连接建立在accept线程、迁移后换了loop），文件里不保证按时间排序，读取时按时间重排
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+class TrafficCapture {
+public:
+  //记录类型
+  enum {
+    CAPTURE_NONE = 0,//文件末尾未写入的部分
+    CAPTURE_OPEN,//连接建立
+    CAPTURE_IN,//从连接读到的数据
+    CAPTURE_OUT,//业务层发给连接的数据
+    CAPTURE_CLOSE//连接销毁
+  };
+  //文件头，之后是一条条记录
+  struct FileHeader {
+    char magic[8];//"NSCAP001"
+    uint64_t starttime;//开始录制的时间，unix时间，单位ns
+    uint64_t reserved[2];
+  };
+  //记录头，之后是len字节的数据
+  struct RecordHeader {
+    uint64_t time;//距开始录制的时间，单位ns
+    uint64_t connid;//连接编号，录制期间唯一
+    uint32_t len;
+    uint16_t type;
+    uint16_t reserved;
+  };
+  //读出的一条记录
+  struct Event {
+    uint64_t time;
+    uint64_t connid;
+    int type;
+    std::string data;
+  };
+  //maxbytes为文件上限，须调用Open后才开始录制
+  TrafficCapture(const std::string& path, size_t maxbytes);
+  //刷新所有线程的缓冲并截断文件，须在其他线程都不再写记录之后析构
+  ~TrafficCapture();
+  bool Open();
+  //分配连接编号并写入建立记录
+  uint64_t OpenConnection();
+  void Record(uint64_t connid, int type, const char* data, size_t len);
+  //把当前线程缓冲里的记录写进文件，由各loop定时调用
+  void FlushLocal();
+  //已写进文件的字节数，成功写入的批次总是占着文件开头连续的一段
+  size_t Bytes() const { return written_.load(); }
+  //文件写满后丢弃的记录数，一旦有批次放不下，之后的批次也都放不下
+  uint64_t Dropped() const { return dropped_.load(); }
+  const std::string& GetPath() const { return path_; }
+  //读取录制文件，按连接编号、时间排序，失败返回false
+  static bool Load(const std::string& path, std::vector<Event>& events);
+private:
+  //一个线程的记录缓冲，只在该线程访问
+  struct Writer {
+    std::string buffer;
+  };
+  Writer* LocalWriter();
+  void Flush(Writer* writer);
+  std::string path_;
+  size_t maxbytes_;
+  int fd_;
+  char* base_;//映射的文件
+  std::atomic<size_t> tail_;//已占用的文件长度，写满后继续增长，超出上限的批次丢弃
+  std::atomic<size_t> written_;//已写入的长度
+  std::atomic<uint64_t> dropped_;
+  std::atomic<uint64_t> nextconnid_;
+  int64_t starttime_;//开始录制的单调时间，单位ns
+  uint64_t id_;//本次录制的编号，线程缓存的Writer按它区分不同的录制
+  std::mutex mutex_;//保护writers_
+  std::unordered_map<std::thread::id, std::unique_ptr<Writer> > writers_;
+};
+#endif // !_TRAFFICCAPTURE_H_
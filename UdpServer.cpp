@@ -0,0 +1,254 @@
+#include "UdpServer.h"
+#include <iostream>
+#include <stdio.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#define GRO_MAX_DATAGRAM 65535 //开启GRO时合并后的数据报最大长度
+#define GSO_MAX_SEGMENTS 64 //一次UDP_SEGMENT发送的最大分段数
+#define GSO_MAX_BYTES 65000 //一次UDP_SEGMENT发送的最大字节数
+UdpServer::Worker::Worker(EventLoop* loop, int port, const Options& options)
+    : loop_(loop), options_(options), socket_(SOCK_DGRAM), channel_(), sendcount_(0),
+      recvcalls_(0), sendcalls_(0), received_(0), sent_(0), dropped_(0), server_(nullptr) {
+  if (options_.gro && options_.maxdatagram < GRO_MAX_DATAGRAM) {
+    options_.maxdatagram = GRO_MAX_DATAGRAM;
+  }
+  socket_.SetReuseAddr();
+  socket_.SetReusePort();
+  socket_.Setnonblocking();
+  socket_.BindAddress(port);
+  if (options_.gro) {
+    int on = 1;
+    if (setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+      perror("setsockopt UDP_GRO");
+      options_.gro = false;
+    }
+  }
+  size_t batchsize = options_.batchsize;
+  size_t controlsize = CMSG_SPACE(sizeof(int));
+  recvbuf_.resize(batchsize * options_.maxdatagram);
+  recvmsgs_.resize(batchsize);
+  recviovs_.resize(batchsize);
+  recvaddrs_.resize(batchsize);
+  recvcontrol_.resize(batchsize * controlsize);
+  for (size_t i = 0; i < batchsize; ++i) {
+    recviovs_[i].iov_base = &recvbuf_[i * options_.maxdatagram];
+    recviovs_[i].iov_len = options_.maxdatagram;
+    memset(&recvmsgs_[i], 0, sizeof(struct mmsghdr));
+    recvmsgs_[i].msg_hdr.msg_name = &recvaddrs_[i];
+    recvmsgs_[i].msg_hdr.msg_iov = &recviovs_[i];
+    recvmsgs_[i].msg_hdr.msg_iovlen = 1;
+    recvmsgs_[i].msg_hdr.msg_control = &recvcontrol_[i * controlsize];
+  }
+  sendbufs_.resize(batchsize);
+  sendmsgs_.resize(batchsize);
+  sendiovs_.resize(batchsize);
+  sendaddrs_.resize(batchsize);
+  for (size_t i = 0; i < batchsize; ++i) {
+    memset(&sendmsgs_[i], 0, sizeof(struct mmsghdr));
+    sendmsgs_[i].msg_hdr.msg_name = &sendaddrs_[i];
+    sendmsgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    sendmsgs_[i].msg_hdr.msg_iov = &sendiovs_[i];
+    sendmsgs_[i].msg_hdr.msg_iovlen = 1;
+  }
+  channel_.SetFd(socket_.fd());
+  //水平触发：每次可读事件只读有限批数，没读完的下一轮继续，避免一个socket独占loop
+  channel_.SetEvents(EPOLLIN);
+  channel_.setReadHandler(std::bind(&UdpServer::Worker::HandleRead, this));
+}
+UdpServer::Worker::~Worker() {
+  loop_->RemoveChannelFromPoller(&channel_);
+}
+void UdpServer::Worker::HandleRead() {
+  int batchsize = options_.batchsize;
+  socklen_t controlsize = options_.gro ? CMSG_SPACE(sizeof(int)) : 0;
+  for (int batch = 0; batch < options_.maxbatches; ++batch) {
+    for (int i = 0; i < batchsize; ++i) {
+      recvmsgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      recvmsgs_[i].msg_hdr.msg_controllen = controlsize;
+    }
+    int n = recvmmsg(socket_.fd(), &recvmsgs_[0], batchsize, MSG_DONTWAIT, NULL);
+    ++recvcalls_;
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        perror("recvmmsg");
+      }
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      if (recvmsgs_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        //超过maxdatagram的数据报只读到了前一部分，不能当作完整的交给业务层
+        ++dropped_;
+        continue;
+      }
+      const char* data = &recvbuf_[i * options_.maxdatagram];
+      size_t len = recvmsgs_[i].msg_len;
+      size_t segsize = len;
+      if (options_.gro) {
+        //GRO合并过的数据报，按内核给出的分段长度拆回原来的数据报
+        struct msghdr* msg = &recvmsgs_[i].msg_hdr;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+          if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gsosize = 0;
+            memcpy(&gsosize, CMSG_DATA(cmsg), sizeof(int));
+            if (gsosize > 0) segsize = gsosize;
+          }
+        }
+      }
+      if (segsize == 0) {
+        segsize = 1; //空数据报也要交给业务层
+      }
+      size_t offset = 0;
+      do {
+        size_t seglen = std::min(segsize, len - offset);
+        ++received_;
+        if (server_->datagramcallback_) {
+          server_->datagramcallback_(this, recvaddrs_[i], data + offset, seglen);
+        }
+        offset += seglen;
+      } while (offset < len);
+    }
+    Flush();
+    if (n < batchsize) {
+      break;
+    }
+  }
+  Flush();
+}
+void UdpServer::Worker::Send(const struct sockaddr_in& peeraddr, const char* data, size_t len) {
+  if (sendcount_ == options_.batchsize) {
+    Flush();
+  }
+  std::string& buf = sendbufs_[sendcount_];
+  buf.assign(data, len);
+  sendaddrs_[sendcount_] = peeraddr;
+  sendiovs_[sendcount_].iov_base = &buf[0];
+  sendiovs_[sendcount_].iov_len = len;
+  sendmsgs_[sendcount_].msg_hdr.msg_control = NULL;
+  sendmsgs_[sendcount_].msg_hdr.msg_controllen = 0;
+  ++sendcount_;
+}
+void UdpServer::Worker::SendBulk(const struct sockaddr_in& peeraddr, const char* data, size_t len, uint16_t segsize) {
+  if (segsize == 0) {
+    return;
+  }
+  if (!options_.gso || len <= segsize) {
+    for (size_t offset = 0; offset < len; offset += segsize) {
+      Send(peeraddr, data + offset, std::min<size_t>(segsize, len - offset));
+    }
+    return;
+  }
+  //保持与之前攒批数据的先后顺序
+  Flush();
+  size_t maxchunk = std::min<size_t>(GSO_MAX_BYTES / segsize, GSO_MAX_SEGMENTS) * segsize;
+  if (maxchunk == 0) {
+    maxchunk = segsize;
+  }
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  for (size_t offset = 0; offset < len;) {
+    size_t chunk = std::min(maxchunk, len - offset);
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data + offset);
+    iov.iov_len = chunk;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = const_cast<struct sockaddr_in*>(&peeraddr);
+    msg.msg_namelen = sizeof(peeraddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segsize, sizeof(uint16_t));
+    ssize_t n = sendmsg(socket_.fd(), &msg, MSG_DONTWAIT);
+    ++sendcalls_;
+    size_t segments = (chunk + segsize - 1) / segsize;
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        perror("sendmsg UDP_SEGMENT");
+      }
+      dropped_ += segments;
+    } else {
+      sent_ += segments;
+    }
+    offset += chunk;
+  }
+}
+void UdpServer::Worker::Flush() {
+  int offset = 0;
+  while (offset < sendcount_) {
+    int n = sendmmsg(socket_.fd(), &sendmsgs_[offset], sendcount_ - offset, MSG_DONTWAIT);
+    ++sendcalls_;
+    if (n > 0) {
+      offset += n;
+      sent_ += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == EAGAIN) {
+      //发送缓冲区满，UDP不重传，剩下的丢弃
+      dropped_ += sendcount_ - offset;
+      break;
+    } else {
+      //第一个数据报发送失败（如目的不可达），跳过它继续发送后面的
+      perror("sendmmsg");
+      ++offset;
+      ++dropped_;
+    }
+  }
+  sendcount_ = 0;
+}
+UdpServer::UdpServer(EventLoopThreadPool* threadpool, const int port, const Options& options)
+    : threadpool_(threadpool), port_(port), options_(options), workers_(), datagramcallback_() {
+}
+UdpServer::~UdpServer() {
+}
+void UdpServer::Start() {
+  std::vector<EventLoop*> loops = threadpool_->GetAllLoops();
+  for (auto &loop : loops) {
+    AddWorker(loop);
+  }
+  threadpool_->AddObserver(std::bind(&UdpServer::AddWorker, this, std::placeholders::_1),
+                           std::bind(&UdpServer::RemoveWorker, this, std::placeholders::_1));
+  std::cout << "UdpServer started on port " << port_ << " with " << loops.size() << " sockets" << std::endl;
+}
+void UdpServer::AddWorker(EventLoop* loop) {
+  std::unique_ptr<Worker> worker(new Worker(loop, port_, options_));
+  worker->server_ = this;
+  loop->AddTask(std::bind(&EventLoop::AddChannelToPoller, loop, &worker->channel_));
+  std::lock_guard<std::mutex> lock(mutex_);
+  workers_.push_back(std::move(worker));
+}
+void UdpServer::RemoveWorker(EventLoop* loop) {
+  //SO_REUSEPORT分组里少了这个socket，内核把之后的数据报分给其余socket
+  std::unique_ptr<Worker> worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+      if ((*it)->GetLoop() == loop) {
+        worker = std::move(*it);
+        workers_.erase(it);
+        break;
+      }
+    }
+  }
+  if (worker) {
+    worker->Flush();
+  }
+}
+std::vector<UdpServer::Worker*> UdpServer::GetWorkers() {
+  std::vector<Worker*> workers;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &worker : workers_) {
+    workers.push_back(worker.get());
+  }
+  return workers;
+}
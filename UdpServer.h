@@ -0,0 +1,92 @@
+#ifndef _UDPSERVER_H_
+#define _UDPSERVER_H_
+//UDP服务器：每个IO线程一个SO_REUSEPORT的数据报socket，由内核按四元组分流
+//收包用recvmmsg批量读入预先分配的缓冲环，回包先攒批再用sendmmsg一次发出，可选UDP GSO/GRO
+#include <functional>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "Socket.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+class UdpServer {
+public:
+  struct Options {
+    int batchsize;//每次recvmmsg/sendmmsg最多处理的数据报数
+    size_t maxdatagram;//单个数据报最大长度，开启GRO时为合并后的最大长度；更长的数据报会被截断，整个丢弃并计入丢弃数
+    int maxbatches;//每次可读事件最多读取的批数，之后让出给同一loop上的其他事件
+    bool gro;//接收端开启UDP_GRO，内核把同一流的数据报合并后上交
+    bool gso;//SendBulk使用UDP_SEGMENT由内核分段
+    Options() : batchsize(32), maxdatagram(2048), maxbatches(4), gro(false), gso(false) {}
+  };
+  //每个IO线程上的数据报socket
+  class Worker {
+  public:
+    Worker(EventLoop* loop, int port, const Options& options);
+    ~Worker();
+    EventLoop* GetLoop() const { return loop_; }
+    //回复一个数据报，先放入发送批，本批数据报处理完后统一发送
+    void Send(const struct sockaddr_in& peeraddr, const char* data, size_t len);
+    //批量发送大块数据，按segsize切成多个数据报；开启GSO时只需一次系统调用
+    void SendBulk(const struct sockaddr_in& peeraddr, const char* data, size_t len, uint16_t segsize);
+    //立即发送当前批
+    void Flush();
+    uint64_t RecvCalls() const { return recvcalls_; }
+    uint64_t SendCalls() const { return sendcalls_; }
+    uint64_t DatagramsReceived() const { return received_; }
+    uint64_t DatagramsSent() const { return sent_; }
+    uint64_t DatagramsDropped() const { return dropped_; }
+  private:
+    friend class UdpServer;
+    void HandleRead();
+    EventLoop* loop_;
+    Options options_;
+    Socket socket_;
+    Channel channel_;
+    //接收环：batchsize个缓冲区连续分配，recvmmsg直接写入
+    std::vector<char> recvbuf_;
+    std::vector<struct mmsghdr> recvmsgs_;
+    std::vector<struct iovec> recviovs_;
+    std::vector<struct sockaddr_in> recvaddrs_;
+    std::vector<char> recvcontrol_;
+    //发送批：缓冲区复用，稳定后不再分配内存
+    std::vector<std::string> sendbufs_;
+    std::vector<struct mmsghdr> sendmsgs_;
+    std::vector<struct iovec> sendiovs_;
+    std::vector<struct sockaddr_in> sendaddrs_;
+    int sendcount_;
+    uint64_t recvcalls_;
+    uint64_t sendcalls_;
+    uint64_t received_;
+    uint64_t sent_;
+    uint64_t dropped_;
+    UdpServer* server_;
+  };
+  //收到数据报回调，在worker所属IO线程执行，data只在回调期间有效
+  typedef std::function<void(Worker*, const struct sockaddr_in&, const char*, size_t)> DatagramCallback;
+  //在threadpool的每个loop上监听port，threadpool须已经Start
+  //线程池运行中增删loop时worker随之增删，扩缩容期间UdpServer须一直有效
+  UdpServer(EventLoopThreadPool* threadpool, const int port, const Options& options = Options());
+  ~UdpServer();
+  void Start();
+  void SetDatagramCallback(DatagramCallback cb) {
+    datagramcallback_ = cb;
+  }
+  //当前所有worker的快照，worker所在的loop移除后随之释放
+  std::vector<Worker*> GetWorkers();
+private:
+  void AddWorker(EventLoop* loop);//新增loop：创建worker并注册到该loop
+  void RemoveWorker(EventLoop* loop);//在被移除的loop线程里释放它的worker
+  EventLoopThreadPool* threadpool_;
+  int port_;
+  Options options_;
+  std::vector<std::unique_ptr<Worker> > workers_;
+  DatagramCallback datagramcallback_;
+  std::mutex mutex_;//保护workers_，线程池扩缩容时在其他线程增删
+};
+#endif // !_UDPSERVER_H_
@@ -0,0 +1,153 @@
+#include "UpstreamPool.h"
+#include <iostream>
+#include <algorithm>
+#define UPSTREAM_CONNECT_RETRIES 2 //新建上游连接失败时的重试次数
+UpstreamPool::UpstreamPool(EventLoop* loop, int maxperbackend, int maxidle)
+    : loop_(loop), maxperbackend_(maxperbackend), maxidle_(maxidle), backends_() {
+}
+UpstreamPool::~UpstreamPool() {
+  //连接可能比连接池活得久，清理回调不能再引用this
+  for (auto &item : backends_) {
+    for (auto &conn : item.second.idle) {
+      conn->SetConnectionCleanup([](const TcpConnectionPtr&) {});
+      conn->Shutdown();
+    }
+    for (auto &connector : item.second.connecting) {
+      connector.second->Stop();
+    }
+  }
+}
+uint64_t UpstreamPool::BackendKey(const struct sockaddr_in& addr) {
+  return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+size_t UpstreamPool::InUse(const Backend& backend) {
+  return backend.active.size() + backend.connecting.size();
+}
+void UpstreamPool::Acquire(const struct sockaddr_in& backendaddr, AcquireCallBack &&cb) {
+  uint64_t key = BackendKey(backendaddr);
+  Backend& backend = backends_[key];
+  backend.addr = backendaddr;
+  while (!backend.idle.empty()) {
+    //最近归还的连接最可能还是热的
+    TcpConnectionPtr conn = backend.idle.back();
+    backend.idle.pop_back();
+    if (conn->Disconnected()) {
+      continue;
+    }
+    backend.active.insert(conn);
+    cb(conn);
+    return;
+  }
+  backend.waiters.push_back(std::move(cb));
+  if (InUse(backend) < maxperbackend_) {
+    StartConnect(backend);
+  }
+}
+void UpstreamPool::StartConnect(Backend& backend) {
+  Connector::spConnector connector(new Connector(loop_, backend.addr));
+  uint64_t key = BackendKey(backend.addr);
+  connector->SetMaxRetries(UPSTREAM_CONNECT_RETRIES);
+  connector->SetNewConnectionCallBack(std::bind(&UpstreamPool::OnConnected, this, key, connector.get(), std::placeholders::_1));
+  connector->SetErrorCallBack(std::bind(&UpstreamPool::OnConnectFailed, this, key, connector.get()));
+  backend.connecting[connector.get()] = connector;
+  connector->Start();
+}
+void UpstreamPool::RemoveConnector(Backend& backend, Connector* connector) {
+  auto iter = backend.connecting.find(connector);
+  if (iter == backend.connecting.end()) {
+    return;
+  }
+  Connector::spConnector holder = iter->second;
+  backend.connecting.erase(iter);
+  loop_->AddTask([holder]() {});
+}
+void UpstreamPool::OnConnected(uint64_t key, Connector* connector, int sockfd) {
+  Backend& backend = backends_[key];
+  RemoveConnector(backend, connector);
+  auto conn = std::make_shared<TcpConnection>(loop_, sockfd, backend.addr);
+  conn->SetMessageCallBack(std::bind(&UpstreamPool::OnIdleMessage, this, std::placeholders::_1, std::placeholders::_2));
+  conn->SetConnectionCleanup(std::bind(&UpstreamPool::RemoveConnection, this, std::placeholders::_1));
+  conn->AddChannelToLoop();
+  Dispatch(backend, conn);
+}
+void UpstreamPool::OnConnectFailed(uint64_t key, Connector* connector) {
+  Backend& backend = backends_[key];
+  RemoveConnector(backend, connector);
+  //每次新建连接对应一个等待者，连接失败时通知它
+  if (!backend.waiters.empty()) {
+    AcquireCallBack cb = std::move(backend.waiters.front());
+    backend.waiters.pop_front();
+    cb(TcpConnectionPtr());
+  }
+}
+void UpstreamPool::Dispatch(Backend& backend, const TcpConnectionPtr& conn) {
+  if (!backend.waiters.empty()) {
+    AcquireCallBack cb = std::move(backend.waiters.front());
+    backend.waiters.pop_front();
+    backend.active.insert(conn);
+    cb(conn);
+  } else if (backend.idle.size() < maxidle_) {
+    backend.idle.push_back(conn);
+  } else {
+    conn->Shutdown();
+  }
+}
+void UpstreamPool::Release(const TcpConnectionPtr& conn) {
+  //通常在连接自己的消息回调里归还，此时不能替换正在执行的回调，延后到任务队列
+  loop_->AddTask(std::bind(&UpstreamPool::ReleaseInLoop, this, conn));
+}
+void UpstreamPool::ReleaseInLoop(const TcpConnectionPtr& conn) {
+  auto iter = backends_.find(BackendKey(conn->GetPeerAddr().GetInet()));
+  if (iter == backends_.end()) {
+    return;
+  }
+  Backend& backend = iter->second;
+  backend.active.erase(conn);
+  if (conn->Disconnected()) {
+    return;
+  }
+  //业务层的回调换回池自己的
+  conn->SetMessageCallBack(std::bind(&UpstreamPool::OnIdleMessage, this, std::placeholders::_1, std::placeholders::_2));
+  conn->SetSendCompleteCallBack(TcpConnection::CallBack());
+  conn->SetCloseCallBack(TcpConnection::CallBack());
+  conn->SetErrorCallBack(TcpConnection::CallBack());
+  Dispatch(backend, conn);
+}
+void UpstreamPool::Discard(const TcpConnectionPtr& conn) {
+  conn->Shutdown();
+}
+void UpstreamPool::RemoveConnection(const TcpConnectionPtr& conn) {
+  auto iter = backends_.find(BackendKey(conn->GetPeerAddr().GetInet()));
+  if (iter == backends_.end()) {
+    return;
+  }
+  Backend& backend = iter->second;
+  backend.active.erase(conn);
+  auto idleiter = std::find(backend.idle.begin(), backend.idle.end(), conn);
+  if (idleiter != backend.idle.end()) {
+    backend.idle.erase(idleiter);
+  }
+  //腾出了并发名额，为排队的请求新建连接
+  if (backend.waiters.size() > backend.connecting.size() && InUse(backend) < maxperbackend_) {
+    StartConnect(backend);
+  }
+}
+void UpstreamPool::OnIdleMessage(const TcpConnectionPtr& conn, std::string& message) {
+  std::cerr << "UpstreamPool unexpected data on idle connection, closing." << std::endl;
+  message.clear();
+  conn->Shutdown();
+}
+size_t UpstreamPool::IdleCount() const {
+  size_t count = 0;
+  for (auto &item : backends_) {
+    count += item.second.idle.size();
+  }
+  return count;
+}
+size_t UpstreamPool::ActiveCount() const {
+  size_t count = 0;
+  for (auto &item : backends_) {
+    count += item.second.active.size();
+  }
+  return count;
+}
@@ -0,0 +1,63 @@
+#ifndef _UPSTREAMPOOL_H_
+#define _UPSTREAMPOOL_H_
+//上游连接池：每个EventLoop一个，复用到后端的空闲连接，并限制每个后端的并发连接数
+//所有接口都须在所属loop线程调用
+#include <functional>
+#include <string>
+#include <memory>
+#include <deque>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <netinet/in.h>
+#include "EventLoop.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+class UpstreamPool {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  //获取连接的回调，连接失败时参数为空
+  typedef std::function<void(const TcpConnectionPtr&)> AcquireCallBack;
+  UpstreamPool(EventLoop* loop, int maxperbackend = 64, int maxidle = 16);
+  ~UpstreamPool();
+  EventLoop* GetLoop() const { return loop_; }
+  //获取一个到backend的连接：优先复用空闲连接，未达到并发上限时新建，否则排队等待归还
+  void Acquire(const struct sockaddr_in& backend, AcquireCallBack &&cb);
+  //用完后归还连接，连接上的业务回调会被池接管
+  void Release(const TcpConnectionPtr& conn);
+  //连接状态异常，不再复用
+  void Discard(const TcpConnectionPtr& conn);
+  //空闲连接数和使用中连接数，用于统计
+  size_t IdleCount() const;
+  size_t ActiveCount() const;
+private:
+  //一个后端的状态
+  struct Backend {
+    struct sockaddr_in addr;
+    std::deque<TcpConnectionPtr> idle;//空闲连接，队尾最近归还
+    std::set<TcpConnectionPtr> active;//借出的连接，池持有引用直到归还或关闭
+    std::map<Connector*, Connector::spConnector> connecting;//正在建立的连接
+    std::deque<AcquireCallBack> waiters;//等待连接的请求
+  };
+  static uint64_t BackendKey(const struct sockaddr_in& addr);
+  //backend的并发连接数，包括正在建立的
+  static size_t InUse(const Backend& backend);
+  void StartConnect(Backend& backend);
+  void OnConnected(uint64_t key, Connector* connector, int sockfd);
+  void OnConnectFailed(uint64_t key, Connector* connector);
+  //Connector在自己的回调里，不能立即析构，延后到任务队列里释放
+  void RemoveConnector(Backend& backend, Connector* connector);
+  //把连接交给请求方，或者放入空闲队列
+  void Dispatch(Backend& backend, const TcpConnectionPtr& conn);
+  void ReleaseInLoop(const TcpConnectionPtr& conn);
+  //连接关闭，TcpConnection的清理回调
+  void RemoveConnection(const TcpConnectionPtr& conn);
+  //空闲连接上收到数据说明状态不对，直接关闭
+  void OnIdleMessage(const TcpConnectionPtr& conn, std::string& message);
+  EventLoop* loop_;
+  size_t maxperbackend_;
+  size_t maxidle_;
+  std::unordered_map<uint64_t, Backend> backends_;
+};
+#endif // !_UPSTREAMPOOL_H_
@@ -0,0 +1,153 @@
+//事件分发开销测试：比较回调类型擦除的TcpServer和编译期绑定的BasicTcpServer把一次可读事件交到业务代码的开销
+//第一组只测分发：Channel经std::function/std::bind到连接再到业务回调，对比函数指针跳板直接调用业务代码，不含系统调用
+//第二组用真实的TcpConnection：socketpair一端写入数据，另一端HandleRead读出后交给业务回调；耗时以读写系统调用为主，
+//分发路径的差别常被系统调用的波动掩盖，用来确认真实路径上回调表没有额外开销
+//用法：DispatchBench [-n count]
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstdlib>
+#include <algorithm>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "Channel.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "BasicTcpServer.h"
+#define MESSAGE_SIZE 64 //第二组每次可读事件的数据长度
+#define CONNECTION_ROUNDS 5 //第二组交替测量的轮数
+//业务代码：统计收到的字节数，读缓冲清空后留给下一次
+class CountHandler {
+public:
+  typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+  CountHandler() : bytes(0) {}
+  void HandleNewConnection(const TcpConnectionPtr& conn) {}
+  void HandleMessage(const TcpConnectionPtr& conn, std::string& message) {
+    bytes += message.size();
+    message.clear();
+  }
+  void HandleSendComplete(const TcpConnectionPtr& conn) {}
+  void HandleClose(const TcpConnectionPtr& conn) {}
+  void HandleError(const TcpConnectionPtr& conn) {}
+  uint64_t bytes;
+};
+//第一组每次可读事件交给业务层的固定数据，只构造一次，替身每次从这里拷进读缓冲
+static const std::string dispatchpayload("x");
+//第一组的连接替身：只保留分发路径，HandleRead把一段固定数据交给业务层
+struct ErasedConnection {
+  std::function<void(std::string&)> messagecallback;
+  std::string readbuffer;
+  void HandleRead() {
+    readbuffer.append(dispatchpayload);
+    messagecallback(readbuffer);
+  }
+};
+template <typename Handler>
+struct CompiledConnection {
+  Handler* handler;
+  std::string readbuffer;
+  static void DispatchEvent(void* owner, uint32_t revents) {
+    CompiledConnection* conn = static_cast<CompiledConnection*>(owner);
+    if (revents & (EPOLLIN | EPOLLPRI)) {
+      conn->readbuffer.append(dispatchpayload);
+      conn->handler->HandleMessage(CountHandler::TcpConnectionPtr(), conn->readbuffer);
+    }
+  }
+};
+template <typename F>
+static double Measure(int count, F dispatch) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; ++i) {
+    dispatch();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+static void DispatchOnly(int count) {
+  CountHandler erasedhandler;
+  ErasedConnection erased;
+  //与TcpServer一样：业务回调经std::bind绑定，再由Channel的std::function调到连接
+  erased.messagecallback = std::bind(&CountHandler::HandleMessage, &erasedhandler, CountHandler::TcpConnectionPtr(), std::placeholders::_1);
+  Channel erasedchannel;
+  erasedchannel.setReadHandler(std::bind(&ErasedConnection::HandleRead, &erased));
+  erasedchannel.SetRevents(EPOLLIN);
+  CountHandler compiledhandler;
+  CompiledConnection<CountHandler> compiled;
+  compiled.handler = &compiledhandler;
+  Channel compiledchannel;
+  compiledchannel.SetEventHandler(&CompiledConnection<CountHandler>::DispatchEvent, &compiled);
+  compiledchannel.SetRevents(EPOLLIN);
+  Measure(count / 10, [&]() { erasedchannel.HandleEvent(); });
+  double erasedns = Measure(count, [&]() { erasedchannel.HandleEvent(); });
+  Measure(count / 10, [&]() { compiledchannel.HandleEvent(); });
+  double compiledns = Measure(count, [&]() { compiledchannel.HandleEvent(); });
+  std::cout << "dispatch only:    std::function " << erasedns << " ns/event, compiled " << compiledns << " ns/event" << std::endl;
+}
+static double ConnectionRound(int count, const std::shared_ptr<TcpConnection>& conn, int peer) {
+  std::string message(MESSAGE_SIZE, 'x');
+  return Measure(count, [&]() {
+    if (write(peer, message.data(), message.size()) != MESSAGE_SIZE) {
+      perror("write");
+      exit(1);
+    }
+    conn->HandleRead();
+  });
+}
+static void RealConnection(int count) {
+  EventLoop loop;
+  int erasedfds[2], compiledfds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, erasedfds) < 0 ||
+      socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, compiledfds) < 0) {
+    perror("socketpair");
+    exit(1);
+  }
+  CountHandler erasedhandler;
+  auto erased = std::make_shared<TcpConnection>(&loop, erasedfds[0], SockAddress());
+  //TcpServer给每个连接拷贝一份std::bind出来的回调
+  TcpServer::MessageCallback messagecallback = std::bind(&CountHandler::HandleMessage, &erasedhandler,
+      std::placeholders::_1, std::placeholders::_2);
+  erased->SetMessageCallBack(TcpConnection::MessageCallBack(messagecallback));
+  CountHandler compiledhandler;
+  auto compiled = std::make_shared<TcpConnection>(&loop, compiledfds[0], SockAddress());
+  TcpServer::HandlerTable table;
+  BasicTcpServer<CountHandler>::MakeHandlerTable(&compiledhandler, table);
+  compiled->SetHandlerTable(&table.connection);
+  //注册到poller，析构时才能正常移除；loop不运行，事件由这里直接调用HandleRead
+  erased->AddChannelToLoop();
+  compiled->AddChannelToLoop();
+  loop.ExecuteTask();
+  //系统调用的耗时波动比分发路径的差别大，两者交替测几轮取最小值
+  double erasedns = 0, compiledns = 0;
+  for (int round = 0; round < CONNECTION_ROUNDS; ++round) {
+    double ns = ConnectionRound(count, compiled, compiledfds[1]);
+    compiledns = round == 0 ? ns : std::min(compiledns, ns);
+    ns = ConnectionRound(count, erased, erasedfds[1]);
+    erasedns = round == 0 ? ns : std::min(erasedns, ns);
+  }
+  std::cout << "TcpConnection:    TcpServer " << erasedns << " ns/event, BasicTcpServer " << compiledns
+            << " ns/event (including write and read syscalls)" << std::endl;
+  if (erasedhandler.bytes == 0 || compiledhandler.bytes == 0) {
+    std::cerr << "no data reached the handler" << std::endl;
+  }
+  close(erasedfds[1]);
+  close(compiledfds[1]);
+}
+int main(int argc, char* argv[]) {
+  int count = 10000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n': count = atoi(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n count]" << std::endl;
+        return 1;
+    }
+  }
+  DispatchOnly(count);
+  RealConnection(count / 50);
+  return 0;
+}
@@ -0,0 +1,108 @@
+//回显延迟测试：对每个地址建立一条连接，一问一答发送count次，统计往返延迟
+//用法：EchoLatencyBench [-n count] [-s size] addr...，addr格式见SockAddress，如127.0.0.1:8000 unix:/tmp/echo.sock @echo
+//服务端为EchoServer，回复带"reply Echo: "前缀
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "SockAddress.h"
+#define REPLY_PREFIX "reply Echo: "
+#define WARMUP_ROUNDS 100 //预热次数，不计入统计
+static bool RoundTrip(int fd, const std::string& request, std::vector<char>& reply) {
+  size_t sent = 0;
+  while (sent < request.size()) {
+    ssize_t n = write(fd, request.data() + sent, request.size() - sent);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    sent += n;
+  }
+  size_t expected = request.size() + strlen(REPLY_PREFIX);
+  size_t received = 0;
+  while (received < expected) {
+    ssize_t n = read(fd, &reply[received], reply.size() - received);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    received += n;
+  }
+  return true;
+}
+static bool RunBench(const SockAddress& addr, int count, size_t size) {
+  int fd = socket(addr.Family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return false;
+  }
+  if (connect(fd, addr.GetSockAddr(), addr.Length()) < 0) {
+    perror("connect");
+    close(fd);
+    return false;
+  }
+  if (!addr.IsUnix()) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  std::string request(size, 'x');
+  std::vector<char> reply(size + strlen(REPLY_PREFIX));
+  std::vector<double> latencies;
+  latencies.reserve(count);
+  for (int i = 0; i < WARMUP_ROUNDS + count; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    if (!RoundTrip(fd, request, reply)) {
+      std::cerr << addr.ToString() << ": connection lost after " << i << " rounds" << std::endl;
+      close(fd);
+      return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (i >= WARMUP_ROUNDS) {
+      latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+  }
+  close(fd);
+  std::sort(latencies.begin(), latencies.end());
+  double sum = 0;
+  for (auto latency : latencies) sum += latency;
+  printf("%-28s rounds=%d size=%zu avg=%.1fus p50=%.1fus p99=%.1fus max=%.1fus\n",
+         addr.ToString().c_str(), count, size, sum / latencies.size(),
+         latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+  return true;
+}
+int main(int argc, char* argv[]) {
+  int count = 10000;
+  size_t size = 64;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+      case 'n': count = atoi(optarg); break;
+      case 's': size = atoi(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n count] [-s size] addr..." << std::endl;
+        return 1;
+    }
+  }
+  if (optind >= argc || count <= 0 || size == 0) {
+    std::cerr << "usage: " << argv[0] << " [-n count] [-s size] addr..." << std::endl;
+    return 1;
+  }
+  int failed = 0;
+  for (int i = optind; i < argc; ++i) {
+    SockAddress addr;
+    if (!SockAddress::Parse(argv[i], addr)) {
+      std::cerr << "invalid address: " << argv[i] << std::endl;
+      ++failed;
+      continue;
+    }
+    if (!RunBench(addr, count, size)) {
+      ++failed;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+//KV服务的多键命令回归检查：在连接上流水线发送SET、MGET、DEL、PING，逐字节比对回复
+//每条MGET、DEL的键分散在各个分片上，同时覆盖本线程分片直接执行和跨loop批次返回两条路径；
+//连接轮流分到各个IO线程，用多个连接让每个分片都当过本地分片；任何一条回复重复、缺失或乱序都会让后面的字节对不上
+//用法：先启动 MyNetServer -k port iothreadnum，再运行 KvCheck [-c conns] [-n rounds] [-k keys] addr，回复全部正确时退出码为0
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "SockAddress.h"
+#include "RespCodec.h"
+#define READ_BUFSIZE 65536
+#define READ_TIMEOUT_MS 5000 //这么久没有收到数据就认为回复缺失
+static void AppendCommand(std::string& out, const std::vector<std::string>& args) {
+  RespCodec::AppendArrayHeader(out, args.size());
+  for (auto &arg : args) {
+    RespCodec::AppendBulk(out, arg.data(), arg.size());
+  }
+}
+//第i个键的值
+static std::string ValueOf(int i) {
+  std::string value("v");
+  value += std::to_string(i);
+  return value;
+}
+//一轮请求：设置全部键，MGET全部键加一个不存在的键，删除前一半，再MGET，最后删除剩下的键
+static void BuildRound(const std::string& prefix, int keys, std::string& request, std::string& expected) {
+  std::vector<std::string> names;
+  for (int i = 0; i < keys; ++i) {
+    names.push_back(prefix);
+    names.back() += std::to_string(i);
+    std::string value = ValueOf(i);
+    AppendCommand(request, {"SET", names.back(), value});
+    RespCodec::AppendStatus(expected, "OK");
+  }
+  std::string missing = prefix;
+  missing += "missing";
+  std::vector<std::string> mget = {"MGET"};
+  mget.insert(mget.end(), names.begin(), names.end());
+  mget.push_back(missing);
+  AppendCommand(request, mget);
+  RespCodec::AppendArrayHeader(expected, keys + 1);
+  for (int i = 0; i < keys; ++i) {
+    std::string value = ValueOf(i);
+    RespCodec::AppendBulk(expected, value.data(), value.size());
+  }
+  RespCodec::AppendNull(expected);
+  std::vector<std::string> del = {"DEL"};
+  del.insert(del.end(), names.begin(), names.begin() + keys / 2);
+  del.push_back(missing);
+  AppendCommand(request, del);
+  RespCodec::AppendInteger(expected, keys / 2);
+  AppendCommand(request, mget);
+  RespCodec::AppendArrayHeader(expected, keys + 1);
+  for (int i = 0; i < keys; ++i) {
+    if (i < keys / 2) {
+      RespCodec::AppendNull(expected);
+    } else {
+      std::string value = ValueOf(i);
+      RespCodec::AppendBulk(expected, value.data(), value.size());
+    }
+  }
+  RespCodec::AppendNull(expected);
+  AppendCommand(request, del);
+  RespCodec::AppendInteger(expected, 0);
+  del.assign(1, "DEL");
+  del.insert(del.end(), names.begin(), names.end());
+  AppendCommand(request, del);
+  RespCodec::AppendInteger(expected, keys - keys / 2);
+  AppendCommand(request, {"PING"});
+  RespCodec::AppendStatus(expected, "PONG");
+}
+static bool WriteAll(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("send");
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+//收齐expected.size()字节，边收边比对，出错时打印第一个不同的位置
+static bool ReadExpected(int fd, const std::string& expected, int conn, int round) {
+  std::string received;
+  char buffer[READ_BUFSIZE];
+  while (received.size() < expected.size()) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int ret = poll(&pfd, 1, READ_TIMEOUT_MS);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      std::cerr << "connection " << conn << " round " << round << ": timed out after " << received.size() << " of " << expected.size() << " bytes" << std::endl;
+      return false;
+    }
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      std::cerr << "connection " << conn << " round " << round << ": connection closed after " << received.size() << " of " << expected.size() << " bytes" << std::endl;
+      return false;
+    }
+    received.append(buffer, n);
+    size_t limit = std::min(received.size(), expected.size());
+    auto diff = std::mismatch(expected.begin(), expected.begin() + limit, received.begin());
+    if (diff.first != expected.begin() + limit || received.size() > expected.size()) {
+      size_t offset = diff.first - expected.begin();
+      size_t start = offset > 32 ? offset - 32 : 0;
+      std::cerr << "connection " << conn << " round " << round << ": reply differs at byte " << offset << "\n  expected: "
+                << expected.substr(start, 64) << "\n  received: " << received.substr(start, 64) << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+int main(int argc, char* argv[]) {
+  int conns = 8;
+  int rounds = 100;
+  int keys = 16;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:k:")) != -1) {
+    switch (opt) {
+      case 'c': conns = atoi(optarg); break;
+      case 'n': rounds = atoi(optarg); break;
+      case 'k': keys = atoi(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-c conns] [-n rounds] [-k keys] addr" << std::endl;
+        return 1;
+    }
+  }
+  SockAddress addr;
+  if (argc - optind != 1 || conns <= 0 || rounds <= 0 || keys < 2) {
+    std::cerr << "usage: " << argv[0] << " [-c conns] [-n rounds] [-k keys] addr" << std::endl;
+    return 1;
+  }
+  if (!SockAddress::Parse(argv[optind], addr)) {
+    std::cerr << "invalid address: " << argv[optind] << std::endl;
+    return 1;
+  }
+  //键带上进程号，不和服务器里已有的数据冲突
+  std::string request, expected;
+  BuildRound("kvcheck:" + std::to_string(getpid()) + ":", keys, request, expected);
+  for (int conn = 0; conn < conns; ++conn) {
+    int fd = socket(addr.Family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      perror("socket");
+      return 1;
+    }
+    if (connect(fd, addr.GetSockAddr(), addr.Length()) < 0) {
+      perror("connect");
+      close(fd);
+      return 1;
+    }
+    for (int round = 0; round < rounds; ++round) {
+      if (!WriteAll(fd, request) || !ReadExpected(fd, expected, conn, round)) {
+        close(fd);
+        return 1;
+      }
+    }
+    close(fd);
+  }
+  std::cout << "ok: " << conns << " connections, " << rounds << " rounds of " << keys << "-key MGET/DEL" << std::endl;
+  return 0;
+}
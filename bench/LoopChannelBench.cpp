@@ -0,0 +1,121 @@
+//loop间消息开销测试：一个loop向另一个loop连续发送count条小消息，比较AddTask和LoopChannels
+//AddTask每条消息要加锁、构造std::function、写一次eventfd；LoopChannels写进无锁环形队列，只在队列由空变非空时唤醒
+//生产者每次最多连发BURST条，之后把自己重新投递到本loop让出；队列满时先让出CPU再重新投递
+//用法：LoopChannelBench [-n count]
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <stdio.h>
+#include <unistd.h>
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "LoopChannel.h"
+#define BURST 64 //生产者每次连发的消息数
+#define CHANNEL_CAPACITY 1024
+struct BenchMessage {
+  uint64_t seq;
+};
+//消费者收齐后通知主线程
+struct Consumer {
+  uint64_t expected;
+  uint64_t received;
+  uint64_t sum;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool done;
+  explicit Consumer(uint64_t n) : expected(n), received(0), sum(0), done(false) {}
+  void OnMessage(uint64_t seq) {
+    sum += seq;
+    if (++received == expected) {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      cond.notify_one();
+    }
+  }
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!done) {
+      cond.wait(lock);
+    }
+  }
+};
+static void ProduceTasks(EventLoop* self, EventLoop* peer, Consumer* consumer, uint64_t next, uint64_t count) {
+  for (int i = 0; i < BURST && next < count; ++i, ++next) {
+    uint64_t seq = next;
+    peer->AddTask([consumer, seq]() { consumer->OnMessage(seq); });
+  }
+  if (next < count) {
+    self->AddTask(std::bind(&ProduceTasks, self, peer, consumer, next, count));
+  }
+}
+static void ProduceChannel(EventLoop* self, LoopChannels<BenchMessage>* channels, uint64_t next, uint64_t count) {
+  for (int i = 0; i < BURST && next < count; ++i, ++next) {
+    BenchMessage message;
+    message.seq = next;
+    if (!channels->Send(0, 1, message)) {
+      std::this_thread::yield(); //队列满，让消费者线程有机会运行（单核机器上尤其需要）
+      break;
+    }
+  }
+  if (next < count) {
+    self->AddTask(std::bind(&ProduceChannel, self, channels, next, count));
+  }
+}
+int main(int argc, char* argv[]) {
+  uint64_t count = 10000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n': count = strtoull(optarg, NULL, 10); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n count]" << std::endl;
+        return 1;
+    }
+  }
+  if (count == 0) {
+    std::cerr << "usage: " << argv[0] << " [-n count]" << std::endl;
+    return 1;
+  }
+  std::unique_ptr<EventLoopThread> producerthread(new EventLoopThread());
+  std::unique_ptr<EventLoopThread> consumerthread(new EventLoopThread());
+  producerthread->Start();
+  consumerthread->Start();
+  EventLoop* producer = producerthread->GetLoop();
+  EventLoop* consumer = consumerthread->GetLoop();
+  uint64_t expectedsum = count * (count - 1) / 2;
+  {
+    Consumer state(count);
+    auto start = std::chrono::steady_clock::now();
+    producer->AddTask(std::bind(&ProduceTasks, producer, consumer, &state, 0, count));
+    state.Wait();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("AddTask       messages=%llu %.1f ns/message%s\n", static_cast<unsigned long long>(count), ns / count,
+           state.sum == expectedsum ? "" : " (checksum mismatch)");
+  }
+  {
+    Consumer state(count);
+    std::vector<EventLoop*> loops;
+    loops.push_back(producer);
+    loops.push_back(consumer);
+    LoopChannels<BenchMessage> channels(loops, CHANNEL_CAPACITY, [&state](size_t, BenchMessage& message) {
+      state.OnMessage(message.seq);
+    });
+    channels.Start();
+    auto start = std::chrono::steady_clock::now();
+    producer->AddTask(std::bind(&ProduceChannel, producer, &channels, 0, count));
+    state.Wait();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("LoopChannels  messages=%llu %.1f ns/message%s\n", static_cast<unsigned long long>(count), ns / count,
+           state.sum == expectedsum ? "" : " (checksum mismatch)");
+    //收件箱登记在loop里，loop退出后通道才能析构
+    producerthread.reset();
+    consumerthread.reset();
+  }
+  return 0;
+}
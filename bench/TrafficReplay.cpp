@@ -0,0 +1,347 @@
+//流量回放：按服务器用-P录制的文件重放每个连接的请求字节流，统计每次请求到收齐对应回复的延迟
+//用法：TrafficReplay [-s speed] [-x copies] [-t idlems] capture addr
+//  -s speed 回放速度，1为按录制时的时间间隔，2为两倍速，0为不等时间、收齐上一个回复就发下一个请求
+//  -x copies 每个录制的连接同时回放copies份，放大并发
+//  -t idlems 超过该时间没有任何收发就结束，没收齐的回复计为未完成
+//每次读到的数据算一个请求，它之后、下一次读到数据之前服务器发出的字节数即期望的回复长度；
+//回复只按长度比对，内容随时间变化（如TTL）不影响回放
+#include <iostream>
+#include <vector>
+#include <string>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "SockAddress.h"
+#include "TrafficCapture.h"
+#define MAX_EVENTS 1024
+#define READ_BUFSIZE 65536
+//一次请求
+struct Step {
+  int64_t time;//录制时距连接建立的时间，单位ns
+  std::string data;
+  uint64_t expected;//到这次请求为止累计期望收到的回复字节数
+  bool measured;//这次请求有回复，计入延迟统计
+};
+//录制的一个连接
+struct Script {
+  int64_t opentime;//录制时连接建立的时间，单位ns
+  std::vector<Step> steps;
+};
+//回放中的一个连接
+struct Replay {
+  const Script* script;
+  int fd;
+  int64_t opentime;//计划的建立时间
+  size_t next;//下一个要发送的请求
+  size_t acked;//回复已收齐的请求数
+  std::string output;//还没写进socket的数据
+  uint64_t received;
+  std::vector<int64_t> senttime;//每个请求的发送时间
+  bool done;
+};
+static int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+static void BuildScripts(const std::vector<TrafficCapture::Event>& events, std::vector<Script>& scripts) {
+  uint64_t connid = 0;
+  uint64_t expected = 0;
+  for (auto &event : events) {
+    if (scripts.empty() || event.connid != connid) {
+      connid = event.connid;
+      expected = 0;
+      scripts.push_back(Script());
+      scripts.back().opentime = event.time;
+    }
+    Script& script = scripts.back();
+    if (event.type == TrafficCapture::CAPTURE_IN) {
+      Step step;
+      step.time = event.time - script.opentime;
+      step.data = event.data;
+      step.expected = expected;
+      step.measured = false;
+      script.steps.push_back(std::move(step));
+    } else if (event.type == TrafficCapture::CAPTURE_OUT) {
+      //第一次请求之前服务器主动发的数据算进第一个请求的期望回复
+      expected += event.data.size();
+      if (!script.steps.empty()) {
+        script.steps.back().expected = expected;
+        script.steps.back().measured = true;
+      }
+    }
+  }
+  //没有请求的连接不回放
+  scripts.erase(std::remove_if(scripts.begin(), scripts.end(), [](const Script& script) {
+    return script.steps.empty();
+  }), scripts.end());
+}
+static bool Connect(const SockAddress& addr, Replay& replay) {
+  replay.fd = socket(addr.Family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (replay.fd < 0) {
+    perror("socket");
+    return false;
+  }
+  if (!addr.IsUnix()) {
+    int on = 1;
+    setsockopt(replay.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  if (connect(replay.fd, addr.GetSockAddr(), addr.Length()) < 0 && errno != EINPROGRESS) {
+    perror("connect");
+    close(replay.fd);
+    replay.fd = -1;
+    return false;
+  }
+  return true;
+}
+int main(int argc, char* argv[]) {
+  double speed = 1;
+  int copies = 1;
+  int idlems = 5000;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:x:t:")) != -1) {
+    switch (opt) {
+      case 's': speed = atof(optarg); break;
+      case 'x': copies = atoi(optarg); break;
+      case 't': idlems = atoi(optarg); break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-s speed] [-x copies] [-t idlems] capture addr" << std::endl;
+        return 1;
+    }
+  }
+  SockAddress addr;
+  if (argc - optind != 2 || speed < 0 || copies <= 0 || idlems <= 0) {
+    std::cerr << "usage: " << argv[0] << " [-s speed] [-x copies] [-t idlems] capture addr" << std::endl;
+    return 1;
+  }
+  if (!SockAddress::Parse(argv[optind + 1], addr)) {
+    std::cerr << "invalid address: " << argv[optind + 1] << std::endl;
+    return 1;
+  }
+  std::vector<TrafficCapture::Event> events;
+  if (!TrafficCapture::Load(argv[optind], events)) {
+    return 1;
+  }
+  std::vector<Script> scripts;
+  BuildScripts(events, scripts);
+  events.clear();
+  if (scripts.empty()) {
+    std::cerr << "no requests in capture" << std::endl;
+    return 1;
+  }
+  int64_t firstopen = scripts.front().opentime;
+  for (auto &script : scripts) {
+    firstopen = std::min(firstopen, script.opentime);
+  }
+  std::vector<Replay> replays(scripts.size() * copies);
+  for (size_t i = 0; i < replays.size(); ++i) {
+    Replay& replay = replays[i];
+    replay.script = &scripts[i % scripts.size()];
+    replay.fd = -1;
+    replay.opentime = speed > 0 ? static_cast<int64_t>((replay.script->opentime - firstopen) / speed) : 0;
+    replay.next = 0;
+    replay.acked = 0;
+    replay.received = 0;
+    replay.senttime.resize(replay.script->steps.size(), 0);
+    replay.done = false;
+  }
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    perror("epoll_create1");
+    return 1;
+  }
+  //按计划时间排队的建立连接和发送请求，值为replays的下标
+  typedef std::pair<int64_t, size_t> Action;
+  std::priority_queue<Action, std::vector<Action>, std::greater<Action> > actions;
+  for (size_t i = 0; i < replays.size(); ++i) {
+    actions.push(Action(replays[i].opentime, i));
+  }
+  std::vector<int64_t> latencies;
+  uint64_t sentbytes = 0, receivedbytes = 0, requests = 0, failed = 0;
+  size_t remaining = replays.size();
+  int64_t start = NowNs();
+  int64_t lastactivity = start;
+  char buf[READ_BUFSIZE];
+  struct epoll_event evs[MAX_EVENTS];
+  //把请求写进socket，写不完时关注可写事件
+  auto flush = [&](size_t index) {
+    Replay& replay = replays[index];
+    while (!replay.output.empty()) {
+      ssize_t n = write(replay.fd, replay.output.data(), replay.output.size());
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && errno == EAGAIN) break;
+      if (n <= 0) return false;
+      replay.output.erase(0, n);
+      sentbytes += n;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (replay.output.empty() ? 0 : EPOLLOUT);
+    ev.data.u64 = index;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, replay.fd, &ev);
+    return true;
+  };
+  auto finish = [&](size_t index, bool ok) {
+    Replay& replay = replays[index];
+    if (replay.done) return;
+    replay.done = true;
+    --remaining;
+    if (!ok) ++failed;
+    if (replay.fd >= 0) {
+      close(replay.fd);
+      replay.fd = -1;
+    }
+  };
+  //收齐回复的请求计入延迟，全部收齐后关闭连接
+  auto acknowledge = [&](size_t index, int64_t now) {
+    Replay& replay = replays[index];
+    const Script& script = *replay.script;
+    while (replay.acked < replay.next && replay.received >= script.steps[replay.acked].expected) {
+      if (script.steps[replay.acked].measured) {
+        latencies.push_back(now - replay.senttime[replay.acked]);
+      }
+      ++replay.acked;
+    }
+    if (replay.acked == script.steps.size() && replay.output.empty()) {
+      finish(index, true);
+    }
+  };
+  //发送已到计划时间的请求；速度为0时上一个请求的回复收齐才发下一个
+  auto schedule = [&](size_t index, int64_t now) {
+    Replay& replay = replays[index];
+    const Script& script = *replay.script;
+    while (replay.next < script.steps.size()) {
+      const Step& step = script.steps[replay.next];
+      if (speed > 0) {
+        int64_t due = replay.opentime + static_cast<int64_t>(step.time / speed);
+        if (due > now) {
+          actions.push(Action(due, index));
+          return;
+        }
+      } else {
+        //没有回复的请求不用等
+        acknowledge(index, now);
+        if (replay.done || replay.acked < replay.next) {
+          return;
+        }
+      }
+      replay.output += step.data;
+      replay.senttime[replay.next++] = now;
+      ++requests;
+    }
+  };
+  while (remaining > 0) {
+    int64_t now = NowNs() - start;
+    while (!actions.empty() && actions.top().first <= now) {
+      size_t index = actions.top().second;
+      actions.pop();
+      Replay& replay = replays[index];
+      if (replay.done) continue;
+      if (replay.fd < 0) {
+        if (!Connect(addr, replay)) {
+          finish(index, false);
+          continue;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = index;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, replay.fd, &ev);
+      }
+      schedule(index, now);
+      if (!replay.done && !flush(index)) {
+        finish(index, false);
+        continue;
+      }
+      acknowledge(index, now); //最后几个请求可能没有回复
+    }
+    int timeout = idlems;
+    if (!actions.empty()) {
+      timeout = static_cast<int>(std::min<int64_t>((actions.top().first - now) / 1000000 + 1, idlems));
+    }
+    int n = epoll_wait(epfd, evs, MAX_EVENTS, timeout);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      return 1;
+    }
+    now = NowNs() - start;
+    if (n > 0) {
+      lastactivity = now + start;
+    } else if (actions.empty() && NowNs() - lastactivity >= static_cast<int64_t>(idlems) * 1000000) {
+      break;
+    }
+    for (int i = 0; i < n; ++i) {
+      size_t index = evs[i].data.u64;
+      Replay& replay = replays[index];
+      if (replay.done) continue;
+      if (evs[i].events & EPOLLOUT) {
+        if (!flush(index)) {
+          finish(index, false);
+          continue;
+        }
+        acknowledge(index, now);
+        if (replay.done) continue;
+      }
+      if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        bool closed = false;
+        for (;;) {
+          ssize_t len = read(replay.fd, buf, sizeof(buf));
+          if (len > 0) {
+            replay.received += len;
+            receivedbytes += len;
+            continue;
+          }
+          if (len < 0 && errno == EINTR) continue;
+          closed = len == 0 || errno != EAGAIN;
+          break;
+        }
+        acknowledge(index, now);
+        if (replay.done) continue;
+        if (closed) {
+          finish(index, false);
+          continue;
+        }
+        if (speed == 0) {
+          schedule(index, now);
+          if (!replay.done && !flush(index)) {
+            finish(index, false);
+            continue;
+          }
+          acknowledge(index, now);
+        }
+      }
+    }
+  }
+  double seconds = (NowNs() - start) / 1e9;
+  size_t incomplete = remaining;
+  for (size_t i = 0; i < replays.size(); ++i) {
+    finish(i, true);
+  }
+  close(epfd);
+  std::sort(latencies.begin(), latencies.end());
+  printf("connections=%zu requests=%llu sent=%llu received=%llu failed=%llu incomplete=%zu time=%.2fs rate=%.0f req/s\n",
+         replays.size(), static_cast<unsigned long long>(requests), static_cast<unsigned long long>(sentbytes),
+         static_cast<unsigned long long>(receivedbytes), static_cast<unsigned long long>(failed), incomplete,
+         seconds, requests / seconds);
+  if (latencies.empty()) {
+    return failed == 0 && incomplete == 0 ? 0 : 1;
+  }
+  double sum = 0;
+  for (auto latency : latencies) sum += latency;
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))] / 1000.0;
+  };
+  printf("latency: avg=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+         sum / latencies.size() / 1000.0, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+         latencies.back() / 1000.0);
+  return failed == 0 && incomplete == 0 ? 0 : 1;
+}
@@ -1,6 +1,14 @@
 #include <signal.h>
+#include <unistd.h>
+#include <string>
 #include "EventLoop.h"
 #include "EchoServer.h"
+#include "RelayServer.h"
+#include "CoServer.h"
+#include "AdminServer.h"
+#include "KvServer.h"
+#include <cstring>
+#include <sstream>
 EventLoop* loop;
 static void sighandler1(int signo) {
     exit(0);
@@ -9,6 +17,20 @@ static void sighandler2( int sig_no )
 {   
     loop->quit(); // 退出事件循环
 }
+#ifdef ENABLE_COROUTINES
+//协程版回显：按行读取，每行回复一次；"sleep <ms>"行先在loop上睡眠再回复
+static Task<> CoEcho(CoConnection& conn) {
+  std::string line;
+  while (co_await conn.ReadUntil("\n", line)) {
+    if (line.compare(0, 6, "sleep ") == 0) {
+      co_await conn.Sleep(atoi(line.c_str() + 6));
+    }
+    if (!co_await conn.Write("reply Echo: " + line)) {
+      break;
+    }
+  }
+}
+#endif
 int main(int argc,char *argv[]){
   signal(SIGUSR1, sighandler1);
   signal(SIGUSR2, sighandler2);
@@ -16,16 +38,287 @@ int main(int argc,char *argv[]){
   signal(SIGPIPE, SIG_IGN);  //SIG_IGN,系统函数，忽略信号的处理程序,客户端发送RST包后，服务器还调用write会触发
   int port=80;
   int iothreadnum=4;
-  if(argc==3)  //如果有参数，端口号和IO线程数
+  //-u 热升级控制socket路径：该路径上已有旧进程时接管它的监听socket，否则正常启动并等待下一次升级
+  //-c 热升级时空闲连接也一并交接
+  //-l addr 监听地址，可以是ip:port、[ipv6]:port、unix:/path或@name（抽象命名空间），指定后忽略port参数
+  //-r ip:port 转发模式，把每个连接转发到上游地址
+  //-U port 同时提供UDP回显，-G 开启UDP GRO/GSO
+  //-D secs 开启TCP_DEFER_ACCEPT，-F qlen 开启TCP Fast Open，-B bytes 连接收发缓冲区大小，-K idle 开启keepalive，-N 不关闭Nagle，-A 开启自动合并写，-Z bytes 不小于该长度的发送走零拷贝
+  //-T cert.pem:key.pem 开启TLS（需要以-DENABLE_TLS=ON编译），握手后尽量切换到内核TLS
+  //-M bytes[:idlems] 连接缓冲内存上限，超过后拒绝新连接并关闭占用最多的连接；idlems为空闲连接释放缓冲的时间
+  //-C 协程模式，按行回显（需要以-DENABLE_COROUTINES=ON编译）
+  //-W stallms[:budgetus[:tasklimit]] 开启loop卡顿检测，IO线程卡住超过stallms打印调用栈，单个回调超过budgetus记为慢回调
+  //-a addr 管理端口地址，按行接收命令：loops、addloop、drainloop
+  //-E min:max IO线程按利用率在min到max之间弹性伸缩
+  //-k KV模式，提供Redis协议的内存KV服务，数据按IO线程分片
+  //-R ms 每隔ms检查一次各IO线程的利用率，把热点线程上流量大的连接迁到空闲线程
+  //-z threshold[:level[:workers]] 开启压缩（需要以-DENABLE_COMPRESSION=ON编译），两端按帧收发，不小于threshold字节的数据用zlib压缩，
+  //  level默认1，workers大于0时压缩交给这么多个压缩线程
+  //-H 各IO线程的发送缓冲池用大页映射（需要预留大页，否则退回透明大页），退出时打印缓冲池统计
+  //-S io_us:task_us 开启loop调度：监听socket和管理连接先处理，每轮分发事件和执行任务分别最多io_us、task_us，超出的推迟到下一轮，0为不限制
+  //-P path[:bytes] 录制每个连接收发的数据到path，文件最大bytes（默认1GB），用bench/TrafficReplay回放
+  std::string upgradepath;
+  int udpport=0;
+  UdpServer::Options udpoptions;
+  ServerOptions serveroptions;
+  bool handoverconns=false;
+  std::string upstream;
+  std::string listenspec;
+  std::vector<std::string> extralistenspecs;
+  std::string tlsspec;
+  std::string compressspec;
+  bool coroutine=false;
+  bool kvmode=false;
+  std::string adminspec;
+  std::string capturepath;
+  size_t capturebytes=1UL<<30;
+  int opt;
+  while((opt=getopt(argc,argv,"u:cl:L:r:U:GD:F:B:K:NAZ:T:W:CM:a:E:R:kP:S:Hz:"))!=-1)
+  {
+    switch(opt)
+    {
+      case 'u': upgradepath=optarg; break;
+      case 'c': handoverconns=true; break;
+      case 'l': listenspec=optarg; break;
+      case 'L': extralistenspecs.push_back(optarg); break;
+      case 'r': upstream=optarg; break;
+      case 'U': udpport=atoi(optarg); break;
+      case 'G': udpoptions.gro=udpoptions.gso=true; break;
+      case 'D': serveroptions.deferaccept=atoi(optarg); break;
+      case 'F': serveroptions.fastopenqueue=atoi(optarg); break;
+      case 'B': serveroptions.sndbuf=serveroptions.rcvbuf=atoi(optarg); break;
+      case 'K': serveroptions.keepalive=true; serveroptions.keepidle=atoi(optarg); break;
+      case 'N': serveroptions.nodelay=false; break;
+      case 'A': serveroptions.autocork=true; break;
+      case 'Z': serveroptions.zerocopythreshold=atoi(optarg); break;
+      case 'T': tlsspec=optarg; break;
+      case 'z': compressspec=optarg; break;
+      case 'C': coroutine=true; break;
+      case 'k': kvmode=true; break;
+      case 'H': serveroptions.hugepages=true; break;
+      case 'P':
+      {
+        capturepath=optarg;
+        size_t colon=capturepath.rfind(':');
+        if(colon!=std::string::npos)
+        {
+          capturebytes=strtoull(capturepath.c_str()+colon+1, NULL, 10);
+          capturepath.resize(colon);
+        }
+        break;
+      }
+      case 'a': adminspec=optarg; break;
+      case 'R': serveroptions.rebalancems=atoi(optarg); break;
+      case 'E':
+      {
+        char* end = optarg;
+        serveroptions.minloops=strtol(end, &end, 10);
+        if(*end==':') serveroptions.maxloops=strtol(end+1, &end, 10);
+        break;
+      }
+      case 'M':
+      {
+        char* end = optarg;
+        serveroptions.memorylimit=strtoull(end, &end, 10);
+        if(*end==':') serveroptions.idleshrinkms=strtol(end+1, &end, 10);
+        break;
+      }
+      case 'S':
+      {
+        char* end = optarg;
+        serveroptions.scheduling=true;
+        serveroptions.iosliceus=strtol(end, &end, 10);
+        if(*end==':') serveroptions.tasksliceus=strtol(end+1, &end, 10);
+        break;
+      }
+      case 'W':
+      {
+        char* end = optarg;
+        serveroptions.stallms=strtol(end, &end, 10);
+        if(*end==':') serveroptions.callbackbudgetus=strtol(end+1, &end, 10);
+        if(*end==':') serveroptions.taskqueuelimit=strtoul(end+1, &end, 10);
+        break;
+      }
+      default:
+        std::cerr<<"usage: "<<argv[0]<<" [-u upgrade_socket] [-c] [-l listen_addr] [-L [name=]extra_listen_addr]... [-r upstream_ip:port] [-U udpport [-G]] [-D secs] [-F qlen] [-B bytes] [-K idle] [-N] [-A] [-Z bytes] [-T cert:key] [-W stallms[:budgetus[:tasklimit]]] [-C] [-M bytes[:idlems]] [-a admin_addr] [-E min:max] [-R ms] [-k] [-P capture[:bytes]] [-S io_us:task_us] [-H] [-z threshold[:level[:workers]]] [port iothreadnum]"<<std::endl;
+        return 1;
+    }
+  }
+  if(argc-optind==2)  //如果有参数，端口号和IO线程数
   {
-    port=atoi(argv[1]);
-    iothreadnum=atoi(argv[2]);
+    port=atoi(argv[optind]);
+    iothreadnum=atoi(argv[optind+1]);
   
   }
+  SockAddress listenaddr=SockAddress::Inet(port);
+  if(!listenspec.empty() && !SockAddress::Parse(listenspec, listenaddr))
+  {
+    std::cerr<<"invalid listen address: "<<listenspec<<std::endl;
+    return 1;
+  }
+  //附加监听的格式为[name=]addr，没有名字时按顺序命名
+  std::vector<std::pair<std::string, SockAddress> > extralisteners;
+  for(size_t i=0;i<extralistenspecs.size();++i)
+  {
+    std::string spec=extralistenspecs[i];
+    std::string name="listener"+std::to_string(i+1);
+    size_t equal=spec.find('=');
+    if(equal!=std::string::npos)
+    {
+      name=spec.substr(0, equal);
+      spec.erase(0, equal+1);
+    }
+    SockAddress extraaddr;
+    if(name.empty() || !SockAddress::Parse(spec, extraaddr))
+    {
+      std::cerr<<"invalid extra listen address: "<<extralistenspecs[i]<<std::endl;
+      return 1;
+    }
+    extralisteners.push_back(std::make_pair(name, extraaddr));
+  }
+  std::shared_ptr<TlsContext> tlscontext;
+  if(!tlsspec.empty())
+  {
+    size_t colon = tlsspec.find(':');
+    tlscontext.reset(new TlsContext());
+    if(colon == std::string::npos || !tlscontext->Init(tlsspec.substr(0, colon), tlsspec.substr(colon + 1)))
+    {
+      std::cerr<<"invalid tls certificate/key: "<<tlsspec<<std::endl;
+      return 1;
+    }
+  }
+  std::shared_ptr<CompressContext> compresscontext;
+  if(!compressspec.empty())
+  {
+    char* end = const_cast<char*>(compressspec.c_str());
+    size_t threshold=strtoull(end, &end, 10);
+    int level=1;
+    int workers=0;
+    if(*end==':') level=strtol(end+1, &end, 10);
+    if(*end==':') workers=strtol(end+1, &end, 10);
+    compresscontext.reset(new CompressContext());
+    if(!compresscontext->Init(threshold, level, workers))
+    {
+      std::cerr<<"invalid compression options: "<<compressspec<<std::endl;
+      return 1;
+    }
+  }
   EventLoop loop1;
   loop = &loop1; // 设置全局事件循环
-  EchoServer server(&loop1, port, iothreadnum);
+  if(!upstream.empty())
+  {
+    struct sockaddr_in upstreamaddr;
+    memset(&upstreamaddr, 0, sizeof(upstreamaddr));
+    upstreamaddr.sin_family = AF_INET;
+    size_t colon = upstream.rfind(':');
+    if(colon == std::string::npos || inet_pton(AF_INET, upstream.substr(0, colon).c_str(), &upstreamaddr.sin_addr) != 1)
+    {
+      std::cerr<<"invalid upstream address: "<<upstream<<std::endl;
+      return 1;
+    }
+    upstreamaddr.sin_port = htons(atoi(upstream.c_str() + colon + 1));
+    RelayServer relay(&loop1, listenaddr, iothreadnum, upstreamaddr, serveroptions);
+    relay.Start();
+    loop1.loop();
+    return 0;
+  }
+  if(kvmode)
+  {
+    KvServer kvserver(&loop1, listenaddr, iothreadnum, serveroptions);
+    if(!capturepath.empty() && !kvserver.GetServer().EnableCapture(capturepath, capturebytes))
+    {
+      return 1;
+    }
+    if(compresscontext)
+    {
+      kvserver.GetServer().EnableCompression(compresscontext);
+    }
+    kvserver.Start();
+    loop1.loop();
+    return 0;
+  }
+  if(coroutine)
+  {
+#ifdef ENABLE_COROUTINES
+    CoServer coserver(&loop1, listenaddr, iothreadnum, serveroptions);
+    coserver.SetHandler(CoEcho);
+    coserver.Start();
+    loop1.loop();
+    return 0;
+#else
+    std::cerr<<"coroutine mode is not compiled in, reconfigure with -DENABLE_COROUTINES=ON"<<std::endl;
+    return 1;
+#endif
+  }
+  EchoServer server(&loop1, listenaddr, iothreadnum, serveroptions);
+  if(!upgradepath.empty())
+  {
+    server.EnableHotUpgrade(upgradepath, handoverconns);
+  }
+  if(tlscontext)
+  {
+    server.EnableTls(tlscontext);
+  }
+  if(compresscontext)
+  {
+    server.EnableCompression(compresscontext);
+  }
+  if(udpport>0)
+  {
+    server.EnableUdp(udpport, udpoptions);
+  }
+  if(!capturepath.empty() && !server.EnableCapture(capturepath, capturebytes))
+  {
+    return 1;
+  }
+  //附加监听：同一个TcpServer和同一组IO线程在多个地址上提供回显，如同时监听TCP端口和Unix域socket
+  for(auto &extra : extralisteners)
+  {
+    server.AddListener(extra.first, extra.second, serveroptions);
+  }
   server.Start();
+  std::unique_ptr<AdminServer> admin;
+  if(!adminspec.empty())
+  {
+    SockAddress adminaddr;
+    if(!SockAddress::Parse(adminspec, adminaddr))
+    {
+      std::cerr<<"invalid admin address: "<<adminspec<<std::endl;
+      return 1;
+    }
+    //管理端口独立监听在主loop上，不受业务连接数、内存上限和IO线程卡顿的影响
+    admin.reset(new AdminServer(&loop1, adminaddr));
+    EchoServer* echo = &server;
+    admin->RegisterCommand("loops", "list IO loops: connections, buffer memory, buffer pool usage, draining", [echo](const std::vector<std::string>&) {
+      std::ostringstream out;
+      std::vector<EventLoop*> loops = echo->GetThreadPool()->GetAllLoops();
+      for(size_t i=0;i<loops.size();++i)
+      {
+        BufferPool::Stats pool = loops[i]->GetBufferPool()->GetStats();
+        out<<i<<": "<<loops[i]->ConnectionCount()<<" connections, "<<loops[i]->BufferMemory()<<" bytes, pool "
+           <<pool.inuse<<"/"<<pool.mapped<<" bytes"<<(echo->GetThreadPool()->IsDraining(loops[i]) ? ", draining" : "")<<"\n";
+      }
+      return out.str();
+    });
+    admin->RegisterCommand("addloop", "start one more IO loop", [echo](const std::vector<std::string>&) {
+      return std::string(echo->AddLoop() ? "ok" : "cannot add loop");
+    });
+    admin->RegisterCommand("drainloop", "stop assigning connections to the newest IO loop and remove it when idle", [echo](const std::vector<std::string>&) {
+      return std::string(echo->DrainLoop() ? "ok" : "cannot drain loop");
+    });
+    admin->RegisterCommand("listeners", "list listeners: address, connections, accepted, rejected", [echo](const std::vector<std::string>&) {
+      std::ostringstream out;
+      out<<"main: "<<echo->GetServer()->ConnectionCount()<<" connections in total, "<<echo->RefusedConnections()<<" refused\n";
+      for(auto listener : echo->GetServer()->GetListeners())
+      {
+        TcpServer::Listener::Stats& stats = listener->GetStats();
+        out<<listener->GetName()<<" "<<listener->GetAddress().ToString()<<": "<<stats.connections<<" connections, "
+           <<stats.accepted<<" accepted, "<<stats.rejected<<" rejected\n";
+      }
+      return out.str();
+    });
+    admin->Start();
+  }
   try
   {
     loop1.loop(); // 启动事件循环
@@ -34,4 +327,61 @@ int main(int argc,char *argv[]){
   {
     std::cerr <<"bad_alloc caught in ThreadPool::ThreadFunc task: " << ba.what() << '\n';
   }
+  if(serveroptions.autocork)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"autocork: "<<stats.corkedsends<<" sends coalesced into "<<stats.corkflushes<<" writes, "
+             <<(stats.corkedsends-stats.corkflushes)<<" syscalls saved"<<std::endl;
+  }
+  if(serveroptions.zerocopythreshold>0)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"zerocopy: "<<stats.zerocopy.sends<<" sends, "<<stats.zerocopy.completions<<" completed, "
+             <<stats.zerocopy.copied<<" copied by kernel"<<std::endl;
+  }
+  if(serveroptions.stallms>0)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"stall: "<<stats.stalls<<" stalls, "<<stats.slowevents<<" slow callbacks, "<<stats.slowtasks<<" slow tasks, max "
+             <<stats.maxcallbackus<<" us, "<<stats.longtaskqueues<<" long task queues (max "<<stats.maxtaskqueue<<")"<<std::endl;
+  }
+  if(serveroptions.memorylimit>0 || serveroptions.idleshrinkms>0)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"memory: "<<server.BufferMemory()<<" bytes in buffers, "<<stats.buffershrinks<<" idle shrinks, "
+             <<stats.shedconnections<<" connections shed, "<<server.RefusedConnections()<<" refused"<<std::endl;
+  }
+  if(serveroptions.scheduling)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"schedule: io delay p50 "<<stats.iodelay.Percentile(0.5)<<" us, p99 "<<stats.iodelay.Percentile(0.99)
+             <<" us ("<<stats.iodelay.Count()<<" events, "<<stats.deferredevents<<" deferred); task delay p50 "
+             <<stats.taskdelay.Percentile(0.5)<<" us, p99 "<<stats.taskdelay.Percentile(0.99)<<" us ("
+             <<stats.taskdelay.Count()<<" tasks, "<<stats.deferredtasks<<" deferred)"<<std::endl;
+  }
+  if(serveroptions.hugepages)
+  {
+    BufferPool::Stats stats = server.BufferPoolStats();
+    std::cout<<"bufferpool: "<<stats.mapped<<" bytes mapped ("<<stats.hugemapped<<" on huge pages), "<<stats.inuse
+             <<" bytes in use, "<<stats.remotefrees<<" chunks returned by other threads"<<std::endl;
+  }
+  if(serveroptions.rebalancems>0)
+  {
+    EventLoop::LoopStats stats = server.GetLoopStats();
+    std::cout<<"rebalance: "<<stats.migrations<<" connections migrated"<<std::endl;
+  }
+  if(compresscontext)
+  {
+    CompressContext::Stats& stats = compresscontext->GetStats();
+    std::cout<<"compression: out "<<stats.framesout<<" frames ("<<stats.compressedout<<" compressed, "<<stats.plainout<<" -> "
+             <<stats.wireout<<" bytes, ratio "<<(stats.wireout>0 ? static_cast<double>(stats.plainout)/stats.wireout : 0)
+             <<", "<<stats.offloaded<<" batches offloaded), in "<<stats.framesin<<" frames ("<<stats.wirein<<" -> "<<stats.plainin
+             <<" bytes), cpu "<<stats.compressns/1000<<" us compress, "<<stats.decompressns/1000<<" us decompress"<<std::endl;
+  }
+  if(tlscontext)
+  {
+    TlsContext::Stats& stats = tlscontext->GetStats();
+    std::cout<<"tls: "<<stats.handshakes<<" handshakes, "<<stats.resumed<<" resumed, "<<stats.failed<<" failed, "
+             <<stats.ktls<<" on kernel TLS"<<std::endl;
+  }
 }
\ No newline at end of file